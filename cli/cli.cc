@@ -1,11 +1,1341 @@
 #include "cli.hh"
+#include "../lib/async.hh"
 #include "../lib/conv.hh"
+#include "../lib/parallel.hh"
+#include "../lib/image/drawer.hh"
+#include "../lib/image/mask.hh"
+#include "../lib/image/png.hh"
+#include "../lib/image/pnm.hh"
+#include "../lib/image/qoi.hh"
+#include "../lib/image/points.hh"
+#include "../lib/image/stamp.hh"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 
 
 namespace cli
 {
+[[nodiscard]] char const* InvalidUsage::what() const noexcept
+{
+	return "invalid usage";
+}
+
+[[nodiscard]] Arguments parse(int const argc, char* const argv[])
+{
+	// getopt keeps its state in globals.
+	static std::mutex mutex;
+	std::lock_guard const lock(mutex);
+
+	Arguments arguments;
+
+	char const* error_message = nullptr;
+
+	try
+	{
+		optind = 0;
+
+		int option_index = input_file_index;
+		int opt;
+
+		while ((opt = getopt_long(argc, argv, short_options, options, &option_index)) != -1)
+		{
+			switch (opt)
+			{
+			case 0:
+			{
+				char const* const option_name = options[option_index].name;
+
+				if (!std::strcmp(option_name, "chunks"))
+				{
+					arguments.with_chunks = true;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "serve"))
+				{
+					if (arguments.mode != Mode::None)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Serve;
+					arguments.socket_path = optarg;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "stats-pixels"))
+				{
+					if (arguments.mode != Mode::None)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Stats;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "compare"))
+				{
+					if (arguments.mode != Mode::None)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Compare;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "exact"))
+				{
+					if (arguments.mode != Mode::Compare)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.equality_only = true;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "tiles"))
+				{
+					if (arguments.mode != Mode::None)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Tiles;
+					break;
+				}
+
+				if (
+					!std::strcmp(option_name, "tile-size")
+					|| !std::strcmp(option_name, "tile-name")
+					|| !std::strcmp(option_name, "skip-blank")
+				)
+				{
+					if (arguments.mode != Mode::Tiles)
+					{
+						throw InvalidUsage();
+					}
+
+					if (!std::strcmp(option_name, "tile-size"))
+					{
+						arguments.tile_size = std::stoull(optarg);
+					}
+					else
+					if (!std::strcmp(option_name, "tile-name"))
+					{
+						arguments.tile_name = optarg;
+					}
+					else
+					{
+						arguments.without_blank_tiles = true;
+					}
+
+					break;
+				}
+
+				if (!std::strcmp(option_name, "workers"))
+				{
+					if (
+						arguments.mode != Mode::Serve
+						&& arguments.mode != Mode::Stats
+						&& arguments.mode != Mode::Compare
+						&& arguments.mode != Mode::Tiles
+					)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.workers = std::stoull(optarg);
+					break;
+				}
+
+				if (!std::strcmp(option_name, "prefetch"))
+				{
+					arguments.prefetch = std::stoull(optarg);
+					break;
+				}
+
+				if (!std::strcmp(option_name, "row-filter"))
+				{
+					constexpr std::pair<char const*, image::filter::Strategy> strategies[]{
+						{"adaptive", image::filter::Strategy::Adaptive},
+						{"default",  image::filter::Strategy::Default},
+						{"none",     image::filter::Strategy::None},
+						{"sub",      image::filter::Strategy::Sub},
+						{"up",       image::filter::Strategy::Up},
+						{"average",  image::filter::Strategy::Average},
+						{"paeth",    image::filter::Strategy::Paeth},
+					};
+
+					auto const it = std::find_if(
+						std::begin(strategies),
+						std::end(strategies),
+						[] (auto const& strategy) { return !std::strcmp(strategy.first, optarg); }
+					);
+
+					if (it == std::end(strategies))
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.row_filter = it->second;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "convert"))
+				{
+					constexpr char const* color_types[]{"gs", "gsa", "rgb", "rgba"};
+
+					auto const it = std::find_if(
+						std::begin(color_types),
+						std::end(color_types),
+						[] (char const* const color_type) { return !std::strcmp(color_type, optarg); }
+					);
+
+					if (it == std::end(color_types))
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.target_channels = it - std::begin(color_types) + 1;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "bit-depth"))
+				{
+					arguments.target_bit_depth = std::stoull(optarg);
+					break;
+				}
+
+				if (!std::strcmp(option_name, "scratch"))
+				{
+					arguments.scratch_directory = optarg;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "cache"))
+				{
+					arguments.cache_directory = optarg;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "cache-size"))
+				{
+					arguments.cache_size = std::stoull(optarg, nullptr, is_hex(optarg) ? 16 : 10);
+					break;
+				}
+
+				if (!std::strcmp(option_name, "optimize"))
+				{
+					arguments.with_optimization = true;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "format"))
+				{
+					if (!std::strcmp(optarg, "png"))
+					{
+						arguments.format = Format::Png;
+					}
+					else
+					if (!std::strcmp(optarg, "pnm"))
+					{
+						arguments.format = Format::Pnm;
+					}
+					else
+					if (!std::strcmp(optarg, "qoi"))
+					{
+						arguments.format = Format::Qoi;
+					}
+					else
+					{
+						throw InvalidUsage();
+					}
+
+					break;
+				}
+
+				if (!std::strcmp(option_name, "tolerance"))
+				{
+					if (arguments.shape != Shape::Flood)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.tolerance = std::stoull(optarg, nullptr, is_hex(optarg) ? 16 : 10);
+					break;
+				}
+
+				if (
+					!std::strcmp(option_name, "text")
+					|| !std::strcmp(option_name, "scale")
+					|| !std::strcmp(option_name, "font")
+				)
+				{
+					if (arguments.shape != Shape::Text)
+					{
+						throw InvalidUsage();
+					}
+
+					if (!std::strcmp(option_name, "text"))
+					{
+						arguments.text = optarg;
+					}
+					else
+					if (!std::strcmp(option_name, "scale"))
+					{
+						arguments.scale = std::stoull(optarg);
+					}
+					else
+					{
+						arguments.font_path = optarg;
+					}
+
+					break;
+				}
+
+				if (!std::strcmp(option_name, "points"))
+				{
+					if (arguments.shape != Shape::Polygon && arguments.shape != Shape::Polyline)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.points_path = optarg;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "fill-rule"))
+				{
+					if (arguments.shape != Shape::Polygon)
+					{
+						throw InvalidUsage();
+					}
+
+					if (!std::strcmp(optarg, "even-odd"))
+					{
+						arguments.fill_rule = image::polygon::FillRule::EvenOdd;
+					}
+					else
+					if (!std::strcmp(optarg, "non-zero"))
+					{
+						arguments.fill_rule = image::polygon::FillRule::NonZero;
+					}
+					else
+					{
+						throw InvalidUsage();
+					}
+
+					break;
+				}
+
+				if (!std::strcmp(option_name, "stamp"))
+				{
+					if (arguments.mode != Mode::None)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Stamp;
+					arguments.points_path = optarg;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "marker"))
+				{
+					if (arguments.mode != Mode::Stamp)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.marker = optarg;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "mask"))
+				{
+					arguments.mask_path = optarg;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "blur"))
+				{
+					constexpr std::pair<char const*, image::convolve::Blur> types[]{
+						{"box",      image::convolve::Blur::Box},
+						{"gaussian", image::convolve::Blur::Gaussian},
+						{"sharpen",  image::convolve::Blur::Sharpen},
+					};
+
+					auto const it = std::find_if(
+						std::begin(types),
+						std::end(types),
+						[] (auto const& type) { return !std::strcmp(type.first, optarg); }
+					);
+
+					if (arguments.mode != Mode::None || it == std::end(types))
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Convolve;
+					arguments.blur = it->second;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "kernel"))
+				{
+					if (arguments.mode != Mode::None)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Convolve;
+					arguments.kernel = string_to_kernel(optarg);
+					break;
+				}
+
+				if (
+					!std::strcmp(option_name, "rotate")
+					|| !std::strcmp(option_name, "flip")
+					|| !std::strcmp(option_name, "transpose")
+				)
+				{
+					using image::transform::Operation;
+
+					constexpr std::pair<char const*, Operation> operations[]{
+						{"rotate90",       Operation::Rotate90},
+						{"rotate180",      Operation::Rotate180},
+						{"rotate270",      Operation::Rotate270},
+						{"fliphorizontal", Operation::FlipHorizontal},
+						{"flipvertical",   Operation::FlipVertical},
+						{"transpose",      Operation::Transpose},
+					};
+
+					std::string const name = std::string(option_name) + (optarg ? optarg : "");
+
+					auto const it = std::find_if(
+						std::begin(operations),
+						std::end(operations),
+						[&name] (auto const& operation) { return name == operation.first; }
+					);
+
+					if (arguments.mode != Mode::None || it == std::end(operations))
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Transform;
+					arguments.operation = it->second;
+					break;
+				}
+
+				if (
+					!std::strcmp(option_name, "invert")
+					|| !std::strcmp(option_name, "gamma")
+					|| !std::strcmp(option_name, "levels")
+					|| !std::strcmp(option_name, "threshold")
+					|| !std::strcmp(option_name, "posterize")
+					|| !std::strcmp(option_name, "lut")
+				)
+				{
+					using image::tone::Operation;
+
+					// Tone options combine into a single curve.
+					if (arguments.mode != Mode::None && arguments.mode != Mode::Tone)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.mode = Mode::Tone;
+
+					image::tone::Step step{};
+
+					if (!std::strcmp(option_name, "invert"))
+					{
+						step.operation = Operation::Invert;
+					}
+					else
+					if (!std::strcmp(option_name, "gamma"))
+					{
+						step.operation = Operation::Gamma;
+						step.gamma = std::stod(optarg);
+
+						if (!std::isfinite(step.gamma) || step.gamma <= 0)
+						{
+							throw std::runtime_error("gamma must be positive");
+						}
+					}
+					else
+					if (!std::strcmp(option_name, "levels"))
+					{
+						math::Vector const levels = string_to_vector(optarg, point_delimiter);
+
+						if (levels.x < 0 || levels.y < 0 || levels.x > UINT32_MAX || levels.y > UINT32_MAX)
+						{
+							throw InvalidUsage();
+						}
+
+						step.operation = Operation::Levels;
+						step.black = levels.x;
+						step.white = levels.y;
+					}
+					else
+					if (!std::strcmp(option_name, "lut"))
+					{
+						step.operation = Operation::Table;
+						step.path = optarg;
+					}
+					else
+					{
+						std::uint64_t const level = std::stoull(optarg, nullptr, is_hex(optarg) ? 16 : 10);
+
+						step.operation = !std::strcmp(option_name, "threshold") ? Operation::Threshold : Operation::Posterize;
+						step.level = std::min<std::uint64_t>(level, UINT32_MAX);
+					}
+
+					arguments.tones.push_back(std::move(step));
+					break;
+				}
+
+				if (arguments.mode != Mode::Draw && arguments.mode != Mode::Convolve)
+				{
+					throw InvalidUsage();
+				}
+
+				math::Vector const position(string_to_vector(optarg, point_delimiter));
+
+				if (!std::strcmp(option_name, "start"))
+				{
+					arguments.start = position;
+					break;
+				}
+
+				if (!std::strcmp(option_name, "end"))
+				{
+					if (arguments.shape == Shape::Point)
+					{
+						throw InvalidUsage();
+					}
+
+					arguments.end = position;
+					break;
+				}
+
+				if (arguments.shape != Shape::Circle)
+				{
+					throw InvalidUsage();
+				}
+
+				if (!std::strcmp(option_name, "center"))
+				{
+					arguments.center = position;
+					break;
+				}
+
+				break;
+			}
+
+			case ShortOption::Out:
+				arguments.filepath_out = optarg;
+				break;
+
+			case ShortOption::Filter:
+			{
+				if (arguments.mode != Mode::None)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.mode = Mode::Filter;
+
+				std::size_t const length = std::strlen(optarg);
+
+				if (length < 1)
+				{
+					throw InvalidUsage();
+				}
+
+				if (length == 1)
+				{
+					if (char const* const ptr = std::strchr(truecolor_channels, tolower(optarg[0])); ptr)
+					{
+						arguments.channel = ptr - truecolor_channels;
+						break;
+					}
+				}
+
+				arguments.channel = std::stoull(optarg);
+				break;
+			}
+
+			case ShortOption::Draw:
+				if (arguments.mode != Mode::None)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.mode = Mode::Draw;
+
+				if (!std::strcmp(optarg, "point"))
+				{
+					arguments.shape = Shape::Point;
+				}
+				else
+				if (!std::strcmp(optarg, "line"))
+				{
+					arguments.shape = Shape::Line;
+				}
+				else
+				if (!std::strcmp(optarg, "rect") || !std::strcmp(optarg, "rectangle"))
+				{
+					arguments.shape = Shape::Rectangle;
+				}
+				else
+				if (!std::strcmp(optarg, "square"))
+				{
+					arguments.shape = Shape::Rectangle;
+				}
+				else
+				if (!std::strcmp(optarg, "circle"))
+				{
+					arguments.shape = Shape::Circle;
+				}
+				else
+				if (!std::strcmp(optarg, "flood"))
+				{
+					arguments.shape = Shape::Flood;
+				}
+				else
+				if (!std::strcmp(optarg, "text"))
+				{
+					arguments.shape = Shape::Text;
+				}
+				else
+				if (!std::strcmp(optarg, "polygon"))
+				{
+					arguments.shape = Shape::Polygon;
+				}
+				else
+				if (!std::strcmp(optarg, "polyline"))
+				{
+					arguments.shape = Shape::Polyline;
+				}
+				else
+				{
+					throw InvalidUsage();
+				}
+
+				break;
+
+			case ShortOption::Slice:
+				if (arguments.mode != Mode::None)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.mode = Mode::Slice;
+				arguments.slice_dimensions = string_to_vector(optarg, point_delimiter);
+				break;
+
+			case ShortOption::Color:
+				arguments.primary_value = std::stoull(optarg, nullptr, is_hex(optarg) ? 16 : 10);
+				break;
+
+			case ShortOption::Fill:
+				if (arguments.shape != Shape::Rectangle && arguments.shape != Shape::Circle)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.secondary_value = std::stoull(optarg, nullptr, is_hex(optarg) ? 16 : 10);
+				break;
+
+			case ShortOption::Thickness:
+				if (
+					arguments.mode != Mode::Slice
+					&& arguments.mode != Mode::Stamp
+					&& arguments.shape != Shape::Rectangle
+					&& arguments.shape != Shape::Circle
+					&& arguments.shape != Shape::Polyline
+				)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.thickness = std::stoull(optarg);
+				break;
+
+			case ShortOption::Radius:
+				if (arguments.shape != Shape::Circle && arguments.mode != Mode::Stamp && !arguments.blur.has_value())
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.radius = std::stoull(optarg);
+				break;
+
+			case ShortOption::Side:
+			{
+				if (arguments.shape != Shape::Rectangle)
+				{
+					throw InvalidUsage();
+				}
+
+				std::size_t const side = std::stoull(optarg);
+				arguments.end = arguments.start + math::Vector{side, side};
+				break;
+			}
+
+			case ShortOption::Width:
+				if (arguments.shape != Shape::Line)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.width = std::stoull(optarg);
+				break;
+
+			case ShortOption::Height:
+				if (arguments.shape != Shape::Line)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.height = std::stoull(optarg);
+				break;
+
+			case ShortOption::WithDiagonals:
+				if (arguments.shape != Shape::Rectangle)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.with_diagonals = true;
+				break;
+
+			case ShortOption::Info:
+				if (arguments.mode != Mode::None)
+				{
+					throw InvalidUsage();
+				}
+
+				arguments.mode = Mode::Info;
+				break;
+
+			case ShortOption::Help:
+			case '?':
+			default:
+				throw InvalidUsage();
+			}
+		}
+	}
+	catch (InvalidUsage const& e)
+	{
+		throw;
+	}
+	catch (std::out_of_range const& e)
+	{
+		error_message = "argument out of bounds";
+	}
+	catch (std::invalid_argument const& e)
+	{
+		error_message = "invalid argument";
+	}
+	catch (std::exception const& e)
+	{
+		throw std::runtime_error(e.what());
+	}
+
+	if (error_message)
+	{
+		throw std::runtime_error(error_message);
+	}
+
+	arguments.filepaths_in.assign(argv + optind, argv + argc);
+
+	if (arguments.with_chunks && arguments.mode != Mode::Info)
+	{
+		throw InvalidUsage();
+	}
+
+	if (arguments.shape == Shape::Text && !arguments.text)
+	{
+		throw InvalidUsage();
+	}
+
+	if ((arguments.shape == Shape::Polygon || arguments.shape == Shape::Polyline) && !arguments.points_path)
+	{
+		throw InvalidUsage();
+	}
+
+	bool const converts =
+		arguments.target_channels.has_value()
+		|| arguments.target_bit_depth.has_value()
+		|| arguments.with_optimization
+		|| arguments.format.has_value();
+	if (
+		converts
+		&& (
+			arguments.mode == Mode::Info
+			|| arguments.mode == Mode::Serve
+			|| arguments.mode == Mode::Stats
+			|| arguments.mode == Mode::Compare
+		)
+	)
+	{
+		throw InvalidUsage();
+	}
+
+	// Masks restrict drawer operations, which leave the layout of the image as it is.
+	if (
+		arguments.mask_path
+		&& arguments.mode != Mode::Draw
+		&& arguments.mode != Mode::Filter
+		&& arguments.mode != Mode::Slice
+		&& arguments.mode != Mode::Stamp
+	)
+	{
+		throw InvalidUsage();
+	}
+
+	// Only outputs of image operations are cached.
+	if (
+		(arguments.cache_size.has_value() && !arguments.cache_directory)
+		|| (arguments.cache_directory && !std::strlen(arguments.cache_directory))
+		|| (
+			arguments.cache_directory
+			&& (
+				arguments.mode == Mode::Info
+				|| arguments.mode == Mode::Serve
+				|| arguments.mode == Mode::Stats
+				|| arguments.mode == Mode::Compare
+				|| arguments.mode == Mode::Tiles
+			)
+		)
+	)
+	{
+		throw InvalidUsage();
+	}
+
+	switch (arguments.mode)
+	{
+	case Mode::Info:
+		if (arguments.filepaths_in.empty() || arguments.prefetch != prefetch_default || arguments.scratch_directory)
+		{
+			throw InvalidUsage();
+		}
+
+		return arguments;
+
+	case Mode::Stats:
+		if (arguments.filepaths_in.empty())
+		{
+			throw InvalidUsage();
+		}
+
+		return arguments;
+
+	case Mode::Compare:
+		// Telling equality alone leaves no picture of the differences to write.
+		if (
+			arguments.filepaths_in.size() != 2
+			|| arguments.prefetch != prefetch_default
+			|| (arguments.equality_only && arguments.filepath_out)
+			|| std::any_of(
+				arguments.filepaths_in.begin(),
+				arguments.filepaths_in.end(),
+				[] (char const* const filepath_in) { return !std::strcmp(filepath_in, "-"); }
+			)
+		)
+		{
+			throw InvalidUsage();
+		}
+
+		return arguments;
+
+	case Mode::Serve:
+		if (
+			!arguments.filepaths_in.empty()
+			|| !std::strlen(arguments.socket_path)
+			|| arguments.prefetch != prefetch_default
+		)
+		{
+			throw InvalidUsage();
+		}
+
+		return arguments;
+
+	case Mode::Tiles:
+		// Tiles keep the samples of the image, in the format of --format or of the extension of their names.
+		if (
+			arguments.filepaths_in.size() != 1
+			|| !std::strlen(arguments.filepaths_in.front())
+			|| !arguments.filepath_out
+			|| !std::strcmp(arguments.filepath_out, "-")
+			|| arguments.target_channels.has_value()
+			|| arguments.target_bit_depth.has_value()
+			|| arguments.with_optimization
+		)
+		{
+			throw InvalidUsage();
+		}
+
+		image::pyramid::validate(tile_options(arguments));
+		return arguments;
+
+	case Mode::None:
+	{
+		// Changing format is an operation of its own.
+		auto const is_transcoded = [] (char const* const filepath)
+		{
+			return image::pnm::has_extension(filepath) || image::qoi::has_extension(filepath);
+		};
+
+		bool const transcodes =
+			(arguments.filepath_out && is_transcoded(arguments.filepath_out))
+			|| std::any_of(arguments.filepaths_in.begin(), arguments.filepaths_in.end(), is_transcoded);
+
+		if (!converts && !transcodes)
+		{
+			throw InvalidUsage();
+		}
+
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	if (arguments.filepaths_in.empty())
+	{
+		throw InvalidUsage();
+	}
+
+	for (char const* const filepath_in : arguments.filepaths_in)
+	{
+		// The standard input holds a single image.
+		if (!std::strlen(filepath_in) || (arguments.filepaths_in.size() > 1 && !std::strcmp(filepath_in, "-")))
+		{
+			throw InvalidUsage();
+		}
+	}
+
+	if (!arguments.filepath_out)
+	{
+		throw std::runtime_error("no output file specified");
+	}
+
+	if (
+		arguments.mode != Mode::None
+		&& arguments.mode != Mode::Convolve
+		&& arguments.mode != Mode::Transform
+		&& arguments.mode != Mode::Tone
+		&& !arguments.primary_value.has_value()
+	)
+	{
+		throw std::runtime_error("no primary color specified");
+	}
+
+	return arguments;
+}
+
+namespace
+{
+[[nodiscard]] image::stamp::Marker marker(Arguments const& arguments)
+{
+	std::string_view const name = arguments.marker;
+
+	if (name == "circle")
+	{
+		return image::stamp::circle(arguments.radius);
+	}
+
+	if (name == "square")
+	{
+		return image::stamp::square(arguments.radius);
+	}
+
+	if (name == "cross")
+	{
+		return image::stamp::cross(arguments.radius, arguments.thickness);
+	}
+
+	std::ifstream is(arguments.marker, std::ios::in | std::ios::binary);
+	if (!is)
+	{
+		throw std::runtime_error("could not open marker file for read");
+	}
+
+	image::png::PNG sprite;
+	sprite.open(is);
+
+	return image::stamp::sprite(sprite);
+}
+
+template <typename ImageT>
+void draw(Arguments const& arguments, ImageT& img, image::mask::Mask const* const mask)
+{
+	color::Value const primary_value = arguments.primary_value.value();
+
+	bool const is_secondary_value_specified = arguments.secondary_value.has_value();
+	color::Value const secondary_value = arguments.secondary_value.value_or(color::Value{});
+
+	std::size_t const channels = img.channels();
+	if (arguments.mode == Mode::Filter && arguments.channel >= channels)
+	{
+		throw std::runtime_error("channel index exceeding maximum (" + std::to_string(channels) + ")");
+	}
+
+	std::size_t const color_depth = img.color_depth();
+	if (primary_value >= color_depth || secondary_value >= color_depth)
+	{
+		throw std::runtime_error("color value exceeding maximum (" + std::to_string(color_depth) + ")");
+	}
+
+	image::BasicDrawer<ImageT> const dw(img, mask);
+
+	math::Vector const& start = arguments.start;
+	math::Vector const& end = arguments.end;
+	std::size_t const thickness = arguments.thickness;
+
+	switch (arguments.mode)
+	{
+	case Mode::Filter:
+		dw.color_filter(arguments.channel, primary_value);
+		break;
+
+	case Mode::Slice:
+		dw.slice(arguments.slice_dimensions.x, arguments.slice_dimensions.y, thickness, primary_value);
+		break;
+
+	case Mode::Stamp:
+		image::stamp::stamp(img, marker(arguments), image::points::read(arguments.points_path), primary_value, mask);
+		break;
+
+	case Mode::Draw:
+		switch (arguments.shape)
+		{
+		case Shape::Point:
+			dw.point(start, primary_value);
+			break;
+
+		case Shape::Line:
+			dw.line(start, end, primary_value, arguments.width, arguments.height);
+			break;
+
+		case Shape::Rectangle:
+			if (!is_secondary_value_specified)
+			{
+				dw.rectangle(start, end, thickness, primary_value, arguments.with_diagonals);
+			}
+			else
+			{
+				dw.rectangle_filled(start, end, thickness, primary_value, secondary_value, arguments.with_diagonals);
+			}
+			break;
+
+		case Shape::Circle:
+			if (start != end || start != start_default)
+			{
+				if (arguments.radius != radius_default)
+				{
+					throw std::runtime_error("circle bounds (start, end) and radius cannot specified together");
+				}
+
+				if (!is_secondary_value_specified)
+				{
+					dw.circle(start, end, thickness, primary_value);
+				}
+				else
+				{
+					dw.circle_filled(start, end, thickness, primary_value, secondary_value);
+				}
+				break;
+			}
+
+			if (!is_secondary_value_specified)
+			{
+				dw.circle(arguments.center, arguments.radius, thickness, primary_value);
+			}
+			else
+			{
+				dw.circle_filled(arguments.center, arguments.radius, thickness, primary_value, secondary_value);
+			}
+
+			break;
+
+		case Shape::Flood:
+			dw.flood(start, primary_value, arguments.tolerance);
+			break;
+
+		case Shape::Polygon:
+			dw.polygon(image::points::read_paths(arguments.points_path), primary_value, arguments.fill_rule);
+			break;
+
+		case Shape::Polyline:
+			for (std::vector<math::Vector> const& path : image::points::read_paths(arguments.points_path))
+			{
+				dw.polyline(path, primary_value, thickness);
+			}
+			break;
+
+		case Shape::Text:
+		{
+			if (!arguments.scale || arguments.scale > scale_max)
+			{
+				throw std::runtime_error("text scale out of range (1 to " + std::to_string(scale_max) + ")");
+			}
+
+			std::shared_ptr<image::font::Font const> const loaded =
+				arguments.font_path ? image::font::load(arguments.font_path) : nullptr;
+			image::font::Font const& font = loaded ? *loaded : image::font::embedded();
+
+			dw.text(start, arguments.text, font, primary_value, arguments.scale);
+			break;
+		}
+
+		case Shape::None:
+		default:
+			break;
+		}
+
+		break;
+
+	default:
+		throw InvalidUsage();
+	}
+}
+
+void filter(Arguments const& arguments, image::Image& img)
+{
+	// Without a rectangle, the whole image is filtered.
+	bool const is_whole = arguments.start == start_default && arguments.end == end_default;
+
+	math::Vector const first = is_whole ? math::Vector{} : arguments.start;
+	math::Vector const last = is_whole ? math::Vector{img.width() - 1, img.height() - 1} : arguments.end;
+
+	if (arguments.blur.has_value())
+	{
+		image::convolve::blur(img, arguments.blur.value(), arguments.radius, first, last);
+	}
+	else
+	{
+		image::convolve::convolve(img, arguments.kernel, first, last);
+	}
+}
+
+void apply_frame(Arguments const& arguments, image::Image& img)
+{
+	switch (arguments.mode)
+	{
+	case Mode::None:
+		break;
+
+	case Mode::Convolve:
+		filter(arguments, img);
+		break;
+
+	case Mode::Transform:
+		img.transform(arguments.operation);
+		break;
+
+	case Mode::Tone:
+		image::tone::apply(img, arguments.tones);
+		break;
+
+	default:
+	{
+		// Operations only draw the pixels a mask sets.
+		std::shared_ptr<image::mask::Mask const> const mask =
+			arguments.mask_path ? image::mask::load(arguments.mask_path) : nullptr;
+
+		// Pixels of a png are drawn through calls the compiler inlines.
+		if (auto* const png = dynamic_cast<image::png::PNG*>(&img))
+		{
+			draw(arguments, *png, mask.get());
+		}
+		else
+		{
+			draw(arguments, img, mask.get());
+		}
+
+		break;
+	}
+	}
+
+	if (arguments.target_channels.has_value() || arguments.target_bit_depth.has_value())
+	{
+		std::size_t const channels = arguments.target_channels.value_or(img.channels());
+
+		// A depth the target cannot hold falls back to 8 bits, unless asked for explicitly.
+		std::size_t bit_depth = arguments.target_bit_depth.value_or(img.depth());
+		if (!arguments.target_bit_depth.has_value() && channels > 1 && bit_depth < 8)
+		{
+			bit_depth = 8;
+		}
+
+		img.convert(channels, bit_depth);
+	}
+}
+}
+
+[[nodiscard]] Format output_format(Arguments const& arguments, std::string_view const path) noexcept
+{
+	if (arguments.format)
+	{
+		return *arguments.format;
+	}
+
+	if (image::pnm::has_extension(path))
+	{
+		return Format::Pnm;
+	}
+
+	return image::qoi::has_extension(path) ? Format::Qoi : Format::Png;
+}
+
+[[nodiscard]] image::pyramid::Options tile_options(Arguments const& arguments)
+{
+	image::pyramid::Options options;
+	options.tile_size = arguments.tile_size;
+	options.name_template = arguments.tile_name;
+	options.without_blank_tiles = arguments.without_blank_tiles;
+	options.number_of_threads = arguments.workers;
+	options.scratch_directory = arguments.scratch_directory;
+	return options;
+}
+
+void apply(Arguments const& arguments, image::Image& img)
+{
+	// Frames of an animation are independent of each other.
+	parallel::for_bands(
+		img.frame_count(),
+		parallel::concurrency(),
+		[&arguments, &img] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			for (std::size_t i = begin; i < end; i++)
+			{
+				apply_frame(arguments, img.frame(i));
+			}
+		}
+	);
+}
+
+void hash_operation(Arguments const& arguments, hash::Hasher& hasher)
+{
+	auto const hash_file = [&hasher] (char const* const path)
+	{
+		std::vector<char> const data = async::read_file(path);
+		hasher.update_value(static_cast<std::uint64_t>(data.size()));
+		hasher.update(data.data(), data.size());
+	};
+
+	auto const hash_optional = [&hasher] (auto const& value)
+	{
+		hasher.update_value(value.has_value());
+		hasher.update_value(value.value_or(typename std::decay_t<decltype(value)>::value_type{}));
+	};
+
+	hasher.update_value(cache_version);
+
+	hasher.update_value(arguments.mode);
+	hasher.update_value(arguments.shape);
+	hasher.update_value(arguments.channel);
+	hash_optional(arguments.primary_value);
+	hash_optional(arguments.secondary_value);
+	hasher.update_value(arguments.with_diagonals);
+	hasher.update_value(arguments.with_optimization);
+
+	for (math::Vector const& point : {arguments.center, arguments.start, arguments.end, arguments.slice_dimensions})
+	{
+		hasher.update_value(point.x);
+		hasher.update_value(point.y);
+	}
+
+	hasher.update_value(arguments.radius);
+	hasher.update_value(arguments.thickness);
+	hasher.update_value(arguments.width);
+	hasher.update_value(arguments.height);
+	hasher.update_value(arguments.scale);
+	hasher.update_value(arguments.tolerance);
+
+	hash_optional(arguments.blur);
+	hasher.update_value(arguments.kernel.width);
+	hasher.update_value(arguments.kernel.height);
+	hasher.update_value(static_cast<std::uint64_t>(arguments.kernel.weights.size()));
+	hasher.update(arguments.kernel.weights.data(), arguments.kernel.weights.size() * sizeof(std::int32_t));
+
+	hasher.update_value(arguments.fill_rule);
+	hasher.update_value(arguments.operation);
+	hasher.update_value(arguments.row_filter);
+	hash_optional(arguments.target_channels);
+	hash_optional(arguments.target_bit_depth);
+
+	hasher.update_value(arguments.text != nullptr);
+	hasher.update_string(arguments.text ? arguments.text : "");
+
+	// Files are hashed by their contents, since an edited file is the same path.
+	hasher.update_value(arguments.font_path != nullptr);
+	if (arguments.font_path)
+	{
+		hash_file(arguments.font_path);
+	}
+
+	hasher.update_value(arguments.points_path != nullptr);
+	if (arguments.points_path)
+	{
+		hash_file(arguments.points_path);
+	}
+
+	hasher.update_value(arguments.mask_path != nullptr);
+	if (arguments.mask_path)
+	{
+		hash_file(arguments.mask_path);
+	}
+
+	std::string_view const marker = arguments.marker;
+	bool const is_marker_file = arguments.mode == Mode::Stamp && marker != "circle" && marker != "square" && marker != "cross";
+
+	hasher.update_value(is_marker_file);
+	if (is_marker_file)
+	{
+		hash_file(arguments.marker);
+	}
+	else
+	{
+		hasher.update_string(marker);
+	}
+
+	hasher.update_value(static_cast<std::uint64_t>(arguments.tones.size()));
+	for (image::tone::Step const& step : arguments.tones)
+	{
+		hasher.update_value(step.operation);
+		hasher.update_value(step.gamma);
+		hasher.update_value(step.black);
+		hasher.update_value(step.white);
+		hasher.update_value(step.level);
+
+		if (step.operation == image::tone::Operation::Table)
+		{
+			hash_file(step.path.c_str());
+		}
+	}
+}
+
 [[nodiscard]] bool is_hex(std::string_view const str) noexcept
 {
 	std::size_t const length = str.length();
@@ -40,4 +1370,98 @@ namespace cli
 		conv::string_to_integer<std::int64_t>(str.substr(delimiter_index + 1)).value_or(0),
 	};
 }
+
+[[nodiscard]] image::convolve::Kernel string_to_kernel(std::string_view str)
+{
+	image::convolve::Kernel kernel{};
+
+	for (;;)
+	{
+		std::size_t const row_end = str.find(kernel_row_delimiter);
+		std::string_view row = str.substr(0, row_end);
+
+		std::size_t width = 0;
+		for (;;)
+		{
+			std::size_t const weight_end = row.find(point_delimiter);
+			std::optional<std::int32_t> const weight = conv::string_to_integer<std::int32_t>(row.substr(0, weight_end));
+
+			if (!weight.has_value())
+			{
+				throw std::invalid_argument("invalid kernel weight");
+			}
+
+			kernel.weights.push_back(weight.value());
+			width++;
+
+			if (weight_end == std::string_view::npos)
+			{
+				break;
+			}
+
+			row.remove_prefix(weight_end + 1);
+		}
+
+		if (kernel.height && width != kernel.width)
+		{
+			throw std::invalid_argument("kernel rows of different lengths");
+		}
+
+		kernel.width = width;
+		kernel.height++;
+
+		if (row_end == std::string_view::npos)
+		{
+			break;
+		}
+
+		str.remove_prefix(row_end + 1);
+	}
+
+	return kernel;
+}
+
+[[nodiscard]] std::string json_string(std::string_view const str)
+{
+	std::string result;
+	result.reserve(str.length() + 2);
+	result += '"';
+
+	for (char const ch : str)
+	{
+		switch (ch)
+		{
+		case '"':
+			result += "\\\"";
+			break;
+
+		case '\\':
+			result += "\\\\";
+			break;
+
+		case '\n':
+			result += "\\n";
+			break;
+
+		case '\t':
+			result += "\\t";
+			break;
+
+		default:
+			if (static_cast<unsigned char>(ch) < 0x20)
+			{
+				char escaped[7];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+				result += escaped;
+				break;
+			}
+
+			result += ch;
+			break;
+		}
+	}
+
+	result += '"';
+	return result;
+}
 }
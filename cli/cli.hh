@@ -1,9 +1,22 @@
 #ifndef PNGR_CLI_H_
 #define PNGR_CLI_H_
 
+#include "../lib/hash.hh"
 #include "../lib/math.hh"
+#include "../lib/color.hh"
+#include "../lib/image/image.hh"
+#include "../lib/image/filter.hh"
+#include "../lib/image/tone.hh"
+#include "../lib/image/convolve.hh"
+#include "../lib/image/polygon.hh"
+#include "../lib/image/pyramid.hh"
 
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 #include <getopt.h>
 
 
@@ -12,6 +25,17 @@ namespace cli
 constexpr char const* help_message =
 	"Usage:\n"
 	"\tpngr (--help)\n"
+	"\tpngr <path> --out <path> --convert <gs|gsa|rgb|rgba> (--bit-depth <uint>)\n"
+	"\tpngr <path> --out <path> --bit-depth <uint>\n"
+	"\tpngr <path> --out <path> --optimize\n"
+	"\tpngr <path> --out <path> (--format png|pnm|qoi)\n"
+	"\tpngr --info <path>... (--chunks)\n"
+	"\tpngr --serve <path> (--workers <uint>)\n"
+	"\tpngr --stats-pixels <path>... (--workers <uint>) (--prefetch <uint>)\n"
+	"\tpngr --compare <path> <path> (--out <path>) (--exact) (--workers <uint>)\n"
+	"\tpngr <path>... --out <directory> (--prefetch <uint>) ...\n"
+	"\tpngr <path>... --out <path> (--cache <directory> (--cache-size <uint>)) ...\n"
+	"\tpngr <path> --out <directory> --tiles (--tile-size <uint>) (--tile-name <template>) (--skip-blank) (--workers <uint>)\n"
 	"\tpngr <path> --out <path> --filter <uint|[rgba]> --color <uint>\n"
 	"\tpngr <path> --out <path> --slice  <uint,uint>   --color <uint (--thickness <uint>)\n"
 	"\tpngr <path> --out <path> --draw   point         --color <uint> --start  <int,int>\n"
@@ -19,6 +43,17 @@ constexpr char const* help_message =
 	"\tpngr <path> --out <path> --draw   circle        --color <uint> --start  <int,int> --end <int,int> (--fill  <uint>) (--thickness <uint>)\n"
 	"\tpngr <path> --out <path> --draw   circle        --color <uint> --center <int,int> --radius <uint> (--fill  <uint>) (--thickness <uint>)\n"
 	"\tpngr <path> --out <path> --draw   rect(angle)   --color <uint> --start  <int,int> --end <int,int> (--fill  <uint>) (--thickness <uint>) (--with-diags)\n"
+	"\tpngr <path> --out <path> --draw   flood         --color <uint> --start  <int,int> (--tolerance <uint>)\n"
+	"\tpngr <path> --out <path> --draw   text          --color <uint> --start  <int,int> --text <string> (--scale <uint>) (--font <path>)\n"
+	"\tpngr <path> --out <path> --draw   polygon       --color <uint> --points <path> (--fill-rule even-odd|non-zero)\n"
+	"\tpngr <path> --out <path> --draw   polyline      --color <uint> --points <path> (--thickness <uint>)\n"
+	"\tpngr <path> --out <path> --stamp  <path>        --color <uint> (--marker circle|square|cross|<path>) (--radius <uint>) (--thickness <uint>)\n"
+	"\tpngr <path> --out <path> --blur   box|gaussian|sharpen (--radius <uint>) (--start <int,int> --end <int,int>)\n"
+	"\tpngr <path> --out <path> --kernel <int,...(;int,...)...> (--start <int,int> --end <int,int>)\n"
+	"\tpngr <path> --out <path> --rotate <90|180|270>\n"
+	"\tpngr <path> --out <path> --flip   <horizontal|vertical>\n"
+	"\tpngr <path> --out <path> --transpose\n"
+	"\tpngr <path> --out <path> [--invert|--gamma <float>|--levels <uint,uint>|--threshold <uint>|--posterize <uint>|--lut <path>]...\n"
 	"\tpngr <path> --out <path> --draw   square        --color <uint> --start  <int,int> --side <uint>   (--fill  <uint>) (--thickness <uint>) (--with-diags)\n"
 	"\nNote on usage:\n"
 	"\t[...] - exactly one of surrounded tokens.\n"
@@ -32,23 +67,82 @@ constexpr char const* help_message =
 	"\t--slice     \t-s    \t        \tsplit the image into NxM cells\n"
 	"\t--color     \t-C    \t        \tprimary (stroke) color (may be hex)\n"
 	"\t--fill      \t-F    \t        \trect,circle: secondary (fill) color (may be hex)\n"
-	"\t--thickness \t-T    \t1       \tstroke thickness\n"
+	"\t--thickness \t-T    \t1       \tstroke thickness, stamp: width of the bars of a cross\n"
 	"\t--width     \t-W    \t1       \tline: width\n"
 	"\t--height    \t-H    \t1       \tline: height\n"
-	"\t--radius    \t-R    \t1       \tcircle: radius\n"
+	"\t--radius    \t-R    \t1       \tcircle: radius, blur: radius (gaussian,sharpen: standard deviation), stamp: marker radius\n"
 	"\t--side      \t-S    \t0       \tsquare: side length\n"
 	"\t--center    \t      \t0,0     \tcircle: center point\n"
-	"\t--start     \t      \t0,0     \tline,rect,circle: start point\n"
-	"\t--end       \t      \t0,0     \tline,rect,circle: end point\n"
+	"\t--start     \t      \t0,0     \tline,rect,circle: start point, text: top left corner, blur,kernel: first corner of the rectangle to filter (whole image if omitted)\n"
+	"\t--end       \t      \t0,0     \tline,rect,circle: end point, blur,kernel: last corner of the rectangle to filter\n"
+	"\t--tolerance \t      \t0       \tflood: maximum difference of any channel from the start pixel\n"
+	"\t--text      \t      \t        \ttext: UTF-8 text to draw, `\\n` (a line feed) starting a new line\n"
+	"\t--scale     \t      \t1       \ttext: side of the square drawn for every glyph pixel\n"
+	"\t--font      \t      \tbuilt-in\ttext: PSF or BDF font file (the built-in 8x8 font covers printable ASCII only)\n"
+	"\t--points    \t      \t        \tpolygon,polyline: file of `x,y` lines, a blank line between rings or lines\n"
+	"\t            \t      \t        \t(little-endian int32 pairs if *.bin, a pair of INT32_MIN between rings or lines)\n"
+	"\t--fill-rule \t      \teven-odd\tpolygon: even-odd (inner rings are holes) or non-zero (rings of the same orientation unite)\n"
+	"\t--stamp     \t      \t        \tstamp a marker centered on every point of a file of `x,y` lines (little-endian int32 pairs if *.bin)\n"
+	"\t--marker    \t      \tcircle  \tstamp: circle, square, cross, or png sprite whose opaque (or, without alpha, bright) pixels are stamped\n"
+	"\t--mask      \t      \t        \tdraw,filter,slice,stamp: only change pixels that are white in a png mask of the image's dimensions\n"
+	"\t            \t      \t        \t(1 in a 1-bit mask, at least 128 in an 8-bit one)\n"
+	"\t--blur      \t      \t        \tblur pixels: box, gaussian or sharpen (unsharp mask)\n"
+	"\t--kernel    \t      \t        \tconvolve pixels with integer weights normalized by their sum, `,` between columns, `;` between rows\n"
+	"\t            \t      \t        \t(a single row is applied horizontally, then vertically)\n"
+	"\t--rotate    \t      \t        \trotate the image clockwise by 90, 180 or 270 degrees\n"
+	"\t--flip      \t      \t        \tmirror the image: horizontal (left to right) or vertical (top to bottom)\n"
+	"\t--transpose \t      \t        \t(flag) mirror the image along its main diagonal\n"
+	"\t--invert    \t      \t        \t(flag) invert color samples (tone options map samples one after another, alpha kept)\n"
+	"\t--gamma     \t      \t        \tgamma-correct color samples by given exponent (above 1 brightens)\n"
+	"\t--levels    \t      \t        \tstretch color samples between given black and white levels to the full range\n"
+	"\t--threshold \t      \t        \tmake color samples from given level on white, the others black\n"
+	"\t--posterize \t      \t        \tkeep given number of evenly spaced values of color samples\n"
+	"\t--lut       \t      \t        \tmap samples through a file of a line per sample value (256 lines at 8 bits, 65536 at 16 bits),\n"
+	"\t            \t      \t        \tholding one value for all color channels or one value per channel, alpha included\n"
 	"\t--with-diags\t-D    \t        \trect,square: (flag) draw diagonals\n"
+	"\t--info      \t-i    \t        \t(flag) print header fields of every input as a JSON line, without decoding\n"
+	"\t--chunks    \t      \t        \tinfo: (flag) also list type and length of every chunk\n"
+	"\t--serve     \t      \t        \tserve jobs over a unix socket bound to the given path\n"
+	"\t--workers   \t      \t0       \tserve,stats-pixels,compare,tiles: number of worker threads (0 - one per hardware thread)\n"
+	"\t--stats-pixels\t    \t        \t(flag) print channel histograms and statistics of every input as a JSON line\n"
+	"\t--compare   \t      \t        \t(flag) print whether two images are equal, how many pixels differ and where,\n"
+	"\t            \t      \t        \tand the maximum error, MSE and PSNR of every channel as a JSON line\n"
+	"\t            \t      \t        \t(--out writes differing pixels in red over the first image faded)\n"
+	"\t--exact     \t      \t        \tcompare: (flag) only tell whether the images are equal, stopping at the first difference\n"
+	"\t--tiles     \t      \t        \t(flag) write tiles of every level of a zoom pyramid to the --out directory, the last level being the image,\n"
+	"\t            \t      \t        \teach one before it halved from the next one and level 0 fitting in a single tile\n"
+	"\t--tile-size \t      \t256     \ttiles: side of a tile (tiles at the right and bottom edges are cut short)\n"
+	"\t--tile-name \t      \t        \ttiles: path of a tile under the output directory, {z} standing for its level, {x} and {y}\n"
+	"\t            \t      \t        \tfor its column and row, and its extension for the format (default {z}/{x}/{y}.png)\n"
+	"\t--skip-blank\t      \t        \ttiles: (flag) leave out tiles of a single color, or fully transparent ones\n"
+	"\t--convert   \t      \t        \tconvert color type after any operation: gs, gsa, rgb or rgba (alpha is dropped, not blended)\n"
+	"\t--bit-depth \t      \t        \tconvert bit depth after any operation: 1, 2, 4 (gs only), 8 or 16\n"
+	"\t--optimize  \t      \t        \t(flag) after any operation, save in the smallest lossless color type, bit depth or palette\n"
+	"\t--format    \t      \t        \toutput format: png, pnm (binary pgm or ppm, pam with alpha) or qoi (8-bit rgb or rgba), by default pnm for *.pgm, *.ppm, *.pnm and *.pam, qoi for *.qoi, png otherwise\n"
+	"\t--row-filter\t      \tadaptive\tpng row filter: adaptive, default (libpng's choice), none, sub, up, average or paeth\n"
+	"\t--scratch   \t      \t        \tkeep decoded pixels in memory-mapped files in given directory rather than in memory\n"
+	"\t--prefetch  \t      \t4       \tnumber of upcoming inputs read in the background when given several inputs\n"
+	"\t--cache     \t      \t        \treuse outputs stored in given directory, keyed by a hash of the input bytes and the operation\n"
+	"\t--cache-size\t      \t1 GiB   \tcache: size in bytes above which the least recently used outputs are removed\n"
 	"\nNote on options:\n"
 	"\t(flag) - optional flag, doesn't have an argument.\n"
+	"\tGiven several inputs, an operation writes each output to the --out directory under the input file name.\n"
+	"\tGiven a single input, path `-` reads it from the standard input, and --out `-` writes to the standard output.\n"
+	"\tInputs are png, binary Netpbm (pgm, ppm, pam) or QOI files, told apart by their first byte.\n"
 	"\tOptions with an integral argument may support hexadecimal numbers that must be prefixed with `0x`.\n"
-	"\tAn option is considered required if and only if it is not a flag and no default value is specified for it.";
+	"\tAn option is considered required if and only if it is not a flag and no default value is specified for it.\n"
+	"\nNote on serving:\n"
+	"\tEvery request and response is a frame prefixed with its length as a big-endian uint32.\n"
+	"\tA request holds a big-endian uint32 length of its arguments, the NUL-terminated arguments\n"
+	"\t(as on the command line, without the program name) and, optionally, inline input bytes.\n"
+	"\tInput path `-` reads the inline bytes, output path `-` returns the encoded image in the response.\n"
+	"\tA response holds a status byte (0 - success, 1 - error) followed by the output bytes or an error message.\n"
+	"\tRequests may be sent without waiting for responses, which come back in the order of the requests.";
 
 constexpr char const* invalid_usage_hint = "see --help for details on usage";
 
 constexpr char const* point_delimiter = ",";
+constexpr char const* kernel_row_delimiter = ";";
 
 constexpr char const* truecolor_channels = "rgba";
 
@@ -60,13 +154,25 @@ constexpr std::size_t radius_default = 1;
 constexpr std::size_t thickness_default = 1;
 constexpr std::size_t width_default = 1;
 constexpr std::size_t height_default = 1;
+constexpr std::size_t workers_default = 0;
+constexpr color::Value tolerance_default = 0;
+constexpr std::size_t prefetch_default = 4;
+constexpr std::uint64_t cache_size_default = std::uint64_t{1} << 30;
+
+/// Version of the outputs, changed whenever pngr writes a different output for the same input and arguments,
+/// so that cached outputs of an older version are not reused.
+constexpr std::uint32_t cache_version = 1;
+constexpr std::size_t scale_default = 1;
+constexpr std::size_t scale_max = 1024;
+
+constexpr char const* marker_default = "circle";
 
 math::Vector const center_default;
 math::Vector const start_default;
 math::Vector const end_default;
 math::Vector const slice_dimensions_default{1, 1};
 
-constexpr char const* short_options = "ho:f:d:s:C:F:T:W:H:R:S:D";
+constexpr char const* short_options = "ho:f:d:s:C:F:T:W:H:R:S:Di";
 
 enum ShortOption : char
 {
@@ -83,6 +189,7 @@ enum ShortOption : char
 	Radius        = 'R',
 	Side          = 'S',
 	WithDiagonals = 'D',
+	Info          = 'i',
 };
 
 enum class Shape
@@ -92,6 +199,18 @@ enum class Shape
 	Line,
 	Rectangle,
 	Circle,
+	Flood,
+	Text,
+	Polygon,
+	Polyline,
+};
+
+/// Formats pngr reads and writes.
+enum class Format
+{
+	Png,
+	Pnm,
+	Qoi,
 };
 
 enum class Mode
@@ -100,6 +219,15 @@ enum class Mode
 	Draw,
 	Filter,
 	Slice,
+	Info,
+	Serve,
+	Stats,
+	Convolve,
+	Transform,
+	Stamp,
+	Tone,
+	Compare,
+	Tiles,
 };
 
 option const options[]{
@@ -116,14 +244,151 @@ option const options[]{
 	{"radius",     required_argument, nullptr, ShortOption::Radius},
 	{"side",       required_argument, nullptr, ShortOption::Side},
 	{"with-diags", no_argument,       nullptr, ShortOption::WithDiagonals},
+	{"info",       no_argument,       nullptr, ShortOption::Info},
+	{"chunks",     no_argument,       nullptr, 0},
+	{"serve",      required_argument, nullptr, 0},
+	{"workers",    required_argument, nullptr, 0},
+	{"stats-pixels", no_argument,     nullptr, 0},
+	{"compare",    no_argument,       nullptr, 0},
+	{"exact",      no_argument,       nullptr, 0},
+	{"tiles",      no_argument,       nullptr, 0},
+	{"tile-size",  required_argument, nullptr, 0},
+	{"tile-name",  required_argument, nullptr, 0},
+	{"skip-blank", no_argument,       nullptr, 0},
+	{"prefetch",   required_argument, nullptr, 0},
+	{"scratch",    required_argument, nullptr, 0},
+	{"cache",      required_argument, nullptr, 0},
+	{"cache-size", required_argument, nullptr, 0},
+	{"row-filter", required_argument, nullptr, 0},
+	{"convert",    required_argument, nullptr, 0},
+	{"bit-depth",  required_argument, nullptr, 0},
+	{"optimize",   no_argument,       nullptr, 0},
+	{"format",     required_argument, nullptr, 0},
+	{"tolerance",  required_argument, nullptr, 0},
+	{"text",       required_argument, nullptr, 0},
+	{"scale",      required_argument, nullptr, 0},
+	{"font",       required_argument, nullptr, 0},
+	{"points",     required_argument, nullptr, 0},
+	{"fill-rule",  required_argument, nullptr, 0},
+	{"stamp",      required_argument, nullptr, 0},
+	{"marker",     required_argument, nullptr, 0},
+	{"mask",       required_argument, nullptr, 0},
+	{"blur",       required_argument, nullptr, 0},
+	{"kernel",     required_argument, nullptr, 0},
+	{"rotate",     required_argument, nullptr, 0},
+	{"flip",       required_argument, nullptr, 0},
+	{"transpose",  no_argument,       nullptr, 0},
+	{"invert",     no_argument,       nullptr, 0},
+	{"gamma",      required_argument, nullptr, 0},
+	{"levels",     required_argument, nullptr, 0},
+	{"threshold",  required_argument, nullptr, 0},
+	{"posterize",  required_argument, nullptr, 0},
+	{"lut",        required_argument, nullptr, 0},
 	{"center",     required_argument, nullptr, 0},
 	{"start",      required_argument, nullptr, 0},
 	{"end",        required_argument, nullptr, 0},
 	{nullptr,      0,                 nullptr, 0},
 };
 
+/// Thrown when given arguments do not match any usage listed in the help message.
+class InvalidUsage : public std::exception
+{
+public:
+	[[nodiscard]] char const* what() const noexcept override;
+};
+
+struct Arguments
+{
+	Mode mode = Mode::None;
+	Shape shape = Shape::None;
+
+	color::ChannelIndex channel = 0;
+
+	std::optional<color::Value> primary_value;
+	std::optional<color::Value> secondary_value;
+
+	bool with_diagonals = false;
+	bool with_chunks = false;
+	bool with_optimization = false;
+	bool equality_only = false;
+	bool without_blank_tiles = false;
+
+	math::Vector center = center_default;
+	math::Vector start = start_default;
+	math::Vector end = end_default;
+
+	math::Vector slice_dimensions = slice_dimensions_default;
+
+	std::vector<char const*> filepaths_in;
+	char const* filepath_out = nullptr;
+	char const* socket_path = nullptr;
+	char const* scratch_directory = nullptr;
+	char const* cache_directory = nullptr;
+	char const* text = nullptr;
+	char const* font_path = nullptr;
+	char const* points_path = nullptr;
+	char const* marker = marker_default;
+	char const* mask_path = nullptr;
+	char const* tile_name = image::pyramid::name_template_default;
+
+	std::size_t radius = radius_default;
+	std::size_t thickness = thickness_default;
+	std::size_t width = width_default;
+	std::size_t height = height_default;
+	std::size_t workers = workers_default;
+	std::size_t prefetch = prefetch_default;
+	std::size_t scale = scale_default;
+	std::size_t tile_size = image::pyramid::tile_size_default;
+
+	std::optional<std::uint64_t> cache_size;
+
+	color::Value tolerance = tolerance_default;
+
+	std::optional<image::convolve::Blur> blur;
+	image::convolve::Kernel kernel{};
+
+	image::polygon::FillRule fill_rule = image::polygon::FillRule::EvenOdd;
+
+	image::transform::Operation operation = image::transform::Operation::Transpose;
+
+	/// Tone curve steps, in the order given.
+	std::vector<image::tone::Step> tones;
+
+	image::filter::Strategy row_filter = image::filter::Strategy::Adaptive;
+
+	std::optional<std::size_t> target_channels;
+	std::optional<std::size_t> target_bit_depth;
+
+	std::optional<Format> format;
+};
+
+/// Parse command line arguments, `argv[0]` being the program name.
+///
+/// Throws InvalidUsage if the arguments match no usage, and std::runtime_error with a message otherwise.
+/// Safe to call from several threads, though getopt may permute `argv`.
+[[nodiscard]] extern Arguments parse(int const argc, char* const argv[]);
+
+/// Format to write an output in: the one asked for, or else that of the extension of its path.
+[[nodiscard]] extern Format output_format(Arguments const& arguments, std::string_view const path) noexcept;
+
+/// Options of the tile pyramid to write.
+[[nodiscard]] extern image::pyramid::Options tile_options(Arguments const& arguments);
+
+/// Validate arguments of an image operation against the image and apply it, to every frame of an animation.
+extern void apply(Arguments const& arguments, image::Image& img);
+
+/// Hash everything the output of an image operation depends on but its input and its format:
+/// the operation, its parameters and the contents of the files they name.
+///
+/// Throws std::runtime_error if a file could not be read.
+extern void hash_operation(Arguments const& arguments, hash::Hasher& hasher);
+
 [[nodiscard]] extern bool is_hex(std::string_view const str) noexcept;
 [[nodiscard]] extern math::Vector string_to_vector(std::string_view const str, std::string_view const delimiter);
+
+/// Parse kernel weights, `point_delimiter` separating columns and `kernel_row_delimiter` rows.
+[[nodiscard]] extern image::convolve::Kernel string_to_kernel(std::string_view const str);
+[[nodiscard]] extern std::string json_string(std::string_view const str);
 }
 
 #endif
@@ -0,0 +1,186 @@
+#include "codecs.hh"
+#include "../lib/io.hh"
+#include "../lib/storage.hh"
+
+#include <fstream>
+#include <stdexcept>
+
+
+namespace cli
+{
+namespace
+{
+/// Format of an image as told by the first byte of its stream: `P` of a Netpbm magic number, `q` of "qoif".
+[[nodiscard]] Format format_of(std::istream& is)
+{
+	switch (is.peek())
+	{
+	case 'P':
+		return Format::Pnm;
+	case 'q':
+		return Format::Qoi;
+	default:
+		return Format::Png;
+	}
+}
+}
+
+void Codecs::set_scratch_directory(char const* const directory) &
+{
+	png.set_scratch_directory(directory);
+	pnm.set_scratch_directory(directory);
+	qoi.set_scratch_directory(directory);
+}
+
+void Codecs::set_row_filter(image::filter::Strategy const strategy) & noexcept
+{
+	png.set_row_filter(strategy);
+}
+
+image::Image& Codecs::open(std::istream& is) &
+{
+	source = format_of(is);
+
+	switch (source)
+	{
+	case Format::Pnm:
+		pnm.open(is);
+		return pnm;
+
+	case Format::Qoi:
+		qoi.open(is);
+		return qoi;
+
+	default:
+		png.open(is);
+		return png;
+	}
+}
+
+image::Image& Codecs::open(char const* const path) &
+{
+	std::ifstream is(path, std::ios::in | std::ios::binary);
+	if (!is.good())
+	{
+		throw std::runtime_error("could not open input file for read");
+	}
+
+	if (format_of(is) == Format::Pnm)
+	{
+		is.close();
+		pnm.map(path);
+
+		source = Format::Pnm;
+		return pnm;
+	}
+
+	return open(is);
+}
+
+image::Image const& Codecs::sample_source(bool const with_optimization) &
+{
+	if (with_optimization)
+	{
+		throw std::runtime_error("only a png output can be optimized");
+	}
+
+	switch (source)
+	{
+	case Format::Pnm:
+		return pnm;
+
+	case Format::Qoi:
+		return qoi;
+
+	default:
+		// Netpbm and QOI samples are intensities of 8 or 16 bits.
+		png.expand();
+		return png;
+	}
+}
+
+void Codecs::save(std::ostream& os, Format const format, bool const with_optimization) &
+{
+	if (format == Format::Pnm)
+	{
+		image::pnm::write(sample_source(with_optimization), os);
+		return;
+	}
+
+	if (format == Format::Qoi)
+	{
+		image::Image const& img = sample_source(with_optimization);
+
+		// A QOI input keeps its colorspace.
+		if (source == Format::Qoi)
+		{
+			qoi.save(os);
+		}
+		else
+		{
+			image::qoi::write(img, os);
+		}
+
+		return;
+	}
+
+	if (source != Format::Png)
+	{
+		png.assign(sample_source(false));
+		source = Format::Png;
+	}
+
+	if (with_optimization)
+	{
+		png.optimize();
+	}
+
+	png.save(os);
+}
+
+void Codecs::save(char const* const path, Format const format, bool const with_optimization) &
+{
+	if (format == Format::Pnm)
+	{
+		image::pnm::write(sample_source(with_optimization), path);
+		return;
+	}
+
+	// An input mapped from the same path keeps reading the file being replaced.
+	storage::Output output(path);
+
+	{
+		io::DescriptorBuffer buffer(output.descriptor());
+		std::ostream os(&buffer);
+
+		save(os, format, with_optimization);
+
+		if (!os.flush())
+		{
+			throw std::runtime_error("could not write output file");
+		}
+	}
+
+	output.commit();
+}
+
+void encode(image::Image const& img, std::ostream& os, Format const format, image::filter::Strategy const row_filter)
+{
+	if (format == Format::Pnm)
+	{
+		image::pnm::write(img, os);
+		return;
+	}
+
+	if (format == Format::Qoi)
+	{
+		image::qoi::write(img, os);
+		return;
+	}
+
+	image::png::PNG png;
+	png.set_row_filter(row_filter);
+	png.assign(img);
+	png.save(os);
+}
+}
@@ -0,0 +1,52 @@
+#ifndef PNGR_CLI_CODECS_H_
+#define PNGR_CLI_CODECS_H_
+
+#include "cli.hh"
+#include "../lib/image/png.hh"
+#include "../lib/image/pnm.hh"
+#include "../lib/image/qoi.hh"
+
+#include <istream>
+#include <ostream>
+
+
+namespace cli
+{
+/// Image of any format pngr reads, its pixels kept between inputs.
+class Codecs
+{
+	image::png::PNG png;
+	image::pnm::PNM pnm;
+	image::qoi::QOI qoi;
+
+	// Format of the image last opened, as long as it is held by the codec of this format.
+	Format source = Format::Png;
+
+	/// Image to write in a format of samples stored as they are, expanded if it is a png.
+	[[nodiscard]] image::Image const& sample_source(bool const with_optimization) &;
+
+public:
+	/// Keep pixels in files memory-mapped in given directory (none - on the heap).
+	void set_scratch_directory(char const* const directory) &;
+	void set_row_filter(image::filter::Strategy const strategy) & noexcept;
+
+	/// Decode an input, a png, Netpbm or QOI one as told by its first byte.
+	image::Image& open(std::istream& is) &;
+
+	/// Decode an input file, mapping a Netpbm one rather than reading it.
+	image::Image& open(char const* const path) &;
+
+	/// Encode the image in given format, in the smallest lossless representation if optimizing a png.
+	///
+	/// A Netpbm or QOI output has no palette nor any frame of an animation past the first one.
+	void save(std::ostream& os, Format const format, bool const with_optimization) &;
+
+	/// Encode the image into a file, a Netpbm one being mapped rather than written.
+	void save(char const* const path, Format const format, bool const with_optimization) &;
+};
+
+/// Encode an image of 8 or 16-bit samples without a palette in given format, a png one by a codec of its own.
+extern void encode(image::Image const& img, std::ostream& os, Format const format, image::filter::Strategy const row_filter);
+}
+
+#endif
@@ -0,0 +1,664 @@
+#include "server.hh"
+#include "cli.hh"
+#include "codecs.hh"
+#include "../lib/io.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace cli
+{
+namespace
+{
+constexpr char const* program_name = "pngr";
+
+constexpr std::size_t frame_header_size = sizeof(std::uint32_t);
+
+// A response frame starts with its length and its status byte.
+constexpr std::size_t response_header_size = frame_header_size + 1;
+
+// Bytes read from a connection at a time.
+constexpr std::size_t receive_size = 1 << 16;
+
+// A client that reads nothing of a response for this long is dropped.
+constexpr std::chrono::seconds send_timeout(60);
+
+// Time to wait before accepting again after an error, such as running out of descriptors.
+constexpr std::chrono::milliseconds accept_backoff(100);
+
+[[nodiscard]] std::uint32_t load_big_endian(char const* const data) noexcept
+{
+	std::uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return memory::to_big_endian(value);
+}
+
+/// Connection to a client, closed once the client hung up and every response to its requests is sent.
+struct Connection
+{
+	int const fd;
+
+	// Bytes received past the last request queued, and what the polling thread does with the connection, used by it only.
+	std::vector<char> received;
+	std::uint64_t next_request = 0;
+	bool is_reading = true;
+	bool is_polled = true;
+	bool is_waiting = false;
+	std::chrono::steady_clock::time_point send_deadline;
+
+	// Requests queued, being handled or with a response not sent yet.
+	std::atomic<std::size_t> pending = 0;
+
+	std::mutex mutex;
+
+	// Responses finished ahead of those to earlier requests, by the position of their request.
+	std::map<std::uint64_t, std::vector<char>> responses;
+	std::uint64_t next_response = 0;
+
+	// Responses next in order, sent by one thread at a time, which alone touches the first one and `sent`.
+	std::deque<std::vector<char>> ready;
+	std::size_t sent = 0;
+	bool is_sending = false;
+	bool is_broken = false;
+
+	explicit Connection(int const fd) noexcept : fd(fd) {}
+
+	Connection(Connection const&) = delete;
+	Connection& operator=(Connection const&) = delete;
+
+	~Connection()
+	{
+		close(fd);
+	}
+
+	/// Queue a response frame behind the responses to the requests before its own.
+	///
+	/// Returns true if the calling thread is to send the responses ready, no other thread doing so.
+	[[nodiscard]] bool respond(std::uint64_t const sequence, std::vector<char>&& response)
+	{
+		std::lock_guard const lock(mutex);
+
+		if (sequence != next_response)
+		{
+			responses.emplace(sequence, std::move(response));
+			return false;
+		}
+
+		ready.push_back(std::move(response));
+		next_response++;
+
+		for (auto it = responses.begin(); it != responses.end() && it->first == next_response; it = responses.erase(it))
+		{
+			ready.push_back(std::move(it->second));
+			next_response++;
+		}
+
+		if (is_sending)
+		{
+			return false;
+		}
+
+		is_sending = true;
+		return true;
+	}
+
+	/// Send the responses ready, as far as the socket takes them without blocking, by the thread sending them.
+	///
+	/// Adds the number of responses sent, or dropped once the connection broke, to `done`.
+	/// Returns true if the socket took no more, the calling thread remaining the one to send the rest.
+	[[nodiscard]] bool send_ready(std::size_t& done) noexcept
+	{
+		std::vector<char> const* response = nullptr;
+
+		while (true)
+		{
+			{
+				std::lock_guard const lock(mutex);
+
+				if (response)
+				{
+					ready.pop_front();
+					sent = 0;
+					done++;
+				}
+
+				if (is_broken)
+				{
+					done += ready.size();
+					ready.clear();
+				}
+
+				if (ready.empty())
+				{
+					is_sending = false;
+					return false;
+				}
+
+				// Other threads only add responses at the back, which leaves the front one in place.
+				response = &ready.front();
+			}
+
+			while (sent < response->size())
+			{
+				ssize_t const count = send(fd, response->data() + sent, response->size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+				if (count < 0 && errno == EINTR)
+				{
+					continue;
+				}
+
+				if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				{
+					return true;
+				}
+
+				if (count <= 0)
+				{
+					abandon();
+					break;
+				}
+
+				sent += count;
+			}
+		}
+	}
+
+	/// Give up on a client gone or stalled, which gets no response past the first one that failed.
+	void abandon() noexcept
+	{
+		std::lock_guard const lock(mutex);
+
+		is_broken = true;
+		shutdown(fd, SHUT_RDWR);
+	}
+};
+
+/// Request frame, its length included.
+struct Job
+{
+	std::shared_ptr<Connection> connection;
+	std::uint64_t sequence;
+	std::vector<char> request;
+};
+
+class JobQueue
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<Job> jobs;
+
+public:
+	void push(Job job)
+	{
+		{
+			std::lock_guard const lock(mutex);
+			jobs.push_back(std::move(job));
+		}
+
+		condition.notify_one();
+	}
+
+	[[nodiscard]] Job pop()
+	{
+		std::unique_lock lock(mutex);
+		condition.wait(lock, [this] { return !jobs.empty(); });
+
+		Job job = std::move(jobs.front());
+		jobs.pop_front();
+		return job;
+	}
+};
+
+/// State owned by a worker and reused by every job it runs.
+struct Worker
+{
+	Codecs codecs;
+
+	// Response frame, its length filled in once the rest of it is known.
+	std::vector<char> output;
+
+	std::vector<char*> argv;
+
+	void run(char const* const inline_input, std::size_t const inline_input_size)
+	{
+		Arguments const arguments = parse(argv.size() - 1, argv.data());
+
+		if (
+			arguments.mode == Mode::Info
+			|| arguments.mode == Mode::Serve
+			|| arguments.mode == Mode::Stats
+			|| arguments.mode == Mode::Compare
+			|| arguments.mode == Mode::Tiles
+		)
+		{
+			throw InvalidUsage();
+		}
+
+		// Arguments live in the request buffer, a worker's pixels are reused by every job it runs,
+		// and the server caches no results on behalf of its clients.
+		if (arguments.filepaths_in.size() != 1 || arguments.scratch_directory || arguments.cache_directory)
+		{
+			throw InvalidUsage();
+		}
+
+		codecs.set_row_filter(arguments.row_filter);
+
+		char const* const filepath_in = arguments.filepaths_in.front();
+		if (!std::strcmp(filepath_in, "-"))
+		{
+			io::MemoryBuffer buffer(inline_input, inline_input_size);
+			std::istream is(&buffer);
+			apply(arguments, codecs.open(is));
+		}
+		else
+		{
+			apply(arguments, codecs.open(filepath_in));
+		}
+
+		if (!std::strcmp(arguments.filepath_out, "-"))
+		{
+			// A response has no path to take the format from, only --format.
+			io::VectorBuffer buffer(output);
+			std::ostream os(&buffer);
+			codecs.save(os, output_format(arguments, ""), arguments.with_optimization);
+			return;
+		}
+
+		codecs.save(
+			arguments.filepath_out,
+			output_format(arguments, arguments.filepath_out),
+			arguments.with_optimization
+		);
+	}
+
+	/// Handle one request frame, filling `output` with the response frame.
+	void handle(std::vector<char>& request) noexcept
+	{
+		output.assign(response_header_size, 0);
+
+		Status status = Status::Success;
+
+		try
+		{
+			if (request.size() < frame_header_size + sizeof(std::uint32_t))
+			{
+				throw std::runtime_error("malformed request");
+			}
+
+			std::size_t const arguments_size = load_big_endian(request.data() + frame_header_size);
+			char* const arguments_begin = request.data() + frame_header_size + sizeof(std::uint32_t);
+
+			if (arguments_size > static_cast<std::size_t>(request.data() + request.size() - arguments_begin))
+			{
+				throw std::runtime_error("malformed request");
+			}
+
+			char* const arguments_end = arguments_begin + arguments_size;
+
+			argv.assign(1, const_cast<char*>(program_name));
+			for (char* it = arguments_begin; it < arguments_end; it += std::strlen(it) + 1)
+			{
+				if (!std::memchr(it, '\0', arguments_end - it))
+				{
+					throw std::runtime_error("malformed request");
+				}
+
+				argv.push_back(it);
+			}
+			argv.push_back(nullptr);
+
+			run(arguments_end, request.data() + request.size() - arguments_end);
+		}
+		catch (std::exception const& e)
+		{
+			status = Status::Error;
+			output.resize(response_header_size);
+			output.insert(output.end(), e.what(), e.what() + std::strlen(e.what()));
+		}
+
+		std::uint32_t const size = memory::to_big_endian(static_cast<std::uint32_t>(output.size() - frame_header_size));
+		std::memcpy(output.data(), &size, sizeof(size));
+		output[frame_header_size] = static_cast<char>(status);
+	}
+};
+
+/// Queue the whole requests received on a connection, at most `max_pending` at a time, the rest being left for later.
+///
+/// Returns false if the next frame is too large.
+[[nodiscard]] bool queue_requests(std::shared_ptr<Connection> const& connection, JobQueue& jobs, std::size_t const max_pending)
+{
+	std::vector<char>& received = connection->received;
+
+	std::size_t begin = 0;
+	bool is_valid = true;
+
+	while (connection->pending < max_pending && begin + frame_header_size <= received.size())
+	{
+		std::uint32_t const frame_size = load_big_endian(received.data() + begin);
+		if (frame_size > max_frame_size)
+		{
+			is_valid = false;
+			break;
+		}
+
+		std::size_t const end = begin + frame_header_size + frame_size;
+		if (received.size() < end)
+		{
+			break;
+		}
+
+		Job job{connection, connection->next_request++, {}};
+
+		// A request received whole, as a large one usually is, is handed over rather than copied.
+		if (!begin && end == received.size())
+		{
+			job.request.swap(received);
+		}
+		else
+		{
+			job.request.assign(received.begin() + begin, received.begin() + end);
+		}
+
+		connection->pending++;
+		jobs.push(std::move(job));
+
+		begin = end;
+	}
+
+	received.erase(received.begin(), received.begin() + std::min(begin, received.size()));
+	return is_valid;
+}
+
+/// Read what a connection has to give and queue the whole requests in it, as long as it has fewer than `max_pending`.
+///
+/// Returns false once the client hung up, failed or sent a frame too large.
+[[nodiscard]] bool receive(
+	std::shared_ptr<Connection> const& connection,
+	JobQueue& jobs,
+	std::size_t const max_pending
+)
+{
+	std::vector<char>& received = connection->received;
+
+	while (connection->pending < max_pending)
+	{
+		std::size_t const size = received.size();
+		received.resize(size + receive_size);
+
+		ssize_t const count = recv(connection->fd, received.data() + size, receive_size, MSG_DONTWAIT);
+		received.resize(size + std::max<ssize_t>(count, 0));
+
+		if (count < 0)
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+
+		if (!count || !queue_requests(connection, jobs, max_pending))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/// Whether bytes received begin with a whole request frame.
+[[nodiscard]] bool has_request(std::vector<char> const& received) noexcept
+{
+	return received.size() >= frame_header_size && received.size() - frame_header_size >= load_big_endian(received.data());
+}
+}
+
+[[noreturn]] void serve(char const* const socket_path, std::size_t const number_of_workers)
+{
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+
+	if (std::strlen(socket_path) >= sizeof(address.sun_path))
+	{
+		throw std::runtime_error("socket path is too long");
+	}
+
+	std::strcpy(address.sun_path, socket_path);
+
+	// Only a stale socket left by a previous server may be replaced.
+	if (struct stat status; !lstat(socket_path, &status) && S_ISSOCK(status.st_mode))
+	{
+		unlink(socket_path);
+	}
+
+	int const listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener < 0)
+	{
+		throw std::runtime_error("could not create socket");
+	}
+
+	if (bind(listener, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) || listen(listener, SOMAXCONN))
+	{
+		close(listener);
+		throw std::runtime_error("could not listen on socket");
+	}
+
+	// Workers wake the polling thread up when a connection has fewer requests pending than it may, or responses for it to send.
+	int wakeup[2];
+	if (pipe2(wakeup, O_CLOEXEC | O_NONBLOCK))
+	{
+		close(listener);
+		throw std::runtime_error("could not create pipe");
+	}
+
+	std::size_t const count = number_of_workers ? number_of_workers : std::max(1u, std::thread::hardware_concurrency());
+
+	// Enough requests of a connection to keep every worker busy, and no more, so that one client cannot flood the queue
+	// nor, reading nothing, have more responses than that waiting to be sent.
+	std::size_t const max_pending = count;
+
+	JobQueue jobs;
+
+	// Connections whose socket took no more of their responses, for the polling thread to send the rest.
+	std::mutex handover_mutex;
+	std::vector<std::shared_ptr<Connection>> handed_over;
+
+	std::vector<std::thread> workers;
+	workers.reserve(count);
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		workers.emplace_back(
+			[&jobs, &handover_mutex, &handed_over, max_pending, wakeup_fd = wakeup[1]]
+			{
+				Worker worker;
+
+				while (true)
+				{
+					Job job = jobs.pop();
+
+					worker.handle(job.request);
+
+					if (!job.connection->respond(job.sequence, std::move(worker.output)))
+					{
+						continue;
+					}
+
+					std::size_t done = 0;
+					bool const is_blocked = job.connection->send_ready(done);
+					std::size_t const pending = job.connection->pending.fetch_sub(done);
+
+					if (is_blocked)
+					{
+						std::lock_guard const lock(handover_mutex);
+						handed_over.push_back(std::move(job.connection));
+					}
+
+					if (is_blocked || (pending >= max_pending && pending - done < max_pending))
+					{
+						static_cast<void>(write(wakeup_fd, "", 1));
+					}
+				}
+			}
+		);
+	}
+
+	// Connections are polled and requests read on this thread, jobs run on the workers as soon as they are whole,
+	// those of a connection in parallel, their responses sent in the order of their requests by whichever worker
+	// finished one when none was, or by this thread once the socket is writable again, no thread ever blocking on a client.
+	std::vector<std::shared_ptr<Connection>> connections;
+	std::vector<pollfd> fds;
+
+	auto resume_accepting = std::chrono::steady_clock::now();
+
+	while (true)
+	{
+		auto now = std::chrono::steady_clock::now();
+		bool const is_accepting = now >= resume_accepting;
+
+		auto deadline = is_accepting ? std::chrono::steady_clock::time_point::max() : resume_accepting;
+
+		// Negative descriptors are left out by poll.
+		fds.clear();
+		fds.push_back(pollfd{wakeup[0], POLLIN, 0});
+		fds.push_back(pollfd{is_accepting ? listener : -1, POLLIN, 0});
+
+		for (std::shared_ptr<Connection> const& connection : connections)
+		{
+			short const events =
+				(connection->is_reading && connection->pending < max_pending ? POLLIN : 0)
+				| (connection->is_waiting ? POLLOUT : 0);
+
+			if (connection->is_waiting)
+			{
+				deadline = std::min(deadline, connection->send_deadline);
+			}
+
+			fds.push_back(pollfd{events ? connection->fd : -1, events, 0});
+		}
+
+		int const timeout =
+			deadline == std::chrono::steady_clock::time_point::max()
+			? -1
+			: static_cast<int>(std::max<std::chrono::milliseconds::rep>(
+				std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count(),
+				0
+			));
+
+		if (poll(fds.data(), fds.size(), timeout) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			throw std::runtime_error("could not poll sockets");
+		}
+
+		if (fds[0].revents)
+		{
+			for (char buffer[64]; read(wakeup[0], buffer, sizeof(buffer)) > 0;)
+			{
+			}
+		}
+
+		now = std::chrono::steady_clock::now();
+
+		// Connections hung up on are dropped once this thread has nothing left to do with them,
+		// and closed once their last job is done.
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < connections.size(); i++)
+		{
+			std::shared_ptr<Connection> const& connection = connections[i];
+			short const revents = fds[i + 2].revents;
+
+			if (revents & (POLLIN | POLLHUP | POLLERR) && connection->is_reading)
+			{
+				connection->is_reading = receive(connection, jobs, max_pending);
+			}
+
+			if (connection->is_waiting && (revents & (POLLOUT | POLLHUP | POLLERR) || now >= connection->send_deadline))
+			{
+				if (!(revents & (POLLOUT | POLLHUP | POLLERR)))
+				{
+					connection->abandon();
+					connection->is_reading = false;
+					connection->received.clear();
+				}
+
+				std::size_t done = 0;
+				connection->is_waiting = connection->send_ready(done);
+				connection->send_deadline = now + send_timeout;
+				connection->pending -= done;
+			}
+
+			// Requests left over once a connection had too many pending are queued as soon as it has fewer,
+			// those of a client that hung up included.
+			if (!queue_requests(connection, jobs, max_pending))
+			{
+				connection->is_reading = false;
+				connection->received.clear();
+			}
+
+			connection->is_polled = connection->is_reading || connection->is_waiting || has_request(connection->received);
+
+			if (connection->is_polled)
+			{
+				connections[kept++] = std::move(connections[i]);
+			}
+		}
+		connections.resize(kept);
+
+		{
+			std::lock_guard const lock(handover_mutex);
+
+			for (std::shared_ptr<Connection>& connection : handed_over)
+			{
+				connection->is_waiting = true;
+				connection->send_deadline = now + send_timeout;
+
+				if (!connection->is_polled)
+				{
+					connection->is_polled = true;
+					connections.push_back(std::move(connection));
+				}
+			}
+
+			handed_over.clear();
+		}
+
+		if (!(fds[1].revents & POLLIN))
+		{
+			continue;
+		}
+
+		int const fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED)
+			{
+				std::cerr << "error: could not accept connection: " << std::strerror(errno) << std::endl;
+				resume_accepting = std::chrono::steady_clock::now() + accept_backoff;
+			}
+
+			continue;
+		}
+
+		connections.push_back(std::make_shared<Connection>(fd));
+	}
+}
+}
@@ -0,0 +1,25 @@
+#ifndef PNGR_CLI_SERVER_H_
+#define PNGR_CLI_SERVER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace cli
+{
+constexpr std::uint32_t max_frame_size = 1u << 30;
+
+enum class Status : std::uint8_t
+{
+	Success,
+	Error,
+};
+
+/// Accept jobs on a unix socket bound to `socket_path` until the process is terminated.
+///
+/// Requests are queued as they arrive and handled by whichever worker is free, those of a connection in parallel,
+/// responses being sent in the order of the requests. A worker keeps its image and buffers between jobs.
+[[noreturn]] extern void serve(char const* const socket_path, std::size_t const number_of_workers);
+}
+
+#endif
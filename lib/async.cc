@@ -0,0 +1,213 @@
+#include "async.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace async
+{
+[[nodiscard]] std::vector<char> read_file(char const* const path)
+{
+	int const fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		throw std::runtime_error("could not open input file for read");
+	}
+
+	std::vector<char> data;
+
+	struct stat status;
+	if (fstat(fd, &status) || !S_ISREG(status.st_mode))
+	{
+		close(fd);
+		throw std::runtime_error("could not open input file for read");
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	data.resize(status.st_size);
+
+	for (std::size_t done = 0; done < data.size();)
+	{
+		ssize_t const count = read(fd, data.data() + done, data.size() - done);
+		if (count <= 0)
+		{
+			close(fd);
+			throw std::runtime_error("could not read input file");
+		}
+
+		done += count;
+	}
+
+	close(fd);
+	return data;
+}
+
+Prefetcher::Prefetcher(std::vector<char const*> const& filepaths, std::size_t const depth)
+	: paths(filepaths.begin(), filepaths.end()), slots(filepaths.size()), depth(std::max<std::size_t>(1, depth))
+{
+	std::size_t const count = std::min(this->depth, paths.size());
+
+	threads.reserve(count);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		threads.emplace_back(&Prefetcher::work, this);
+	}
+}
+
+Prefetcher::~Prefetcher()
+{
+	{
+		std::lock_guard const lock(mutex);
+		stopping = true;
+	}
+
+	condition.notify_all();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void Prefetcher::work()
+{
+	while (true)
+	{
+		std::size_t index;
+
+		{
+			std::unique_lock lock(mutex);
+			condition.wait(
+				lock,
+				[this] { return stopping || next_to_read >= paths.size() || next_to_read < next_to_take + depth; }
+			);
+
+			if (stopping || next_to_read >= paths.size())
+			{
+				return;
+			}
+
+			index = next_to_read++;
+		}
+
+		Slot slot;
+
+		try
+		{
+			slot.data = read_file(paths[index].c_str());
+		}
+		catch (std::exception const& e)
+		{
+			slot.error = e.what();
+		}
+
+		{
+			std::lock_guard const lock(mutex);
+			slot.ready = true;
+			slots[index] = std::move(slot);
+		}
+
+		condition.notify_all();
+	}
+}
+
+[[nodiscard]] std::vector<char> Prefetcher::next()
+{
+	Slot slot;
+
+	{
+		std::unique_lock lock(mutex);
+
+		if (next_to_take >= slots.size())
+		{
+			throw std::out_of_range("no files left to prefetch");
+		}
+
+		std::size_t const index = next_to_take;
+		condition.wait(lock, [this, index] { return slots[index].ready; });
+
+		slot = std::move(slots[index]);
+		next_to_take++;
+	}
+
+	condition.notify_all();
+
+	if (!slot.error.empty())
+	{
+		throw std::runtime_error(slot.error);
+	}
+
+	return std::move(slot.data);
+}
+
+Writer::Writer(std::size_t const depth) : depth(std::max<std::size_t>(1, depth)), thread(&Writer::work, this) {}
+
+Writer::~Writer()
+{
+	static_cast<void>(finish());
+}
+
+void Writer::work()
+{
+	while (true)
+	{
+		Job job;
+
+		{
+			std::unique_lock lock(mutex);
+			condition.wait(lock, [this] { return finishing || !jobs.empty(); });
+
+			if (jobs.empty())
+			{
+				return;
+			}
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		condition.notify_all();
+
+		std::ofstream os(job.path, std::ios::out | std::ios::binary);
+		if (!os.write(job.data.data(), job.data.size()) || !os.flush())
+		{
+			std::lock_guard const lock(mutex);
+			failed.push_back(std::move(job.path));
+		}
+	}
+}
+
+void Writer::write(std::string path, std::vector<char> data)
+{
+	{
+		std::unique_lock lock(mutex);
+		condition.wait(lock, [this] { return jobs.size() < depth; });
+
+		jobs.push_back(Job{std::move(path), std::move(data)});
+	}
+
+	condition.notify_all();
+}
+
+[[nodiscard]] std::vector<std::string> Writer::finish()
+{
+	{
+		std::lock_guard const lock(mutex);
+		finishing = true;
+	}
+
+	condition.notify_all();
+
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+
+	return std::move(failed);
+}
+}
@@ -0,0 +1,92 @@
+#ifndef PNGR_ASYNC_H_
+#define PNGR_ASYNC_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace async
+{
+/// Reads whole files on background threads, at most `depth` files ahead of the consumer,
+/// so that reading the upcoming files overlaps processing of the current one.
+class Prefetcher
+{
+	struct Slot
+	{
+		bool ready = false;
+
+		std::vector<char> data;
+		std::string error;
+	};
+
+	std::vector<std::string> paths;
+	std::vector<Slot> slots;
+
+	std::size_t depth;
+	std::size_t next_to_read = 0;
+	std::size_t next_to_take = 0;
+
+	bool stopping = false;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	std::vector<std::thread> threads;
+
+	void work();
+
+public:
+	explicit Prefetcher(std::vector<char const*> const& filepaths, std::size_t const depth);
+
+	~Prefetcher();
+
+	/// Wait for the contents of the next file, in the order of given paths.
+	///
+	/// Throws std::runtime_error if that file could not be read.
+	[[nodiscard]] std::vector<char> next();
+};
+
+/// Writes files in order on a background thread, blocking producers only when `depth` writes are pending.
+class Writer
+{
+	struct Job
+	{
+		std::string path;
+		std::vector<char> data;
+	};
+
+	std::deque<Job> jobs;
+	std::vector<std::string> failed;
+
+	std::size_t depth;
+
+	bool finishing = false;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	std::thread thread;
+
+	void work();
+
+public:
+	explicit Writer(std::size_t const depth);
+
+	~Writer();
+
+	void write(std::string path, std::vector<char> data);
+
+	/// Wait for every pending write, returning the paths that could not be written.
+	[[nodiscard]] std::vector<std::string> finish();
+};
+
+/// Read a whole file, hinting the kernel that it is read sequentially.
+[[nodiscard]] extern std::vector<char> read_file(char const* const path);
+}
+
+#endif
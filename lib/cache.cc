@@ -0,0 +1,444 @@
+#include "cache.hh"
+#include "storage.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string_view>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+
+namespace cache
+{
+namespace
+{
+constexpr char temporary_prefix[] = ".tmp-";
+
+/// Age after which a temporary file is taken as abandoned.
+constexpr std::time_t abandoned_after = 60 * 60;
+
+struct Entry
+{
+	std::string path;
+	std::uint64_t size;
+	struct timespec used;
+};
+
+[[nodiscard]] bool write_all(int const fd, char const* data, std::size_t size) noexcept
+{
+	while (size)
+	{
+		ssize_t const count = write(fd, data, size);
+		if (count < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (count <= 0)
+		{
+			return false;
+		}
+
+		data += count;
+		size -= count;
+	}
+
+	return true;
+}
+
+/// Copy all bytes of a file to a descriptor, optionally cloning the blocks where both are files of a filesystem
+/// that can, which replaces whatever the target held.
+[[nodiscard]] bool copy(int const from, int const to, bool const may_clone) noexcept
+{
+#ifdef FICLONE
+	if (may_clone && !ioctl(to, FICLONE, from))
+	{
+		return true;
+	}
+#else
+	static_cast<void>(may_clone);
+#endif
+
+	std::vector<char> buffer(1 << 20);
+
+	while (true)
+	{
+		ssize_t const count = read(from, buffer.data(), buffer.size());
+		if (count < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (count < 0)
+		{
+			return false;
+		}
+
+		if (!count)
+		{
+			return true;
+		}
+
+		if (!write_all(to, buffer.data(), count))
+		{
+			return false;
+		}
+	}
+}
+
+[[nodiscard]] bool is_older(struct timespec const& a, struct timespec const& b) noexcept
+{
+	return a.tv_sec != b.tv_sec ? a.tv_sec < b.tv_sec : a.tv_nsec < b.tv_nsec;
+}
+
+/// Files of every shard of a cache directory, temporary files older than `abandoned_after` being removed.
+[[nodiscard]] std::vector<Entry> list(std::string const& directory) noexcept
+{
+	std::vector<Entry> entries;
+
+	DIR* const root = opendir(directory.c_str());
+	if (!root)
+	{
+		return entries;
+	}
+
+	std::time_t const now = std::time(nullptr);
+
+	while (dirent const* const shard = readdir(root))
+	{
+		if (shard->d_name[0] == '.')
+		{
+			continue;
+		}
+
+		std::string const shard_path = directory + '/' + shard->d_name;
+
+		DIR* const files = opendir(shard_path.c_str());
+		if (!files)
+		{
+			continue;
+		}
+
+		while (dirent const* const file = readdir(files))
+		{
+			std::string_view const name = file->d_name;
+			if (name == "." || name == "..")
+			{
+				continue;
+			}
+
+			struct stat status;
+
+			// Another process may have removed it meanwhile.
+			if (fstatat(dirfd(files), file->d_name, &status, AT_SYMLINK_NOFOLLOW) || !S_ISREG(status.st_mode))
+			{
+				continue;
+			}
+
+			std::string path = shard_path + '/' + file->d_name;
+
+			if (name.substr(0, sizeof(temporary_prefix) - 1) == temporary_prefix)
+			{
+				if (now - status.st_mtim.tv_sec > abandoned_after)
+				{
+					unlink(path.c_str());
+				}
+
+				continue;
+			}
+
+			entries.push_back(Entry{std::move(path), static_cast<std::uint64_t>(status.st_size), status.st_mtim});
+		}
+
+		closedir(files);
+	}
+
+	closedir(root);
+	return entries;
+}
+}
+
+Cache::Cache(char const* const directory, std::uint64_t const limit) : directory(directory), limit(limit)
+{
+	if (mkdir(directory, 0777) && errno != EEXIST)
+	{
+		throw std::runtime_error("could not create cache directory");
+	}
+}
+
+[[nodiscard]] std::string Cache::entry_path(hash::Digest const& key) const&
+{
+	// Entries are spread over 256 subdirectories, so that none grows too large to search quickly.
+	std::string const name = key.hex();
+	return directory + '/' + name.substr(0, 2) + '/' + name.substr(2);
+}
+
+[[nodiscard]] int Cache::open_entry(hash::Digest const& key) const& noexcept
+{
+	int const fd = open(entry_path(key).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd >= 0)
+	{
+		// Setting the time to now is allowed to the owner even without write access.
+		futimens(fd, nullptr);
+	}
+
+	return fd;
+}
+
+[[nodiscard]] bool Cache::fetch(hash::Digest const& key, char const* const path) const&
+{
+	int const from = open_entry(key);
+	if (from < 0)
+	{
+		return false;
+	}
+
+	// Written aside and renamed over the path like any output, so that a failed copy leaves no partial file behind.
+	bool is_copied;
+	try
+	{
+		storage::Output output(path);
+		is_copied = copy(from, output.descriptor(), true);
+
+		if (is_copied)
+		{
+			output.commit();
+		}
+	}
+	catch (...)
+	{
+		close(from);
+		throw;
+	}
+
+	close(from);
+
+	if (!is_copied)
+	{
+		throw std::runtime_error("could not write output file");
+	}
+
+	return true;
+}
+
+[[nodiscard]] bool Cache::fetch(hash::Digest const& key, int const fd) const&
+{
+	int const from = open_entry(key);
+	if (from < 0)
+	{
+		return false;
+	}
+
+	// The descriptor may be positioned past data of its own, which cloning would replace.
+	bool const is_copied = copy(from, fd, false);
+	close(from);
+
+	if (!is_copied)
+	{
+		throw std::runtime_error("could not write output file");
+	}
+
+	return true;
+}
+
+[[nodiscard]] bool Cache::fetch(hash::Digest const& key, std::vector<char>& data) const&
+{
+	int const fd = open_entry(key);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status))
+	{
+		close(fd);
+		return false;
+	}
+
+	data.resize(status.st_size);
+
+	for (std::size_t done = 0; done < data.size();)
+	{
+		ssize_t const count = read(fd, data.data() + done, data.size() - done);
+		if (count < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (count <= 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		done += count;
+	}
+
+	close(fd);
+	return true;
+}
+
+[[nodiscard]] int Cache::create_temporary(hash::Digest const& key, std::string& path) const&
+{
+	std::string const shard = directory + '/' + key.hex().substr(0, 2);
+	if (mkdir(shard.c_str(), 0777) && errno != EEXIST)
+	{
+		return -1;
+	}
+
+	static std::atomic<std::uint64_t> count = 0;
+
+	// Created rather than taken from mkstemp, whose files only their owner may read, so that the umask gives entries the mode
+	// of any new file; a name left over by a process of the same id is skipped.
+	int fd;
+	do
+	{
+		path =
+			shard + '/' + temporary_prefix + std::to_string(getpid()) + '-' + std::to_string(count.fetch_add(1, std::memory_order_relaxed));
+
+		fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+	}
+	while (fd < 0 && errno == EEXIST);
+
+	return fd;
+}
+
+void Cache::commit(hash::Digest const& key, int const fd, std::string const& temporary_path, std::uint64_t const size) &
+{
+	// Renaming publishes the entry, whose bytes must then be on disk lest a crash leave a truncated result to reuse.
+	if (fdatasync(fd) || close(fd) || rename(temporary_path.c_str(), entry_path(key).c_str()))
+	{
+		unlink(temporary_path.c_str());
+		return;
+	}
+
+	stored += size;
+
+	// Counting entries means reading every shard, which is done again only once a sixteenth of the limit is stored.
+	if (!has_scanned || stored >= limit / 16)
+	{
+		evict();
+
+		has_scanned = true;
+		stored = 0;
+	}
+}
+
+void Cache::store(hash::Digest const& key, void const* const data, std::size_t const size) & noexcept
+{
+	try
+	{
+		std::string path;
+
+		int const fd = create_temporary(key, path);
+		if (fd < 0)
+		{
+			return;
+		}
+
+		if (!write_all(fd, static_cast<char const*>(data), size))
+		{
+			close(fd);
+			unlink(path.c_str());
+			return;
+		}
+
+		commit(key, fd, path, size);
+	}
+	catch (std::exception const&)
+	{
+	}
+}
+
+void Cache::store(hash::Digest const& key, char const* const source) & noexcept
+{
+	try
+	{
+		int const from = open(source, O_RDONLY | O_CLOEXEC);
+		if (from < 0)
+		{
+			return;
+		}
+
+		struct stat status;
+		std::string path;
+
+		int const fd = fstat(from, &status) || !S_ISREG(status.st_mode) ? -1 : create_temporary(key, path);
+		if (fd < 0)
+		{
+			close(from);
+			return;
+		}
+
+		bool const is_copied = copy(from, fd, true);
+		close(from);
+
+		if (!is_copied)
+		{
+			close(fd);
+			unlink(path.c_str());
+			return;
+		}
+
+		commit(key, fd, path, status.st_size);
+	}
+	catch (std::exception const&)
+	{
+	}
+}
+
+void Cache::evict() const& noexcept
+{
+	try
+	{
+		std::vector<Entry> entries = list(directory);
+
+		std::uint64_t total = 0;
+		for (Entry const& entry : entries)
+		{
+			total += entry.size;
+		}
+
+		if (total <= limit)
+		{
+			return;
+		}
+
+		std::sort(
+			entries.begin(),
+			entries.end(),
+			[] (Entry const& a, Entry const& b) { return is_older(a.used, b.used); }
+		);
+
+		// Going below the limit leaves room for the next results, so that eviction is not needed after each.
+		std::uint64_t const target = limit / 10 * 9;
+
+		for (Entry const& entry : entries)
+		{
+			if (total <= target)
+			{
+				break;
+			}
+
+			// Another process evicting at the same time may have removed it first, which frees the same bytes.
+			unlink(entry.path.c_str());
+			total -= entry.size;
+		}
+	}
+	catch (std::exception const&)
+	{
+	}
+}
+}
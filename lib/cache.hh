@@ -0,0 +1,72 @@
+#ifndef PNGR_CACHE_H_
+#define PNGR_CACHE_H_
+
+#include "hash.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace cache
+{
+/// Directory of results named after the digest of everything they were made from,
+/// so that work done once, by any process, is a copy of a file the next time.
+///
+/// Entries are written to temporary files then renamed into place, so that a reader sees either a whole entry
+/// or none, and processes sharing a directory need no lock. Reading an entry refreshes its modification time,
+/// which eviction goes by, least recently used first, whenever a process has stored enough to exceed the limit.
+class Cache
+{
+	std::string directory;
+	std::uint64_t limit;
+
+	/// Bytes stored since the entries were last counted, the first store always counting them.
+	std::uint64_t stored = 0;
+	bool has_scanned = false;
+
+	[[nodiscard]] std::string entry_path(hash::Digest const& key) const&;
+
+	/// Open the entry of given key for read and mark it as used, returning -1 if there is none.
+	[[nodiscard]] int open_entry(hash::Digest const& key) const& noexcept;
+
+	/// Move a complete temporary file into place as the entry of given key.
+	void commit(hash::Digest const& key, int const fd, std::string const& temporary_path, std::uint64_t const size) &;
+
+	/// Create a temporary file next to where the entry of given key goes.
+	[[nodiscard]] int create_temporary(hash::Digest const& key, std::string& path) const&;
+
+	/// Remove the least recently used entries until those left take at most nine tenths of the limit,
+	/// along with temporary files abandoned by processes that died.
+	void evict() const& noexcept;
+
+public:
+	/// Use given directory, creating it if needed.
+	///
+	/// Throws std::runtime_error if it could not be created.
+	explicit Cache(char const* const directory, std::uint64_t const limit);
+
+	/// Copy the entry of given key to a file, replaced once whole, sharing its blocks where the filesystem can.
+	///
+	/// Returns false, leaving the file untouched, if there is no such entry.
+	/// Throws std::runtime_error if the file could not be written.
+	[[nodiscard]] bool fetch(hash::Digest const& key, char const* const path) const&;
+
+	/// Copy the entry of given key to an open descriptor.
+	[[nodiscard]] bool fetch(hash::Digest const& key, int const fd) const&;
+
+	/// Read the entry of given key.
+	[[nodiscard]] bool fetch(hash::Digest const& key, std::vector<char>& data) const&;
+
+	/// Store bytes as the entry of given key.
+	///
+	/// Storing is best effort: a result that could not be stored is simply not found later.
+	void store(hash::Digest const& key, void const* const data, std::size_t const size) & noexcept;
+
+	/// Store a copy of a file as the entry of given key.
+	void store(hash::Digest const& key, char const* const path) & noexcept;
+};
+}
+
+#endif
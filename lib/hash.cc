@@ -0,0 +1,197 @@
+#include "hash.hh"
+#include "memory.hh"
+
+#include <cstring>
+
+
+namespace hash
+{
+namespace
+{
+constexpr std::uint64_t prime_1 = 0x9E3779B185EBCA87;
+constexpr std::uint64_t prime_2 = 0xC2B2AE3D27D4EB4F;
+constexpr std::uint64_t prime_3 = 0x165667B19E3779F9;
+constexpr std::uint64_t prime_4 = 0x85EBCA77C2B2AE63;
+constexpr std::uint64_t prime_5 = 0x27D4EB2F165667C5;
+
+[[nodiscard]] inline std::uint64_t rotate_left(std::uint64_t const value, unsigned const count) noexcept
+{
+	return value << count | value >> (64 - count);
+}
+
+[[nodiscard]] inline std::uint64_t load_64(std::uint8_t const* const data) noexcept
+{
+	std::uint64_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return memory::to_little_endian(value);
+}
+
+[[nodiscard]] inline std::uint32_t load_32(std::uint8_t const* const data) noexcept
+{
+	std::uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return memory::to_little_endian(value);
+}
+
+[[nodiscard]] inline std::uint64_t round(std::uint64_t accumulator, std::uint64_t const input) noexcept
+{
+	accumulator += input * prime_2;
+	accumulator = rotate_left(accumulator, 31);
+	return accumulator * prime_1;
+}
+
+[[nodiscard]] inline std::uint64_t merge(std::uint64_t const accumulator, std::uint64_t const value) noexcept
+{
+	return (accumulator ^ round(0, value)) * prime_1 + prime_4;
+}
+
+/// Fold 32-byte stripes into the accumulators, returning the end of the last one.
+inline std::uint8_t const* consume(
+	std::uint64_t* const accumulators,
+	std::uint8_t const* data,
+	std::uint8_t const* const end
+) noexcept
+{
+	std::uint64_t a = accumulators[0];
+	std::uint64_t b = accumulators[1];
+	std::uint64_t c = accumulators[2];
+	std::uint64_t d = accumulators[3];
+
+	for (; end - data >= 32; data += 32)
+	{
+		a = round(a, load_64(data));
+		b = round(b, load_64(data + 8));
+		c = round(c, load_64(data + 16));
+		d = round(d, load_64(data + 24));
+	}
+
+	accumulators[0] = a;
+	accumulators[1] = b;
+	accumulators[2] = c;
+	accumulators[3] = d;
+
+	return data;
+}
+}
+
+[[nodiscard]] std::string Digest::hex() const&
+{
+	constexpr char digits[] = "0123456789abcdef";
+
+	std::string result(32, '0');
+	for (std::size_t i = 0; i < 16; i++)
+	{
+		result[15 - i] = digits[(high >> (4 * i)) & 0xF];
+		result[31 - i] = digits[(low >> (4 * i)) & 0xF];
+	}
+
+	return result;
+}
+
+XXH64::XXH64(std::uint64_t const seed) noexcept:
+	seed(seed),
+	accumulators{seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1}
+{
+}
+
+void XXH64::update(void const* const data, std::size_t const size) & noexcept
+{
+	std::uint8_t const* input = static_cast<std::uint8_t const*>(data);
+	std::uint8_t const* const end = input + size;
+
+	total_length += size;
+
+	if (buffered + size < 32)
+	{
+		std::memcpy(buffer + buffered, input, size);
+		buffered += size;
+		return;
+	}
+
+	if (buffered)
+	{
+		std::size_t const filling = 32 - buffered;
+		std::memcpy(buffer + buffered, input, filling);
+		consume(accumulators, buffer, buffer + 32);
+
+		input += filling;
+		buffered = 0;
+	}
+
+	input = consume(accumulators, input, end);
+
+	buffered = end - input;
+	std::memcpy(buffer, input, buffered);
+}
+
+[[nodiscard]] std::uint64_t XXH64::digest() const& noexcept
+{
+	std::uint64_t result;
+
+	if (total_length >= 32)
+	{
+		result = rotate_left(accumulators[0], 1)
+			+ rotate_left(accumulators[1], 7)
+			+ rotate_left(accumulators[2], 12)
+			+ rotate_left(accumulators[3], 18);
+
+		for (std::uint64_t const accumulator : accumulators)
+		{
+			result = merge(result, accumulator);
+		}
+	}
+	else
+	{
+		result = seed + prime_5;
+	}
+
+	result += total_length;
+
+	std::uint8_t const* data = buffer;
+	std::uint8_t const* const end = buffer + buffered;
+
+	for (; end - data >= 8; data += 8)
+	{
+		result ^= round(0, load_64(data));
+		result = rotate_left(result, 27) * prime_1 + prime_4;
+	}
+
+	if (end - data >= 4)
+	{
+		result ^= load_32(data) * prime_1;
+		result = rotate_left(result, 23) * prime_2 + prime_3;
+		data += 4;
+	}
+
+	for (; data < end; data++)
+	{
+		result ^= *data * prime_5;
+		result = rotate_left(result, 11) * prime_1;
+	}
+
+	result ^= result >> 33;
+	result *= prime_2;
+	result ^= result >> 29;
+	result *= prime_3;
+	result ^= result >> 32;
+
+	return result;
+}
+
+void Hasher::update(void const* const data, std::size_t const size) & noexcept
+{
+	high.update(data, size);
+	low.update(data, size);
+}
+
+void Hasher::update_string(std::string_view const value) & noexcept
+{
+	update_value(static_cast<std::uint64_t>(value.size()));
+	update(value.data(), value.size());
+}
+
+[[nodiscard]] Digest Hasher::digest() const& noexcept
+{
+	return {high.digest(), low.digest()};
+}
+}
@@ -0,0 +1,67 @@
+#ifndef PNGR_HASH_H_
+#define PNGR_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+
+namespace hash
+{
+/// 128 bits identifying some bytes, for all practical purposes.
+struct Digest
+{
+	std::uint64_t high;
+	std::uint64_t low;
+
+	/// 32 lowercase hexadecimal digits, high bits first.
+	[[nodiscard]] std::string hex() const&;
+};
+
+/// Streaming XXH64 of bytes, as defined by the xxHash specification.
+class XXH64
+{
+	std::uint64_t seed;
+	std::uint64_t accumulators[4];
+	std::uint64_t total_length = 0;
+
+	std::uint8_t buffer[32];
+	std::size_t buffered = 0;
+
+public:
+	explicit XXH64(std::uint64_t const seed = 0) noexcept;
+
+	void update(void const* const data, std::size_t const size) & noexcept;
+
+	[[nodiscard]] std::uint64_t digest() const& noexcept;
+};
+
+/// Streaming digest of bytes made of two XXH64 hashes under different seeds.
+///
+/// Copying a hasher forks it, so that a common prefix is hashed only once.
+class Hasher
+{
+	XXH64 high{0};
+	XXH64 low{1};
+
+public:
+	void update(void const* const data, std::size_t const size) & noexcept;
+
+	/// Hash a trivially copyable value as the bytes it is made of on this host.
+	template <typename T>
+	void update_value(T const& value) & noexcept
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		update(&value, sizeof(value));
+	}
+
+	/// Hash a string preceded by its length, so that consecutive strings can not run into each other.
+	void update_string(std::string_view const value) & noexcept;
+
+	[[nodiscard]] Digest digest() const& noexcept;
+};
+}
+
+#endif
@@ -0,0 +1,297 @@
+#include "compare.hh"
+#include "../parallel.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+namespace image::compare
+{
+namespace
+{
+struct Band
+{
+	std::uint64_t differing_pixels = 0;
+
+	std::int64_t min_x = std::numeric_limits<std::int64_t>::max();
+	std::int64_t min_y = std::numeric_limits<std::int64_t>::max();
+	std::int64_t max_x = -1;
+	std::int64_t max_y = -1;
+
+	std::vector<color::Value> max_errors;
+	std::vector<std::uint64_t> squared_errors;
+};
+
+[[nodiscard]] std::size_t row_size(Image const& img) noexcept
+{
+	return img.width() * img.channels() * img.depth() / 8;
+}
+
+/// Threads worth using for a pass over both images, unless a number is given.
+[[nodiscard]] std::size_t threads_for(Image const& a, std::size_t const number_of_threads) noexcept
+{
+	return number_of_threads ? number_of_threads : parallel::concurrency_for(2 * row_size(a) * a.height());
+}
+
+template <std::size_t SampleSize>
+[[nodiscard]] inline std::uint32_t load(std::uint8_t const* const sample) noexcept
+{
+	if constexpr (SampleSize == 1)
+	{
+		return sample[0];
+	}
+	else
+	{
+		return sample[0] << 8 | sample[1];
+	}
+}
+
+template <std::size_t SampleSize>
+inline void store(std::uint8_t* const sample, std::uint32_t const value) noexcept
+{
+	if constexpr (SampleSize == 1)
+	{
+		sample[0] = value;
+	}
+	else
+	{
+		sample[0] = value >> 8;
+		sample[1] = value;
+	}
+}
+
+template <std::size_t SampleSize>
+void accumulate(Image const& a, Image const& b, std::size_t const begin, std::size_t const end, Band& band) noexcept
+{
+	std::size_t const width = a.width();
+	std::size_t const channels = a.channels();
+	std::size_t const size = row_size(a);
+
+	for (std::size_t y = begin; y < end; y++)
+	{
+		std::uint8_t const* const row_a = a.row(y);
+		std::uint8_t const* const row_b = b.row(y);
+
+		// Rows mostly match between renderings, and whole rows are compared much faster than samples.
+		if (!std::memcmp(row_a, row_b, size))
+		{
+			continue;
+		}
+
+		for (std::size_t x = 0; x < width; x++)
+		{
+			bool differs = false;
+
+			for (std::size_t c = 0; c < channels; c++)
+			{
+				std::size_t const offset = (x * channels + c) * SampleSize;
+
+				std::uint32_t const sample_a = load<SampleSize>(row_a + offset);
+				std::uint32_t const sample_b = load<SampleSize>(row_b + offset);
+				std::uint32_t const error = sample_a > sample_b ? sample_a - sample_b : sample_b - sample_a;
+
+				band.max_errors[c] = std::max<color::Value>(band.max_errors[c], error);
+				band.squared_errors[c] += static_cast<std::uint64_t>(error) * error;
+
+				differs |= error != 0;
+			}
+
+			if (differs)
+			{
+				band.differing_pixels++;
+
+				band.min_x = std::min<std::int64_t>(band.min_x, x);
+				band.max_x = std::max<std::int64_t>(band.max_x, x);
+				band.min_y = std::min<std::int64_t>(band.min_y, y);
+				band.max_y = std::max<std::int64_t>(band.max_y, y);
+			}
+		}
+	}
+}
+
+template <std::size_t SampleSize>
+void paint(Image const& a, Image const& b, std::size_t const begin, std::size_t const end) noexcept
+{
+	std::size_t const width = a.width();
+	std::size_t const channels = a.channels();
+	std::size_t const pixel_size = channels * SampleSize;
+	std::uint32_t const max = SampleSize == 1 ? 0xFF : 0xFFFF;
+
+	for (std::size_t y = begin; y < end; y++)
+	{
+		std::uint8_t* const row_a = a.row(y);
+		std::uint8_t const* const row_b = b.row(y);
+
+		for (std::size_t x = 0; x < width; x++)
+		{
+			std::uint8_t* const pixel = row_a + x * pixel_size;
+
+			if (std::memcmp(pixel, row_b + x * pixel_size, pixel_size))
+			{
+				store<SampleSize>(pixel, max);
+				store<SampleSize>(pixel + SampleSize, 0);
+				store<SampleSize>(pixel + 2 * SampleSize, 0);
+			}
+			else
+			{
+				// Three quarters of the way to white, so that red stands out.
+				for (std::size_t c = 0; c < 3; c++)
+				{
+					std::uint8_t* const sample = pixel + c * SampleSize;
+					store<SampleSize>(sample, max - (max - load<SampleSize>(sample)) / 4);
+				}
+			}
+
+			if (channels == 4)
+			{
+				store<SampleSize>(pixel + 3 * SampleSize, max);
+			}
+		}
+	}
+}
+}
+
+[[nodiscard]] double psnr(double const mse, color::Value const max) noexcept
+{
+	if (mse <= 0)
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+
+	return 10 * std::log10(static_cast<double>(max) * max / mse);
+}
+
+void match_layouts(Image& a, Image& b)
+{
+	a.expand();
+	b.expand();
+
+	bool const has_colors = a.channels() >= 3 || b.channels() >= 3;
+	bool const has_alpha = a.channels() % 2 == 0 || b.channels() % 2 == 0;
+
+	std::size_t const channels = (has_colors ? 3 : 1) + has_alpha;
+	std::size_t const bit_depth = std::max(a.depth(), b.depth());
+
+	a.convert(channels, bit_depth);
+	b.convert(channels, bit_depth);
+}
+
+[[nodiscard]] bool equal(Image const& a, Image const& b, std::size_t const number_of_threads)
+{
+	std::size_t const size = row_size(a);
+	std::atomic<bool> differs = false;
+
+	parallel::for_bands(
+		a.height(),
+		threads_for(a, number_of_threads),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			for (std::size_t y = begin; y < end && !differs.load(std::memory_order_relaxed); y++)
+			{
+				if (std::memcmp(a.row(y), b.row(y), size))
+				{
+					differs.store(true, std::memory_order_relaxed);
+				}
+			}
+		}
+	);
+
+	return !differs;
+}
+
+[[nodiscard]] Difference compute(Image const& a, Image const& b, std::size_t const number_of_threads)
+{
+	std::size_t const channels = a.channels();
+	std::size_t const bit_depth = a.depth();
+
+	std::vector<Band> bands(threads_for(a, number_of_threads));
+
+	std::size_t const number_of_bands = parallel::for_bands(
+		a.height(),
+		bands.size(),
+		[&a, &b, &bands, channels, bit_depth] (std::size_t const begin, std::size_t const end, std::size_t const index)
+		{
+			Band& band = bands[index];
+			band.max_errors.assign(channels, 0);
+			band.squared_errors.assign(channels, 0);
+
+			if (bit_depth == 16)
+			{
+				accumulate<2>(a, b, begin, end, band);
+			}
+			else
+			{
+				accumulate<1>(a, b, begin, end, band);
+			}
+		}
+	);
+
+	Band& total = bands.front();
+	for (std::size_t i = 1; i < number_of_bands; i++)
+	{
+		Band const& band = bands[i];
+
+		total.differing_pixels += band.differing_pixels;
+
+		total.min_x = std::min(total.min_x, band.min_x);
+		total.min_y = std::min(total.min_y, band.min_y);
+		total.max_x = std::max(total.max_x, band.max_x);
+		total.max_y = std::max(total.max_y, band.max_y);
+
+		for (std::size_t c = 0; c < channels; c++)
+		{
+			total.max_errors[c] = std::max(total.max_errors[c], band.max_errors[c]);
+			total.squared_errors[c] += band.squared_errors[c];
+		}
+	}
+
+	Difference difference{};
+	difference.number_of_pixels = static_cast<std::uint64_t>(a.width()) * a.height();
+	difference.differing_pixels = total.differing_pixels;
+	difference.max = (static_cast<color::Value>(1) << bit_depth) - 1;
+
+	if (total.differing_pixels)
+	{
+		difference.first = math::Vector{total.min_x, total.min_y};
+		difference.last = math::Vector{total.max_x, total.max_y};
+	}
+
+	difference.channels.resize(channels);
+	for (std::size_t c = 0; c < channels; c++)
+	{
+		difference.channels[c].max_error = total.max_errors[c];
+		difference.channels[c].mse =
+			difference.number_of_pixels ? static_cast<double>(total.squared_errors[c]) / difference.number_of_pixels : 0;
+	}
+
+	return difference;
+}
+
+void highlight(Image& a, Image& b)
+{
+	if (a.channels() < 3)
+	{
+		a.convert(a.channels() + 2, a.depth());
+		b.convert(b.channels() + 2, b.depth());
+	}
+
+	parallel::for_bands(
+		a.height(),
+		threads_for(a, 0),
+		[&a, &b] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			if (a.depth() == 16)
+			{
+				paint<2>(a, b, begin, end);
+			}
+			else
+			{
+				paint<1>(a, b, begin, end);
+			}
+		}
+	);
+}
+}
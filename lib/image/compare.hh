@@ -0,0 +1,55 @@
+#ifndef PNGR_IMAGE_COMPARE_H_
+#define PNGR_IMAGE_COMPARE_H_
+
+#include "image.hh"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace image::compare
+{
+struct Channel
+{
+	color::Value max_error;
+
+	/// Mean of squared differences over every pixel.
+	double mse;
+};
+
+struct Difference
+{
+	std::uint64_t number_of_pixels;
+	std::uint64_t differing_pixels;
+
+	/// Corners of the smallest rectangle holding every differing pixel, inclusive, if there is any.
+	math::Vector first;
+	math::Vector last;
+
+	/// Largest sample value, which the peak signal-to-noise ratio is relative to.
+	color::Value max;
+
+	std::vector<Channel> channels;
+};
+
+/// Peak signal-to-noise ratio in decibels of a mean squared error, infinite if it is zero.
+[[nodiscard]] extern double psnr(double const mse, color::Value const max) noexcept;
+
+/// Convert two images to the layout that holds both losslessly: colors and alpha if either has them,
+/// and the larger bit depth, indexed and sub-byte samples being expanded.
+extern void match_layouts(Image& a, Image& b);
+
+/// Whether two images of the same dimensions and layout hold the same samples,
+/// every band of rows stopping as soon as any band finds a difference.
+[[nodiscard]] extern bool equal(Image const& a, Image const& b, std::size_t const number_of_threads = 0);
+
+/// Measure the differences between two images of the same dimensions and layout, bands of rows on separate threads,
+/// rows holding the same bytes being skipped at the cost of comparing them.
+[[nodiscard]] extern Difference compute(Image const& a, Image const& b, std::size_t const number_of_threads = 0);
+
+/// Turn the first of two images of the same dimensions and layout into a picture of their differences:
+/// differing pixels red, the others those of the first image faded. Both get colors if they have none.
+extern void highlight(Image& a, Image& b);
+}
+
+#endif
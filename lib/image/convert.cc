@@ -0,0 +1,256 @@
+#include "convert.hh"
+
+
+namespace image::convert
+{
+namespace
+{
+constexpr std::uint32_t max_sample = 0xFFFF;
+
+// Rec. 709 luma weights, scaled to sum up to 2^15.
+constexpr std::uint32_t luma_r = 6967;
+constexpr std::uint32_t luma_g = 23436;
+constexpr std::uint32_t luma_b = 2365;
+constexpr std::size_t luma_shift = 15;
+
+[[nodiscard]] inline std::uint16_t luma(std::uint16_t const* const pixel) noexcept
+{
+	return (luma_r * pixel[0] + luma_g * pixel[1] + luma_b * pixel[2] + (1 << (luma_shift - 1))) >> luma_shift;
+}
+
+/// Rounds to the nearest 8-bit value, as round(value * 255 / 65535) does.
+[[nodiscard]] inline std::uint8_t narrow(std::uint32_t const value) noexcept
+{
+	return (value * 255 + 32895) >> 16;
+}
+
+template <std::size_t BitDepth>
+[[nodiscard]] inline std::uint16_t load(std::uint8_t const* const sample) noexcept
+{
+	if constexpr (BitDepth == 16)
+	{
+		return (sample[0] << 8) | sample[1];
+	}
+	else
+	{
+		return sample[0] * 257;
+	}
+}
+
+template <std::size_t BitDepth>
+inline void store(std::uint8_t* const sample, std::uint16_t const value) noexcept
+{
+	if constexpr (BitDepth == 16)
+	{
+		sample[0] = value >> 8;
+		sample[1] = value;
+	}
+	else
+	{
+		sample[0] = narrow(value);
+	}
+}
+
+template <std::size_t Channels, std::size_t BitDepth>
+void unpack_row(std::uint8_t const* const row, std::size_t const width, std::uint16_t* const rgba) noexcept
+{
+	constexpr std::size_t stride = Channels * BitDepth / 8;
+	constexpr std::size_t sample_size = BitDepth / 8;
+
+	for (std::size_t x = 0; x < width; x++)
+	{
+		std::uint8_t const* const pixel = row + x * stride;
+		std::uint16_t* const out = rgba + x * 4;
+
+		if constexpr (Channels <= 2)
+		{
+			out[0] = out[1] = out[2] = load<BitDepth>(pixel);
+		}
+		else
+		{
+			out[0] = load<BitDepth>(pixel);
+			out[1] = load<BitDepth>(pixel + sample_size);
+			out[2] = load<BitDepth>(pixel + 2 * sample_size);
+		}
+
+		if constexpr (Channels % 2 == 0)
+		{
+			out[3] = load<BitDepth>(pixel + (Channels - 1) * sample_size);
+		}
+		else
+		{
+			out[3] = max_sample;
+		}
+	}
+}
+
+template <std::size_t Channels, std::size_t BitDepth>
+void pack_row(std::uint16_t const* const rgba, std::size_t const width, std::uint8_t* const row) noexcept
+{
+	constexpr std::size_t stride = Channels * BitDepth / 8;
+	constexpr std::size_t sample_size = BitDepth / 8;
+
+	for (std::size_t x = 0; x < width; x++)
+	{
+		std::uint16_t const* const pixel = rgba + x * 4;
+		std::uint8_t* const out = row + x * stride;
+
+		if constexpr (Channels <= 2)
+		{
+			store<BitDepth>(out, luma(pixel));
+		}
+		else
+		{
+			store<BitDepth>(out, pixel[0]);
+			store<BitDepth>(out + sample_size, pixel[1]);
+			store<BitDepth>(out + 2 * sample_size, pixel[2]);
+		}
+
+		if constexpr (Channels % 2 == 0)
+		{
+			store<BitDepth>(out + (Channels - 1) * sample_size, pixel[3]);
+		}
+	}
+}
+
+template <std::size_t BitDepth>
+void dispatch_unpack(std::uint8_t const* const row, std::size_t const channels, std::size_t const width, std::uint16_t* const rgba) noexcept
+{
+	switch (channels)
+	{
+	case 1:
+		unpack_row<1, BitDepth>(row, width, rgba);
+		break;
+	case 2:
+		unpack_row<2, BitDepth>(row, width, rgba);
+		break;
+	case 3:
+		unpack_row<3, BitDepth>(row, width, rgba);
+		break;
+	case 4:
+		unpack_row<4, BitDepth>(row, width, rgba);
+		break;
+	}
+}
+
+template <std::size_t BitDepth>
+void dispatch_pack(std::uint16_t const* const rgba, std::size_t const channels, std::size_t const width, std::uint8_t* const row) noexcept
+{
+	switch (channels)
+	{
+	case 1:
+		pack_row<1, BitDepth>(rgba, width, row);
+		break;
+	case 2:
+		pack_row<2, BitDepth>(rgba, width, row);
+		break;
+	case 3:
+		pack_row<3, BitDepth>(rgba, width, row);
+		break;
+	case 4:
+		pack_row<4, BitDepth>(rgba, width, row);
+		break;
+	}
+}
+
+[[nodiscard]] inline std::size_t sample_at(std::uint8_t const* const row, std::size_t const x, std::size_t const bit_depth) noexcept
+{
+	if (bit_depth == 16)
+	{
+		return (row[2 * x] << 8) | row[2 * x + 1];
+	}
+
+	std::size_t const shift = 8 - bit_depth - (x * bit_depth) % 8;
+	return (row[x * bit_depth / 8] >> shift) & ((1 << bit_depth) - 1);
+}
+}
+
+[[nodiscard]] bool is_valid(Layout const& layout) noexcept
+{
+	switch (layout.bit_depth)
+	{
+	case 1:
+	case 2:
+	case 4:
+		return layout.channels == 1;
+	case 8:
+	case 16:
+		return 1 <= layout.channels && layout.channels <= 4;
+	default:
+		return false;
+	}
+}
+
+void unpack(
+	std::uint8_t const* const row,
+	Layout const& layout,
+	std::size_t const width,
+	std::uint16_t* const rgba,
+	std::uint16_t const* const palette,
+	std::size_t const palette_size
+) noexcept
+{
+	if (palette)
+	{
+		for (std::size_t x = 0; x < width; x++)
+		{
+			std::size_t const index = sample_at(row, x, layout.bit_depth);
+			for (std::size_t c = 0; c < 4; c++)
+			{
+				rgba[x * 4 + c] = index < palette_size ? palette[index * 4 + c] : c == 3 ? max_sample : 0;
+			}
+		}
+
+		return;
+	}
+
+	switch (layout.bit_depth)
+	{
+	case 8:
+		dispatch_unpack<8>(row, layout.channels, width, rgba);
+		return;
+	case 16:
+		dispatch_unpack<16>(row, layout.channels, width, rgba);
+		return;
+	}
+
+	std::uint32_t const scale = max_sample / ((1 << layout.bit_depth) - 1);
+	for (std::size_t x = 0; x < width; x++)
+	{
+		rgba[x * 4] = rgba[x * 4 + 1] = rgba[x * 4 + 2] = sample_at(row, x, layout.bit_depth) * scale;
+		rgba[x * 4 + 3] = max_sample;
+	}
+}
+
+void pack(
+	std::uint16_t const* const rgba,
+	std::size_t const width,
+	Layout const& layout,
+	std::uint8_t* const row
+) noexcept
+{
+	switch (layout.bit_depth)
+	{
+	case 8:
+		dispatch_pack<8>(rgba, layout.channels, width, row);
+		return;
+	case 16:
+		dispatch_pack<16>(rgba, layout.channels, width, row);
+		return;
+	}
+
+	std::uint32_t const max_value = (1 << layout.bit_depth) - 1;
+	std::size_t const row_size = (width * layout.bit_depth + 7) / 8;
+
+	for (std::size_t i = 0; i < row_size; i++)
+	{
+		row[i] = 0;
+	}
+
+	for (std::size_t x = 0; x < width; x++)
+	{
+		std::uint32_t const value = (luma(rgba + x * 4) * max_value + max_sample / 2) / max_sample;
+		row[x * layout.bit_depth / 8] |= value << (8 - layout.bit_depth - (x * layout.bit_depth) % 8);
+	}
+}
+}
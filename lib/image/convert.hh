@@ -0,0 +1,41 @@
+#ifndef PNGR_IMAGE_CONVERT_H_
+#define PNGR_IMAGE_CONVERT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace image::convert
+{
+struct Layout
+{
+	std::size_t channels;
+	std::size_t bit_depth;
+};
+
+/// Whether samples of given layout can be stored: one channel at 1, 2, 4, 8 or 16 bits, more at 8 or 16 bits.
+[[nodiscard]] extern bool is_valid(Layout const& layout) noexcept;
+
+/// Expand a row into 16-bit RGBA, four samples per pixel.
+///
+/// If `palette` is given, single-channel samples are indices into it, each entry being four 16-bit RGBA samples.
+extern void unpack(
+	std::uint8_t const* const row,
+	Layout const& layout,
+	std::size_t const width,
+	std::uint16_t* const rgba,
+	std::uint16_t const* const palette = nullptr,
+	std::size_t const palette_size = 0
+) noexcept;
+
+/// Store a row of 16-bit RGBA in given layout, with rounding when narrowing
+/// and Rec. 709 luma weights when dropping colors.
+extern void pack(
+	std::uint16_t const* const rgba,
+	std::size_t const width,
+	Layout const& layout,
+	std::uint8_t* const row
+) noexcept;
+}
+
+#endif
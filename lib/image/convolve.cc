@@ -0,0 +1,554 @@
+#include "convolve.hh"
+#include "../parallel.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+
+namespace image::convolve
+{
+namespace
+{
+// Running sums of up to `2 * max_radius + 1` 16-bit samples fit in 32 bits.
+constexpr std::size_t max_radius = 0x7FFF;
+
+// Weighted sums of 16-bit samples fit in 32 bits.
+constexpr std::int64_t max_weight_sum = 0x7FFF;
+
+constexpr std::size_t gaussian_passes = 3;
+
+// Bands produce their output rows this many at a time, or eight times their halo if that is more,
+// to bound their scratch memory while keeping the cost of restarting running sums low.
+constexpr std::size_t chunk_rows = 256;
+
+/// Output rectangle and the margin of pixels read around it.
+struct Region
+{
+	std::size_t x;
+	std::size_t y;
+	std::size_t width;
+	std::size_t height;
+
+	std::size_t margin_x;
+	std::size_t margin_y;
+
+	std::size_t channels;
+	std::size_t bit_depth;
+	std::int64_t max_sample;
+};
+
+[[nodiscard]] Region region_of(
+	Image const& img,
+	math::Vector const& first,
+	math::Vector const& last,
+	std::size_t const margin_x,
+	std::size_t const margin_y
+) noexcept
+{
+	math::Vector const a = img.bind(first);
+	math::Vector const b = img.bind(last);
+
+	return {
+		static_cast<std::size_t>(std::min(a.x, b.x)),
+		static_cast<std::size_t>(std::min(a.y, b.y)),
+		static_cast<std::size_t>(std::abs(a.x - b.x) + 1),
+		static_cast<std::size_t>(std::abs(a.y - b.y) + 1),
+		margin_x,
+		margin_y,
+		img.channels(),
+		img.depth(),
+		(static_cast<std::int64_t>(1) << img.depth()) - 1,
+	};
+}
+
+/// Load the samples of a row of the region and its horizontal margin, replicating edge pixels.
+void load(Image const& img, Region const& region, std::int64_t const y, std::uint16_t* const line) noexcept
+{
+	std::uint8_t const* const row = img.row(img.bind_y(y));
+	std::size_t const count = region.width + 2 * region.margin_x;
+	std::int64_t const x_begin = static_cast<std::int64_t>(region.x) - static_cast<std::int64_t>(region.margin_x);
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		std::size_t const sample = img.bind_x(x_begin + i) * region.channels;
+		std::uint16_t* const out = line + i * region.channels;
+
+		if (region.bit_depth == 16)
+		{
+			for (std::size_t c = 0; c < region.channels; c++)
+			{
+				out[c] = (row[2 * (sample + c)] << 8) | row[2 * (sample + c) + 1];
+			}
+		}
+		else
+		{
+			for (std::size_t c = 0; c < region.channels; c++)
+			{
+				out[c] = row[sample + c];
+			}
+		}
+	}
+}
+
+/// Store a row of the region, or with `sharpen`, twice the original row minus given one.
+void store(Image const& img, Region const& region, std::size_t const y, std::uint16_t const* const line, bool const sharpen) noexcept
+{
+	std::size_t const count = region.width * region.channels;
+	std::uint8_t* const row = img.row(region.y + y) + region.x * region.channels * (region.bit_depth / 8);
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		std::int64_t value = line[i];
+
+		if (region.bit_depth == 16)
+		{
+			if (sharpen)
+			{
+				value = std::clamp<std::int64_t>(2 * ((row[2 * i] << 8) | row[2 * i + 1]) - value, 0, region.max_sample);
+			}
+
+			row[2 * i] = value >> 8;
+			row[2 * i + 1] = value;
+		}
+		else
+		{
+			if (sharpen)
+			{
+				value = std::clamp<std::int64_t>(2 * row[i] - value, 0, region.max_sample);
+			}
+
+			row[i] = value;
+		}
+	}
+}
+
+/// Run a separable convolution over a region: `horizontal(line, buffer_row)` turns each loaded row
+/// into a row of the buffer, then `vertical(buffer_rows, count, output)` turns `count` rows of the buffer,
+/// along with the vertical margin before and after them, into `count` output rows, a chunk of a band at a time.
+///
+/// A band only keeps a chunk and its margin in its buffer, carrying the margin rows after a chunk over to the next one.
+/// The margin rows it shares with the bands around it are loaded before any band writes its output.
+template <typename T, typename Horizontal, typename Vertical>
+void run(
+	Image const& img,
+	Region const& region,
+	std::size_t const buffer_row_size,
+	Horizontal const& horizontal,
+	Vertical const& vertical,
+	bool const sharpen = false
+)
+{
+	std::size_t const margin = region.margin_y;
+	std::size_t const halo_size = margin * buffer_row_size;
+
+	// One pixel of padding lets running sums read past the last pixel instead of testing for it.
+	std::size_t const line_size = (region.width + 2 * region.margin_x + 1) * region.channels;
+	std::size_t const output_row_size = region.width * region.channels;
+
+	std::size_t const chunk_size = std::max(chunk_rows, 8 * margin);
+
+	std::size_t const number_of_threads = parallel::concurrency_for(
+		(region.height + 2 * margin) * buffer_row_size * sizeof(T)
+	);
+
+	// Row `i` of the buffer is row `i` of the region counting its margin above, hence the output row `i - margin`.
+	auto const load_rows = [&] (std::size_t const first, std::size_t const count, T* const out, std::uint16_t* const line)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			load(img, region, static_cast<std::int64_t>(region.y + first + i) - static_cast<std::int64_t>(margin), line);
+			horizontal(line, out + i * buffer_row_size);
+		}
+	};
+
+	// The margin above and below every band.
+	std::vector<T> halos(2 * number_of_threads * halo_size);
+
+	parallel::for_bands(
+		region.height,
+		number_of_threads,
+		[&] (std::size_t const begin, std::size_t const end, std::size_t const band)
+		{
+			if (begin == end)
+			{
+				return;
+			}
+
+			std::vector<std::uint16_t> line(line_size);
+
+			load_rows(begin, margin, halos.data() + 2 * band * halo_size, line.data());
+			load_rows(end + margin, margin, halos.data() + (2 * band + 1) * halo_size, line.data());
+		}
+	);
+
+	parallel::for_bands(
+		region.height,
+		number_of_threads,
+		[&] (std::size_t const begin, std::size_t const end, std::size_t const band)
+		{
+			if (begin == end)
+			{
+				return;
+			}
+
+			std::size_t const window_rows = std::min(chunk_size, end - begin) + 2 * margin;
+
+			std::vector<std::uint16_t> line(line_size);
+			std::vector<T> window(window_rows * buffer_row_size);
+			std::vector<std::uint16_t> output((window_rows - 2 * margin) * output_row_size);
+
+			T const* const top = halos.data() + 2 * band * halo_size;
+			T const* const bottom = top + halo_size;
+
+			std::copy(top, top + halo_size, window.begin());
+
+			for (std::size_t chunk = begin; chunk < end; chunk += chunk_size)
+			{
+				std::size_t const count = std::min(chunk_size, end - chunk);
+
+				// Rows of the band are loaded before the chunk is stored over them, those past it are taken from the halo.
+				std::size_t const own = std::min(count + margin, end - chunk);
+				load_rows(chunk + margin, own, window.data() + halo_size, line.data());
+				std::copy(bottom, bottom + (count + margin - own) * buffer_row_size, window.data() + (margin + own) * buffer_row_size);
+
+				vertical(window.data(), count, output.data());
+
+				for (std::size_t i = 0; i < count; i++)
+				{
+					store(img, region, chunk + i, &output[i * output_row_size], sharpen);
+				}
+
+				std::copy_n(window.data() + count * buffer_row_size, halo_size, window.data());
+			}
+		}
+	);
+}
+
+/// Replace the first `count` pixels of a line with the average of the `2 * radius + 1` pixels starting at each.
+///
+/// The line holds `count + 2 * radius` pixels and one of padding.
+template <std::size_t Channels>
+void box_line(std::uint16_t* const line, std::size_t const count, std::size_t const radius) noexcept
+{
+	std::size_t const window = 2 * radius + 1;
+	double const scale = 1.0 / window;
+
+	std::uint32_t sums[Channels]{};
+	for (std::size_t i = 0; i < window; i++)
+	{
+		for (std::size_t c = 0; c < Channels; c++)
+		{
+			sums[c] += line[i * Channels + c];
+		}
+	}
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		for (std::size_t c = 0; c < Channels; c++)
+		{
+			std::uint16_t const leaving = line[i * Channels + c];
+			line[i * Channels + c] = sums[c] * scale + 0.5;
+			sums[c] += line[(i + window) * Channels + c] - leaving;
+		}
+	}
+}
+
+void box_line(std::uint16_t* const line, std::size_t const channels, std::size_t const count, std::size_t const radius) noexcept
+{
+	switch (channels)
+	{
+	case 1:
+		box_line<1>(line, count, radius);
+		break;
+	case 2:
+		box_line<2>(line, count, radius);
+		break;
+	case 3:
+		box_line<3>(line, count, radius);
+		break;
+	default:
+		box_line<4>(line, count, radius);
+		break;
+	}
+}
+
+/// Replace the first `count` rows with the average of the `2 * radius + 1` rows starting at each,
+/// accumulating whole rows at once.
+///
+/// There are `count + 2 * radius` rows and one of padding.
+void box_rows(
+	std::uint16_t* const rows,
+	std::size_t const row_size,
+	std::size_t const count,
+	std::size_t const radius,
+	std::vector<std::uint32_t>& sums
+) noexcept
+{
+	std::size_t const window = 2 * radius + 1;
+	double const scale = 1.0 / window;
+
+	sums.assign(row_size, 0);
+	for (std::size_t i = 0; i < window; i++)
+	{
+		std::uint16_t const* const row = rows + i * row_size;
+		for (std::size_t s = 0; s < row_size; s++)
+		{
+			sums[s] += row[s];
+		}
+	}
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		std::uint16_t* const out = rows + i * row_size;
+		std::uint16_t const* const entering = rows + (i + window) * row_size;
+
+		for (std::size_t s = 0; s < row_size; s++)
+		{
+			std::uint16_t const leaving = out[s];
+			out[s] = sums[s] * scale + 0.5;
+			sums[s] += entering[s] - leaving;
+		}
+	}
+}
+
+/// Radii of box blurs that, applied in turn, approximate a gaussian blur of given standard deviation.
+[[nodiscard]] std::array<std::size_t, gaussian_passes> gaussian_radii(double const sigma) noexcept
+{
+	constexpr double n = gaussian_passes;
+
+	double const ideal = std::sqrt(12 * sigma * sigma / n + 1);
+
+	std::size_t lower = std::floor(ideal);
+	if (lower % 2 == 0)
+	{
+		lower--;
+	}
+
+	std::size_t const upper = lower + 2;
+
+	double const smaller = (12 * sigma * sigma - n * lower * lower - 4 * n * lower - 3 * n) / (-4.0 * lower - 4);
+	std::size_t const number_of_lower = std::clamp<double>(std::round(smaller), 0, n);
+
+	std::array<std::size_t, gaussian_passes> radii;
+	for (std::size_t i = 0; i < gaussian_passes; i++)
+	{
+		radii[i] = ((i < number_of_lower ? lower : upper) - 1) / 2;
+	}
+
+	return radii;
+}
+
+/// Rounded quotient, clamped to the sample range.
+[[nodiscard]] inline std::uint16_t normalize(std::int64_t const sum, std::int64_t const divisor, std::int64_t const max_sample) noexcept
+{
+	std::int64_t const value = sum >= 0 ? (sum + divisor / 2) / divisor : -((divisor / 2 - sum) / divisor);
+	return std::clamp<std::int64_t>(value, 0, max_sample);
+}
+}
+
+void blur(
+	Image& img,
+	Blur const type,
+	std::size_t const radius,
+	math::Vector const& first,
+	math::Vector const& last
+)
+{
+	if (radius > max_radius)
+	{
+		throw std::runtime_error("blur radius exceeding maximum (" + std::to_string(max_radius) + ")");
+	}
+
+	if (!radius)
+	{
+		return;
+	}
+
+	img.expand();
+
+	std::vector<std::size_t> radii{radius};
+	if (type != Blur::Box)
+	{
+		std::array<std::size_t, gaussian_passes> const gaussian = gaussian_radii(radius);
+		radii.assign(gaussian.begin(), gaussian.end());
+	}
+
+	std::size_t const margin = std::accumulate(radii.begin(), radii.end(), std::size_t{});
+
+	Region const region = region_of(img, first, last, margin, margin);
+	std::size_t const row_size = region.width * region.channels;
+
+	run<std::uint16_t>(
+		img,
+		region,
+		row_size,
+		[&region, &radii, row_size] (std::uint16_t* const line, std::uint16_t* const buffer_row)
+		{
+			std::size_t count = region.width + 2 * region.margin_x;
+			for (std::size_t const r : radii)
+			{
+				count -= 2 * r;
+				box_line(line, region.channels, count, r);
+			}
+
+			std::memcpy(buffer_row, line, row_size * sizeof(std::uint16_t));
+		},
+		[&region, &radii, row_size] (std::uint16_t const* const buffer_rows, std::size_t const count, std::uint16_t* const output)
+		{
+			std::size_t const rows = count + 2 * region.margin_y;
+
+			// The margin rows after a chunk are carried over to the next one, so passes run in place on a copy.
+			std::vector<std::uint16_t> band((rows + 1) * row_size);
+			std::copy(buffer_rows, buffer_rows + rows * row_size, band.begin());
+
+			std::vector<std::uint32_t> sums;
+
+			std::size_t remaining = rows;
+			for (std::size_t const r : radii)
+			{
+				remaining -= 2 * r;
+				box_rows(band.data(), row_size, remaining, r, sums);
+			}
+
+			std::copy(band.begin(), band.begin() + count * row_size, output);
+		},
+		type == Blur::Sharpen
+	);
+}
+
+void convolve(
+	Image& img,
+	Kernel const& kernel,
+	math::Vector const& first,
+	math::Vector const& last
+)
+{
+	if (!kernel.width || !kernel.height || kernel.width % 2 == 0 || kernel.height % 2 == 0)
+	{
+		throw std::runtime_error("kernel sides must be odd");
+	}
+
+	if (kernel.weights.size() != kernel.width * kernel.height)
+	{
+		throw std::runtime_error("kernel rows must be of equal length");
+	}
+
+	std::int64_t weight_sum = 0;
+	std::int64_t absolute_weight_sum = 0;
+	for (std::int32_t const weight : kernel.weights)
+	{
+		weight_sum += weight;
+		absolute_weight_sum += std::abs(static_cast<std::int64_t>(weight));
+	}
+
+	if (absolute_weight_sum > max_weight_sum)
+	{
+		throw std::runtime_error("kernel weights exceeding maximum (" + std::to_string(max_weight_sum) + " in total)");
+	}
+
+	img.expand();
+
+	std::int64_t const divisor = weight_sum > 0 ? weight_sum : 1;
+	std::int32_t const* const weights = kernel.weights.data();
+
+	if (kernel.height == 1)
+	{
+		std::size_t const size = kernel.width;
+
+		Region const region = region_of(img, first, last, size / 2, size / 2);
+		std::size_t const row_size = region.width * region.channels;
+
+		run<std::int32_t>(
+			img,
+			region,
+			row_size,
+			[&region, weights, size, row_size] (std::uint16_t* const line, std::int32_t* const buffer_row)
+			{
+				std::fill(buffer_row, buffer_row + row_size, 0);
+
+				for (std::size_t k = 0; k < size; k++)
+				{
+					std::uint16_t const* const in = line + k * region.channels;
+					for (std::size_t s = 0; s < row_size; s++)
+					{
+						buffer_row[s] += weights[k] * in[s];
+					}
+				}
+			},
+			[&region, weights, size, row_size, divisor] (std::int32_t const* const buffer_rows, std::size_t const count, std::uint16_t* const output)
+			{
+				std::vector<std::int64_t> sums(row_size);
+
+				for (std::size_t i = 0; i < count; i++)
+				{
+					std::fill(sums.begin(), sums.end(), 0);
+
+					for (std::size_t k = 0; k < size; k++)
+					{
+						std::int32_t const* const in = buffer_rows + (i + k) * row_size;
+						for (std::size_t s = 0; s < row_size; s++)
+						{
+							sums[s] += static_cast<std::int64_t>(weights[k]) * in[s];
+						}
+					}
+
+					for (std::size_t s = 0; s < row_size; s++)
+					{
+						output[i * row_size + s] = normalize(sums[s], divisor * divisor, region.max_sample);
+					}
+				}
+			}
+		);
+
+		return;
+	}
+
+	Region const region = region_of(img, first, last, kernel.width / 2, kernel.height / 2);
+	std::size_t const row_size = region.width * region.channels;
+	std::size_t const buffer_row_size = (region.width + 2 * region.margin_x) * region.channels;
+
+	// Without separability, rows are kept whole with their margin, and every weight is applied to them at once.
+	run<std::int32_t>(
+		img,
+		region,
+		buffer_row_size,
+		[buffer_row_size] (std::uint16_t* const line, std::int32_t* const buffer_row)
+		{
+			std::copy(line, line + buffer_row_size, buffer_row);
+		},
+		[&region, &kernel, weights, row_size, buffer_row_size, divisor] (std::int32_t const* const buffer_rows, std::size_t const count, std::uint16_t* const output)
+		{
+			std::vector<std::int64_t> sums(row_size);
+
+			for (std::size_t i = 0; i < count; i++)
+			{
+				std::fill(sums.begin(), sums.end(), 0);
+
+				for (std::size_t ky = 0; ky < kernel.height; ky++)
+				{
+					for (std::size_t kx = 0; kx < kernel.width; kx++)
+					{
+						std::int64_t const weight = weights[ky * kernel.width + kx];
+						std::int32_t const* const in = buffer_rows + (i + ky) * buffer_row_size + kx * region.channels;
+
+						for (std::size_t s = 0; s < row_size; s++)
+						{
+							sums[s] += weight * in[s];
+						}
+					}
+				}
+
+				for (std::size_t s = 0; s < row_size; s++)
+				{
+					output[i * row_size + s] = normalize(sums[s], divisor, region.max_sample);
+				}
+			}
+		}
+	);
+}
+}
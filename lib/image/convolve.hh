@@ -0,0 +1,54 @@
+#ifndef PNGR_IMAGE_CONVOLVE_H_
+#define PNGR_IMAGE_CONVOLVE_H_
+
+#include "image.hh"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace image::convolve
+{
+enum class Blur
+{
+	Box,
+	Gaussian,
+	Sharpen,
+};
+
+struct Kernel
+{
+	std::size_t width;
+	std::size_t height;
+
+	/// Row-major weights, normalized by their sum if it is positive.
+	///
+	/// A kernel one row high is separable: it is applied horizontally, then vertically.
+	std::vector<std::int32_t> weights;
+};
+
+/// Blur the rectangle between `first` and `last` (inclusive, bound to the image),
+/// reading pixels around it and replicating edge pixels past the image.
+///
+/// Box blur averages a square of side `2 * radius + 1` with running sums, in constant time per pixel.
+/// Gaussian blur approximates a standard deviation of `radius` with three box blurs,
+/// and sharpening subtracts that from twice the original (unsharp masking).
+extern void blur(
+	Image& img,
+	Blur const type,
+	std::size_t const radius,
+	math::Vector const& first,
+	math::Vector const& last
+);
+
+/// Convolve the rectangle between `first` and `last` (inclusive, bound to the image) with a kernel of odd sides,
+/// replicating edge pixels past the image.
+extern void convolve(
+	Image& img,
+	Kernel const& kernel,
+	math::Vector const& first,
+	math::Vector const& last
+);
+}
+
+#endif
@@ -1,45 +1,151 @@
 #include "drawer.hh"
+#include "png.hh"
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <vector>
 
 
 namespace image
 {
-Drawer::Drawer(Image& image) : img(image) {}
+template <typename ImageT>
+BasicDrawer<ImageT>::BasicDrawer(ImageT& image, mask::Mask const* const mask) : img(image), mask(mask)
+{
+	if (mask)
+	{
+		mask::validate(*mask, img);
+	}
+}
+
+template <typename ImageT>
+[[nodiscard]] std::size_t BasicDrawer<ImageT>::bind_x(std::int64_t const x) const& noexcept
+{
+	return std::clamp<std::int64_t>(x, 0, static_cast<std::int64_t>(img.width()) - 1);
+}
+
+template <typename ImageT>
+[[nodiscard]] std::size_t BasicDrawer<ImageT>::bind_y(std::int64_t const y) const& noexcept
+{
+	return std::clamp<std::int64_t>(y, 0, static_cast<std::int64_t>(img.height()) - 1);
+}
+
+template <typename ImageT>
+[[nodiscard]] math::Vector BasicDrawer<ImageT>::bind(math::Vector const& position) const& noexcept
+{
+	return math::Vector{bind_x(position.x), bind_y(position.y)};
+}
+
+template <typename ImageT>
+template <typename Fill>
+void BasicDrawer<ImageT>::clip(std::size_t const y, std::size_t const x_first, std::size_t const x_last, Fill const& fill) const& noexcept
+{
+	if (mask)
+	{
+		mask->runs(y, x_first, x_last, fill);
+	}
+	else
+	{
+		fill(x_first, x_last);
+	}
+}
+
+template <typename ImageT>
+void BasicDrawer<ImageT>::run(
+	std::size_t const y,
+	std::size_t const x_first,
+	std::size_t const x_last,
+	color::Value const value
+) const& noexcept
+{
+	std::size_t const pixel_bits = img.channels() * img.depth();
+
+	if (pixel_bits < 8)
+	{
+		for (std::size_t x = x_first; x <= x_last; x++)
+		{
+			img.set(math::Vector{x, y}, value);
+		}
+
+		return;
+	}
+
+	// The first pixel is set, and its bytes copied over the rest of the span in runs doubling in length.
+	img.set(math::Vector{x_first, y}, value);
+
+	std::size_t const pixel_size = pixel_bits / 8;
+	std::size_t const size = (x_last - x_first + 1) * pixel_size;
+	std::uint8_t* const first = img.row(y) + x_first * pixel_size;
+
+	for (std::size_t filled = pixel_size; filled < size; filled *= 2)
+	{
+		std::memcpy(first + filled, first, std::min(filled, size - filled));
+	}
+}
+
+template <typename ImageT>
+void BasicDrawer<ImageT>::span(
+	std::size_t const y,
+	std::size_t const x_first,
+	std::size_t const x_last,
+	color::Value const value
+) const& noexcept
+{
+	clip(
+		y,
+		x_first,
+		x_last,
+		[this, y, value] (std::size_t const first, std::size_t const last)
+		{
+			run(y, first, last, value);
+		}
+	);
+}
 
-void Drawer::point(
+template <typename ImageT>
+void BasicDrawer<ImageT>::point(
 	math::Vector const& position,
 	color::Value const value
 ) const& noexcept
 {
 	if ((0 <= position.x && position.x < img.width()) && (0 <= position.y && position.y < img.height()))
 	{
-		img.set(position, value);
+		span(position.y, position.x, position.x, value);
 	}
 }
 
-void Drawer::fill(
+template <typename ImageT>
+void BasicDrawer<ImageT>::fill(
 	math::Vector const& first,
 	math::Vector const& last,
 	color::Value const value
 ) const& noexcept
 {
-	math::Vector const& start(img.bind(first));
-	math::Vector const& end(img.bind(last));
+	math::Vector const& start(bind(first));
+	math::Vector const& end(bind(last));
 
 	if ((first.x != last.x && start.x == end.x) || (first.y != last.y && start.y == end.y))
 	{
 		return;
 	}
 
-	for (std::size_t i = img.index(start); i <= img.index(end); i++)
+	// Pixels from `start` to `end` in row-major order, row by row rather than dividing every index by the width.
+	std::int64_t const width = img.width();
+
+	for (std::int64_t y = start.y; y <= end.y; y++)
 	{
-		point(img.coordinates(i), value);
+		std::int64_t const x_first = y == start.y ? start.x : 0;
+		std::int64_t const x_last = y == end.y ? end.x : width - 1;
+
+		if (x_first <= x_last)
+		{
+			span(y, x_first, x_last, value);
+		}
 	}
 }
 
-void Drawer::line_horizontal(
+template <typename ImageT>
+void BasicDrawer<ImageT>::line_horizontal(
 	std::int64_t const y,
 	std::int64_t const x_left,
 	std::int64_t const x_right,
@@ -58,7 +164,8 @@ void Drawer::line_horizontal(
 	}
 }
 
-void Drawer::line_vertical(
+template <typename ImageT>
+void BasicDrawer<ImageT>::line_vertical(
 	std::int64_t const x,
 	std::int64_t const y_top,
 	std::int64_t const y_bottom,
@@ -71,13 +178,14 @@ void Drawer::line_vertical(
 		return;
 	}
 
-	for (std::size_t y = img.bind_y(y_top); y <= img.bind_y(y_bottom); y++)
+	for (std::size_t y = bind_y(y_top); y <= bind_y(y_bottom); y++)
 	{
 		line_horizontal(y, x, x + width - 1, value);
 	}
 }
 
-void Drawer::line(
+template <typename ImageT>
+void BasicDrawer<ImageT>::line(
 	math::Vector const& start,
 	math::Vector const& end,
 	color::Value const value,
@@ -93,8 +201,8 @@ void Drawer::line(
 		return;
 	}
 
-	std::int64_t const y_start = img.bind_y(start.y);
-	std::int64_t const y_end = img.bind_y(end.y);
+	std::int64_t const y_start = bind_y(start.y);
+	std::int64_t const y_end = bind_y(end.y);
 
 	if (y_start == y_end && start.y != end.y)
 	{
@@ -122,14 +230,15 @@ void Drawer::line(
 	}
 }
 
-void Drawer::solid(
+template <typename ImageT>
+void BasicDrawer<ImageT>::solid(
 	math::Vector const& start,
 	math::Vector const& end,
 	color::Value const value
 ) const& noexcept
 {
-	std::size_t const y_start = img.bind_y(start.y);
-	std::size_t const y_end = img.bind_y(end.y);
+	std::size_t const y_start = bind_y(start.y);
+	std::size_t const y_end = bind_y(end.y);
 
 	if (y_start == y_end && start.y != end.y)
 	{
@@ -142,7 +251,8 @@ void Drawer::solid(
 	}
 }
 
-void Drawer::rectangle(
+template <typename ImageT>
+void BasicDrawer<ImageT>::rectangle(
 	math::Vector const& start,
 	math::Vector const& end,
 	std::size_t const stroke_thickness,
@@ -151,8 +261,8 @@ void Drawer::rectangle(
 	std::size_t const diagonal_thickness
 ) const& noexcept
 {
-	std::int64_t const y_start = img.bind_y(start.y);
-	std::int64_t const y_end = img.bind_y(end.y);
+	std::int64_t const y_start = bind_y(start.y);
+	std::int64_t const y_end = bind_y(end.y);
 
 	if (y_start == y_end && start.y != end.y)
 	{
@@ -194,7 +304,8 @@ void Drawer::rectangle(
 	}
 }
 
-void Drawer::rectangle_filled(
+template <typename ImageT>
+void BasicDrawer<ImageT>::rectangle_filled(
 	math::Vector const& start,
 	math::Vector const& end,
 	std::size_t const stroke_thickness,
@@ -209,7 +320,8 @@ void Drawer::rectangle_filled(
 	rectangle(start, end, stroke_thickness, stroke_value, with_diagonals, diagonal_thickness);
 }
 
-void Drawer::square(
+template <typename ImageT>
+void BasicDrawer<ImageT>::square(
 	math::Vector const& start,
 	std::size_t const side_length,
 	std::size_t const stroke_thickness,
@@ -228,7 +340,8 @@ void Drawer::square(
 	);
 }
 
-void Drawer::square_filled(
+template <typename ImageT>
+void BasicDrawer<ImageT>::square_filled(
 	math::Vector const& start,
 	std::size_t const side_length,
 	std::size_t const stroke_thickness,
@@ -249,7 +362,8 @@ void Drawer::square_filled(
 	);
 }
 
-void Drawer::circle(
+template <typename ImageT>
+void BasicDrawer<ImageT>::circle(
 	math::Vector const& start,
 	math::Vector const& end,
 	std::size_t const stroke_thickness,
@@ -278,8 +392,8 @@ void Drawer::circle(
 		return radius - std::sqrt(radius * radius - (center_y - y) * (center_y - y));
 	};
 
-	std::size_t const y_start = img.bind_y(start.y);
-	std::size_t const y_end = img.bind_y(end.y);
+	std::size_t const y_start = bind_y(start.y);
+	std::size_t const y_end = bind_y(end.y);
 
 	if (y_start == y_end && start.y != end.y)
 	{
@@ -298,7 +412,8 @@ void Drawer::circle(
 	}
 }
 
-void Drawer::circle(
+template <typename ImageT>
+void BasicDrawer<ImageT>::circle(
 	math::Vector const& center,
 	std::size_t const radius,
 	std::size_t const stroke_thickness,
@@ -309,7 +424,8 @@ void Drawer::circle(
 	circle(center - offset, center + offset, stroke_thickness, stroke_value);
 }
 
-void Drawer::circle_filled(
+template <typename ImageT>
+void BasicDrawer<ImageT>::circle_filled(
 	math::Vector const& start,
 	math::Vector const& end,
 	std::size_t const stroke_thickness,
@@ -322,7 +438,8 @@ void Drawer::circle_filled(
 	circle(start, end, stroke_thickness, stroke_value);
 }
 
-void Drawer::circle_filled(
+template <typename ImageT>
+void BasicDrawer<ImageT>::circle_filled(
 	math::Vector const& center,
 	std::size_t const radius,
 	std::size_t const stroke_thickness,
@@ -334,7 +451,203 @@ void Drawer::circle_filled(
 	circle(center, radius, stroke_thickness, stroke_value);
 }
 
-void Drawer::slice(
+template <typename ImageT>
+void BasicDrawer<ImageT>::flood(
+	math::Vector const& start,
+	color::Value const value,
+	color::Value const tolerance
+) const&
+{
+	std::int64_t const width = img.width();
+	std::int64_t const height = img.height();
+
+	if ((0 > start.x || start.x >= width) || (0 > start.y || start.y >= height))
+	{
+		return;
+	}
+
+	std::size_t const channels = img.channels();
+	std::size_t const bit_depth = img.depth();
+	color::Value const channel_mask = (static_cast<color::Value>(1) << bit_depth) - 1;
+	color::Value const seed = img.get(start);
+
+	// The visited bitmap keeps the fill from revisiting pixels, even if `value` itself matches the seed.
+	std::vector<std::uint64_t> visited((width * height + 63) / 64);
+
+	auto matches = [&] (std::int64_t const x, std::int64_t const y)
+	{
+		std::size_t const i = x + y * width;
+		if (visited[i / 64] & (static_cast<std::uint64_t>(1) << (i % 64)))
+		{
+			return false;
+		}
+
+		color::Value const current = img.get(math::Vector{x, y});
+		for (std::size_t channel = 0; channel < channels; channel++)
+		{
+			color::Value const a = (current >> (channel * bit_depth)) & channel_mask;
+			color::Value const b = (seed >> (channel * bit_depth)) & channel_mask;
+
+			if ((a > b ? a - b : b - a) > tolerance)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	struct Span
+	{
+		std::int64_t y;
+		std::int64_t x_left;
+		std::int64_t x_right;
+	};
+
+	std::vector<Span> stack{Span{start.y, start.x, start.x}};
+
+	while (!stack.empty())
+	{
+		Span const span = stack.back();
+		stack.pop_back();
+
+		if (0 > span.y || span.y >= height)
+		{
+			continue;
+		}
+
+		for (std::int64_t x = span.x_left; x <= span.x_right; x++)
+		{
+			if (!matches(x, span.y))
+			{
+				continue;
+			}
+
+			std::int64_t x_left = x;
+			while (x_left > 0 && matches(x_left - 1, span.y))
+			{
+				x_left--;
+			}
+
+			std::int64_t x_right = x;
+			while (x_right + 1 < width && matches(x_right + 1, span.y))
+			{
+				x_right++;
+			}
+
+			for (std::size_t i = x_left + span.y * width; i <= static_cast<std::size_t>(x_right + span.y * width); i++)
+			{
+				visited[i / 64] |= static_cast<std::uint64_t>(1) << (i % 64);
+			}
+
+			line_horizontal(span.y, x_left, x_right, value);
+
+			stack.push_back(Span{span.y - 1, x_left, x_right});
+			stack.push_back(Span{span.y + 1, x_left, x_right});
+
+			x = x_right;
+		}
+	}
+}
+
+template <typename ImageT>
+void BasicDrawer<ImageT>::polygon(
+	std::vector<std::vector<math::Vector>> const& rings,
+	color::Value const value,
+	polygon::FillRule const rule
+) const&
+{
+	for (polygon::Span const& span : polygon::fill(rings, rule, img.width(), img.height()))
+	{
+		line_horizontal(span.y, span.x_first, span.x_last, value);
+	}
+}
+
+template <typename ImageT>
+void BasicDrawer<ImageT>::polyline(
+	std::vector<math::Vector> const& path,
+	color::Value const value,
+	std::size_t const thickness
+) const&
+{
+	for (polygon::Span const& span : polygon::stroke(path, thickness, img.width(), img.height()))
+	{
+		line_horizontal(span.y, span.x_first, span.x_last, value);
+	}
+}
+
+template <typename ImageT>
+void BasicDrawer<ImageT>::text(
+	math::Vector const& start,
+	std::string_view const text,
+	font::Font const& font,
+	color::Value const value,
+	std::size_t const scale
+) const& noexcept
+{
+	std::int64_t const width = img.width();
+	std::int64_t const height = img.height();
+
+	std::int64_t const size = scale;
+	std::int64_t const line_height = font.height() * scale;
+	std::int64_t const left = font.left() * size;
+	std::int64_t const bottom = font.bottom() * scale;
+
+	font::Span const* const atlas = font.atlas();
+
+	math::Vector pen = start;
+
+	for (std::size_t i = 0; i < text.size();)
+	{
+		// The rest of a line above, below or right of the image is skipped without decoding it.
+		if (pen.y + bottom <= 0 || pen.y >= height || pen.x + left >= width)
+		{
+			i = text.find('\n', i);
+			if (i == std::string_view::npos)
+			{
+				break;
+			}
+		}
+
+		char32_t const code = font::decode(text, i);
+
+		if (code == '\n')
+		{
+			pen.x = start.x;
+			pen.y += line_height;
+			continue;
+		}
+
+		font::Glyph const* const glyph = font.glyph(code);
+		if (!glyph)
+		{
+			continue;
+		}
+
+		for (std::size_t j = glyph->first_span; j < glyph->first_span + glyph->span_count; j++)
+		{
+			font::Span const& span = atlas[j];
+
+			std::int64_t const top = pen.y + span.y * size;
+			std::int64_t const x_left = pen.x + span.x * size;
+
+			std::int64_t const y_first = std::max<std::int64_t>(top, 0);
+			std::int64_t const y_end = std::min(top + size, height);
+			std::int64_t const x_first = std::max<std::int64_t>(x_left, 0);
+			std::int64_t const x_last = std::min(x_left + span.length * size, width) - 1;
+
+			if (y_first < y_end && x_first <= x_last)
+			{
+				line_horizontal(y_first, x_first, x_last, value, y_end - y_first);
+			}
+		}
+
+		pen.x += glyph->advance * size;
+	}
+}
+
+template <typename ImageT>
+void BasicDrawer<ImageT>::slice(
 	std::size_t const row_count,
 	std::size_t const column_count,
 	std::size_t const thickness,
@@ -355,14 +668,80 @@ void Drawer::slice(
 	}
 }
 
-void Drawer::color_filter(
+template <typename ImageT>
+void BasicDrawer<ImageT>::color_filter(
 	color::ChannelIndex const channel,
 	color::Value const value
 ) const& noexcept
 {
-	for (std::size_t i = 0; i < img.width() * img.height(); i++)
+	std::size_t const width = img.width();
+	std::size_t const height = img.height();
+
+	std::size_t const channels = img.channels();
+	std::size_t const bit_depth = img.depth();
+	color::Value const channel_mask = (static_cast<color::Value>(1) << bit_depth) - 1;
+
+	if (!width)
+	{
+		return;
+	}
+
+	if (bit_depth < 8)
+	{
+		std::size_t const offset = (channels - 1 - channel) * bit_depth;
+
+		color::Value const keep_mask = ~(channel_mask << offset);
+		color::Value const channel_value = (value & channel_mask) << offset;
+
+		for (std::size_t y = 0; y < height; y++)
+		{
+			clip(
+				y,
+				0,
+				width - 1,
+				[this, y, keep_mask, channel_value] (std::size_t const first, std::size_t const last)
+				{
+					for (std::size_t x = first; x <= last; x++)
+					{
+						math::Vector const position{x, y};
+						img.set(position, (img.get(position) & keep_mask) | channel_value);
+					}
+				}
+			);
+		}
+
+		return;
+	}
+
+	// Whole samples are stored in place, big-endian, without reading the pixels around them.
+	std::size_t const sample_size = bit_depth / 8;
+	std::size_t const pixel_size = channels * sample_size;
+
+	std::uint8_t sample[2];
+	for (std::size_t i = 0; i < sample_size; i++)
 	{
-		img.set_channel(img.coordinates(i), channel, value);
+		sample[i] = (value & channel_mask) >> (8 * (sample_size - 1 - i));
+	}
+
+	for (std::size_t y = 0; y < height; y++)
+	{
+		std::uint8_t* const row = img.row(y) + channel * sample_size;
+
+		clip(
+			y,
+			0,
+			width - 1,
+			[row, &sample, sample_size, pixel_size] (std::size_t const first, std::size_t const last)
+			{
+				for (std::size_t x = first; x <= last; x++)
+				{
+					std::memcpy(row + x * pixel_size, sample, sample_size);
+				}
+			}
+		);
 	}
 }
+
+template class BasicDrawer<Image>;
+template class BasicDrawer<png::PNG>;
 }
@@ -2,16 +2,63 @@
 #define PNGR_IMAGE_DRAWER_H_
 
 #include "image.hh"
+#include "font.hh"
+#include "mask.hh"
+#include "polygon.hh"
+
+#include <string_view>
+#include <vector>
 
 
 namespace image
 {
-class Drawer
+namespace png
+{
+class PNG;
+}
+
+/// Draws on an image of static type `ImageT`, every pixel access being a call of that type,
+/// so that for a final class such as png::PNG it is inlined instead of going through the virtual table.
+///
+/// Instantiated for Image, drawing on any image, and png::PNG.
+///
+/// Given a mask, only the pixels it sets are drawn, every span clipped to its runs.
+template <typename ImageT>
+class BasicDrawer
 {
-	Image& img;
+	ImageT& img;
+	mask::Mask const* mask;
+
+	[[nodiscard]] std::size_t bind_x(std::int64_t const x) const& noexcept;
+	[[nodiscard]] std::size_t bind_y(std::int64_t const y) const& noexcept;
+	[[nodiscard]] math::Vector bind(math::Vector const& position) const& noexcept;
+
+	/// Call `fill(first, last)` for the runs of pixels of a row from `x_first` to `x_last`, both within the image,
+	/// that the mask sets, or for all of them without a mask.
+	template <typename Fill>
+	void clip(std::size_t const y, std::size_t const x_first, std::size_t const x_last, Fill const& fill) const& noexcept;
+
+	/// Set the pixels of a row from `x_first` to `x_last`, both within the image, whatever the mask.
+	void run(
+		std::size_t const y,
+		std::size_t const x_first,
+		std::size_t const x_last,
+		color::Value const value
+	) const& noexcept;
+
+	/// Set the pixels of a row from `x_first` to `x_last`, both within the image, that the mask sets.
+	void span(
+		std::size_t const y,
+		std::size_t const x_first,
+		std::size_t const x_last,
+		color::Value const value
+	) const& noexcept;
 
 public:
-	explicit Drawer(Image& image);
+	/// Draw on an image, only where a mask sets pixels if one is given.
+	///
+	/// Throws std::runtime_error if the mask and the image differ in dimensions.
+	explicit BasicDrawer(ImageT& image, mask::Mask const* const mask = nullptr);
 
 	void point(
 		math::Vector const& position,
@@ -122,6 +169,38 @@ public:
 		color::Value const fill_value
 	) const& noexcept;
 
+	/// Fill the 4-connected region of pixels around `start` whose channels all differ from those of `start`
+	/// by at most `tolerance`, one horizontal span at a time.
+	void flood(
+		math::Vector const& start,
+		color::Value const value,
+		color::Value const tolerance = 0
+	) const&;
+
+	/// Fill the rings of a polygon, their outline included.
+	void polygon(
+		std::vector<std::vector<math::Vector>> const& rings,
+		color::Value const value,
+		polygon::FillRule const rule = polygon::FillRule::EvenOdd
+	) const&;
+
+	/// Draw a line through the points of a path, with round joins and caps when thicker than a pixel.
+	void polyline(
+		std::vector<math::Vector> const& path,
+		color::Value const value,
+		std::size_t const thickness = 1
+	) const&;
+
+	/// Draw UTF-8 text with its first cell's top left corner at `start`, every glyph pixel a `scale` by `scale` square,
+	/// clipped to the image. A line feed moves to the next line.
+	void text(
+		math::Vector const& start,
+		std::string_view const text,
+		font::Font const& font,
+		color::Value const value,
+		std::size_t const scale = 1
+	) const& noexcept;
+
 	void slice(
 		std::size_t const row_count,
 		std::size_t const column_count,
@@ -134,6 +213,11 @@ public:
 		color::Value const value
 	) const& noexcept;
 };
+
+extern template class BasicDrawer<Image>;
+extern template class BasicDrawer<png::PNG>;
+
+using Drawer = BasicDrawer<Image>;
 }
 
 #endif
@@ -0,0 +1,227 @@
+#include "filter.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace image::filter
+{
+namespace
+{
+[[nodiscard]] inline std::uint8_t paeth(std::uint8_t const a, std::uint8_t const b, std::uint8_t const c) noexcept
+{
+	int const pa = std::abs(b - c);
+	int const pb = std::abs(a - c);
+	int const pc = std::abs(a + b - 2 * c);
+
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+[[nodiscard]] inline std::uint8_t predict(
+	Type const type,
+	std::uint8_t const a,
+	std::uint8_t const b,
+	std::uint8_t const c
+) noexcept
+{
+	switch (type)
+	{
+	case Type::Sub:
+		return a;
+	case Type::Up:
+		return b;
+	case Type::Average:
+		return (a + b) >> 1;
+	case Type::Paeth:
+		return paeth(a, b, c);
+	case Type::None:
+	default:
+		return 0;
+	}
+}
+
+/// Filter bytes [begin, size), `begin` being at least `pixel_size`.
+void apply_range(
+	Type const type,
+	std::uint8_t const* const row,
+	std::uint8_t const* const previous,
+	std::size_t begin,
+	std::size_t const size,
+	std::size_t const pixel_size,
+	std::uint8_t* const out
+) noexcept
+{
+#ifdef __SSE2__
+	__m128i const zero = _mm_setzero_si128();
+
+	for (; begin + 16 <= size; begin += 16)
+	{
+		__m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + begin));
+		__m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + begin - pixel_size));
+		__m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(previous + begin));
+
+		__m128i prediction;
+
+		switch (type)
+		{
+		case Type::Sub:
+			prediction = a;
+			break;
+
+		case Type::Up:
+			prediction = b;
+			break;
+
+		case Type::Average:
+			// _mm_avg_epu8 rounds up, filters round down.
+			prediction = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+			break;
+
+		case Type::Paeth:
+		{
+			__m128i const c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(previous + begin - pixel_size));
+
+			auto half = [&zero] (__m128i const a, __m128i const b, __m128i const c)
+			{
+				__m128i const p = _mm_sub_epi16(_mm_add_epi16(a, b), c);
+				__m128i const pa_signed = _mm_sub_epi16(p, a);
+				__m128i const pb_signed = _mm_sub_epi16(p, b);
+				__m128i const pc_signed = _mm_sub_epi16(p, c);
+
+				__m128i const pa = _mm_max_epi16(pa_signed, _mm_sub_epi16(zero, pa_signed));
+				__m128i const pb = _mm_max_epi16(pb_signed, _mm_sub_epi16(zero, pb_signed));
+				__m128i const pc = _mm_max_epi16(pc_signed, _mm_sub_epi16(zero, pc_signed));
+
+				__m128i const use_a = _mm_and_si128(
+					_mm_cmpeq_epi16(_mm_min_epi16(pa, pb), pa),
+					_mm_cmpeq_epi16(_mm_min_epi16(pa, pc), pa)
+				);
+				__m128i const use_b = _mm_cmpeq_epi16(_mm_min_epi16(pb, pc), pb);
+
+				__m128i const b_or_c = _mm_or_si128(_mm_and_si128(use_b, b), _mm_andnot_si128(use_b, c));
+				return _mm_or_si128(_mm_and_si128(use_a, a), _mm_andnot_si128(use_a, b_or_c));
+			};
+
+			prediction = _mm_packus_epi16(
+				half(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+				half(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero))
+			);
+			break;
+		}
+
+		case Type::None:
+		default:
+			prediction = zero;
+			break;
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + begin), _mm_sub_epi8(x, prediction));
+	}
+#endif
+
+	for (; begin < size; begin++)
+	{
+		out[begin] = static_cast<std::uint8_t>(
+			row[begin] - predict(type, row[begin - pixel_size], previous[begin], previous[begin - pixel_size])
+		);
+	}
+}
+
+/// Zeros standing for the row above the first one.
+[[nodiscard]] std::uint8_t const* zeros(std::size_t const size)
+{
+	thread_local std::vector<std::uint8_t> buffer;
+
+	if (buffer.size() < size)
+	{
+		buffer.assign(size, 0);
+	}
+
+	return buffer.data();
+}
+
+/// Sum of count * log2(count) over the byte values of a filtered row,
+/// its entropy in bits being size * log2(size) less this sum, so the larger the better.
+[[nodiscard]] double concentration(std::uint8_t const* const bytes, std::size_t const size) noexcept
+{
+	std::uint32_t counts[256]{};
+	for (std::size_t i = 0; i < size; i++)
+	{
+		counts[bytes[i]]++;
+	}
+
+	double sum = 0;
+	for (std::uint32_t const count : counts)
+	{
+		if (count > 1)
+		{
+			sum += count * std::log2(static_cast<double>(count));
+		}
+	}
+
+	return sum;
+}
+}
+
+void apply(
+	Type const type,
+	std::uint8_t const* const row,
+	std::uint8_t const* const previous,
+	std::size_t const size,
+	std::size_t const pixel_size,
+	std::uint8_t* const out
+) noexcept
+{
+	std::uint8_t const* const above = previous ? previous : zeros(size);
+
+	// The first pixel has no left neighbour, which the vector loop cannot express.
+	std::size_t const head = std::min(pixel_size, size);
+	for (std::size_t i = 0; i < head; i++)
+	{
+		out[i] = static_cast<std::uint8_t>(row[i] - predict(type, 0, above[i], 0));
+	}
+
+	apply_range(type, row, above, head, size, pixel_size, out);
+}
+
+[[nodiscard]] Type select(
+	std::uint8_t const* const row,
+	std::uint8_t const* const previous,
+	std::size_t const size,
+	std::size_t const pixel_size,
+	std::uint8_t* const out
+) noexcept
+{
+	thread_local std::vector<std::uint8_t> candidate;
+	if (candidate.size() < size)
+	{
+		candidate.resize(size);
+	}
+
+	apply(Type::None, row, previous, size, pixel_size, out);
+
+	Type best = Type::None;
+	double best_score = concentration(out, size);
+
+	for (Type const type : {Type::Sub, Type::Up, Type::Average, Type::Paeth})
+	{
+		apply(type, row, previous, size, pixel_size, candidate.data());
+
+		if (double const current = concentration(candidate.data(), size); current > best_score)
+		{
+			best = type;
+			best_score = current;
+			std::memcpy(out, candidate.data(), size);
+		}
+	}
+
+	return best;
+}
+}
@@ -0,0 +1,59 @@
+#ifndef PNGR_IMAGE_FILTER_H_
+#define PNGR_IMAGE_FILTER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace image::filter
+{
+/// PNG row filter types, valued as in the filter byte of a row.
+enum class Type : std::uint8_t
+{
+	None,
+	Sub,
+	Up,
+	Average,
+	Paeth,
+};
+
+enum class Strategy : std::uint8_t
+{
+	/// Pick the filter of every row by the entropy of its bytes, or none at all where that deflates better.
+	Adaptive,
+	/// Leave the choice to the encoder's own heuristic.
+	Default,
+	None,
+	Sub,
+	Up,
+	Average,
+	Paeth,
+};
+
+constexpr std::size_t number_of_types = 5;
+
+/// Filter a row with given type into `out`, which holds `size` bytes and does not overlap the row.
+///
+/// `previous` is the unfiltered previous row, or nullptr for the first one.
+extern void apply(
+	Type const type,
+	std::uint8_t const* const row,
+	std::uint8_t const* const previous,
+	std::size_t const size,
+	std::size_t const pixel_size,
+	std::uint8_t* const out
+) noexcept;
+
+/// Filter a row with the type whose bytes have the least entropy, writing them into `out`.
+///
+/// Deflate codes bytes by their frequency, which the sum of absolute differences of libpng only guesses at.
+[[nodiscard]] extern Type select(
+	std::uint8_t const* const row,
+	std::uint8_t const* const previous,
+	std::size_t const size,
+	std::size_t const pixel_size,
+	std::uint8_t* const out
+) noexcept;
+}
+
+#endif
@@ -0,0 +1,654 @@
+#include "font.hh"
+#include "../loaded.hh"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+
+namespace image::font
+{
+namespace
+{
+constexpr std::size_t embedded_size = 8;
+constexpr char32_t embedded_first = ' ';
+
+// font8x8_basic (public domain), based on the IBM PC BIOS font, one byte per row.
+constexpr std::uint8_t embedded_glyphs[][embedded_size]{
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+	{0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00}, // !
+	{0x6C, 0x6C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // "
+	{0x6C, 0x6C, 0xFE, 0x6C, 0xFE, 0x6C, 0x6C, 0x00}, // #
+	{0x30, 0x7C, 0xC0, 0x78, 0x0C, 0xF8, 0x30, 0x00}, // $
+	{0x00, 0xC6, 0xCC, 0x18, 0x30, 0x66, 0xC6, 0x00}, // %
+	{0x38, 0x6C, 0x38, 0x76, 0xDC, 0xCC, 0x76, 0x00}, // &
+	{0x60, 0x60, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00}, // '
+	{0x18, 0x30, 0x60, 0x60, 0x60, 0x30, 0x18, 0x00}, // (
+	{0x60, 0x30, 0x18, 0x18, 0x18, 0x30, 0x60, 0x00}, // )
+	{0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00}, // *
+	{0x00, 0x30, 0x30, 0xFC, 0x30, 0x30, 0x00, 0x00}, // +
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x60}, // ,
+	{0x00, 0x00, 0x00, 0xFC, 0x00, 0x00, 0x00, 0x00}, // -
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00}, // .
+	{0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0x80, 0x00}, // /
+	{0x7C, 0xC6, 0xCE, 0xDE, 0xF6, 0xE6, 0x7C, 0x00}, // 0
+	{0x30, 0x70, 0x30, 0x30, 0x30, 0x30, 0xFC, 0x00}, // 1
+	{0x78, 0xCC, 0x0C, 0x38, 0x60, 0xCC, 0xFC, 0x00}, // 2
+	{0x78, 0xCC, 0x0C, 0x38, 0x0C, 0xCC, 0x78, 0x00}, // 3
+	{0x1C, 0x3C, 0x6C, 0xCC, 0xFE, 0x0C, 0x1E, 0x00}, // 4
+	{0xFC, 0xC0, 0xF8, 0x0C, 0x0C, 0xCC, 0x78, 0x00}, // 5
+	{0x38, 0x60, 0xC0, 0xF8, 0xCC, 0xCC, 0x78, 0x00}, // 6
+	{0xFC, 0xCC, 0x0C, 0x18, 0x30, 0x30, 0x30, 0x00}, // 7
+	{0x78, 0xCC, 0xCC, 0x78, 0xCC, 0xCC, 0x78, 0x00}, // 8
+	{0x78, 0xCC, 0xCC, 0x7C, 0x0C, 0x18, 0x70, 0x00}, // 9
+	{0x00, 0x30, 0x30, 0x00, 0x00, 0x30, 0x30, 0x00}, // :
+	{0x00, 0x30, 0x30, 0x00, 0x00, 0x30, 0x30, 0x60}, // ;
+	{0x18, 0x30, 0x60, 0xC0, 0x60, 0x30, 0x18, 0x00}, // <
+	{0x00, 0x00, 0xFC, 0x00, 0x00, 0xFC, 0x00, 0x00}, // =
+	{0x60, 0x30, 0x18, 0x0C, 0x18, 0x30, 0x60, 0x00}, // >
+	{0x78, 0xCC, 0x0C, 0x18, 0x30, 0x00, 0x30, 0x00}, // ?
+	{0x7C, 0xC6, 0xDE, 0xDE, 0xDE, 0xC0, 0x78, 0x00}, // @
+	{0x30, 0x78, 0xCC, 0xCC, 0xFC, 0xCC, 0xCC, 0x00}, // A
+	{0xFC, 0x66, 0x66, 0x7C, 0x66, 0x66, 0xFC, 0x00}, // B
+	{0x3C, 0x66, 0xC0, 0xC0, 0xC0, 0x66, 0x3C, 0x00}, // C
+	{0xF8, 0x6C, 0x66, 0x66, 0x66, 0x6C, 0xF8, 0x00}, // D
+	{0xFE, 0x62, 0x68, 0x78, 0x68, 0x62, 0xFE, 0x00}, // E
+	{0xFE, 0x62, 0x68, 0x78, 0x68, 0x60, 0xF0, 0x00}, // F
+	{0x3C, 0x66, 0xC0, 0xC0, 0xCE, 0x66, 0x3E, 0x00}, // G
+	{0xCC, 0xCC, 0xCC, 0xFC, 0xCC, 0xCC, 0xCC, 0x00}, // H
+	{0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 0x78, 0x00}, // I
+	{0x1E, 0x0C, 0x0C, 0x0C, 0xCC, 0xCC, 0x78, 0x00}, // J
+	{0xE6, 0x66, 0x6C, 0x78, 0x6C, 0x66, 0xE6, 0x00}, // K
+	{0xF0, 0x60, 0x60, 0x60, 0x62, 0x66, 0xFE, 0x00}, // L
+	{0xC6, 0xEE, 0xFE, 0xFE, 0xD6, 0xC6, 0xC6, 0x00}, // M
+	{0xC6, 0xE6, 0xF6, 0xDE, 0xCE, 0xC6, 0xC6, 0x00}, // N
+	{0x38, 0x6C, 0xC6, 0xC6, 0xC6, 0x6C, 0x38, 0x00}, // O
+	{0xFC, 0x66, 0x66, 0x7C, 0x60, 0x60, 0xF0, 0x00}, // P
+	{0x78, 0xCC, 0xCC, 0xCC, 0xDC, 0x78, 0x1C, 0x00}, // Q
+	{0xFC, 0x66, 0x66, 0x7C, 0x6C, 0x66, 0xE6, 0x00}, // R
+	{0x78, 0xCC, 0xE0, 0x70, 0x1C, 0xCC, 0x78, 0x00}, // S
+	{0xFC, 0xB4, 0x30, 0x30, 0x30, 0x30, 0x78, 0x00}, // T
+	{0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xFC, 0x00}, // U
+	{0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0x78, 0x30, 0x00}, // V
+	{0xC6, 0xC6, 0xC6, 0xD6, 0xFE, 0xEE, 0xC6, 0x00}, // W
+	{0xC6, 0xC6, 0x6C, 0x38, 0x38, 0x6C, 0xC6, 0x00}, // X
+	{0xCC, 0xCC, 0xCC, 0x78, 0x30, 0x30, 0x78, 0x00}, // Y
+	{0xFE, 0xC6, 0x8C, 0x18, 0x32, 0x66, 0xFE, 0x00}, // Z
+	{0x78, 0x60, 0x60, 0x60, 0x60, 0x60, 0x78, 0x00}, // [
+	{0xC0, 0x60, 0x30, 0x18, 0x0C, 0x06, 0x02, 0x00}, // backslash
+	{0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0x78, 0x00}, // ]
+	{0x10, 0x38, 0x6C, 0xC6, 0x00, 0x00, 0x00, 0x00}, // ^
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF}, // _
+	{0x30, 0x30, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00}, // `
+	{0x00, 0x00, 0x78, 0x0C, 0x7C, 0xCC, 0x76, 0x00}, // a
+	{0xE0, 0x60, 0x60, 0x7C, 0x66, 0x66, 0xDC, 0x00}, // b
+	{0x00, 0x00, 0x78, 0xCC, 0xC0, 0xCC, 0x78, 0x00}, // c
+	{0x1C, 0x0C, 0x0C, 0x7C, 0xCC, 0xCC, 0x76, 0x00}, // d
+	{0x00, 0x00, 0x78, 0xCC, 0xFC, 0xC0, 0x78, 0x00}, // e
+	{0x38, 0x6C, 0x60, 0xF0, 0x60, 0x60, 0xF0, 0x00}, // f
+	{0x00, 0x00, 0x76, 0xCC, 0xCC, 0x7C, 0x0C, 0xF8}, // g
+	{0xE0, 0x60, 0x6C, 0x76, 0x66, 0x66, 0xE6, 0x00}, // h
+	{0x30, 0x00, 0x70, 0x30, 0x30, 0x30, 0x78, 0x00}, // i
+	{0x0C, 0x00, 0x0C, 0x0C, 0x0C, 0xCC, 0xCC, 0x78}, // j
+	{0xE0, 0x60, 0x66, 0x6C, 0x78, 0x6C, 0xE6, 0x00}, // k
+	{0x70, 0x30, 0x30, 0x30, 0x30, 0x30, 0x78, 0x00}, // l
+	{0x00, 0x00, 0xCC, 0xFE, 0xFE, 0xD6, 0xC6, 0x00}, // m
+	{0x00, 0x00, 0xF8, 0xCC, 0xCC, 0xCC, 0xCC, 0x00}, // n
+	{0x00, 0x00, 0x78, 0xCC, 0xCC, 0xCC, 0x78, 0x00}, // o
+	{0x00, 0x00, 0xDC, 0x66, 0x66, 0x7C, 0x60, 0xF0}, // p
+	{0x00, 0x00, 0x76, 0xCC, 0xCC, 0x7C, 0x0C, 0x1E}, // q
+	{0x00, 0x00, 0xDC, 0x76, 0x66, 0x60, 0xF0, 0x00}, // r
+	{0x00, 0x00, 0x7C, 0xC0, 0x78, 0x0C, 0xF8, 0x00}, // s
+	{0x10, 0x30, 0x7C, 0x30, 0x30, 0x34, 0x18, 0x00}, // t
+	{0x00, 0x00, 0xCC, 0xCC, 0xCC, 0xCC, 0x76, 0x00}, // u
+	{0x00, 0x00, 0xCC, 0xCC, 0xCC, 0x78, 0x30, 0x00}, // v
+	{0x00, 0x00, 0xC6, 0xD6, 0xFE, 0xFE, 0x6C, 0x00}, // w
+	{0x00, 0x00, 0xC6, 0x6C, 0x38, 0x6C, 0xC6, 0x00}, // x
+	{0x00, 0x00, 0xCC, 0xCC, 0xCC, 0x7C, 0x0C, 0xF8}, // y
+	{0x00, 0x00, 0xFC, 0x98, 0x30, 0x64, 0xFC, 0x00}, // z
+	{0x1C, 0x30, 0x30, 0xE0, 0x30, 0x30, 0x1C, 0x00}, // {
+	{0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00}, // |
+	{0xE0, 0x30, 0x30, 0x1C, 0x30, 0x30, 0xE0, 0x00}, // }
+	{0x76, 0xDC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ~
+};
+
+// Spans hold coordinates as 16-bit integers, larger glyphs are no labeling fonts anyway.
+constexpr std::int64_t max_glyph_size = 1024;
+
+// Fonts kept loaded, a server drawing text with several of them.
+constexpr std::size_t font_cache_capacity = 8;
+
+constexpr std::uint8_t psf1_magic[]{0x36, 0x04};
+constexpr std::uint8_t psf1_mode_512 = 0x01;
+constexpr std::uint8_t psf1_mode_table = 0x02 | 0x04;
+constexpr std::size_t psf1_header_size = 4;
+constexpr std::uint16_t psf1_separator = 0xFFFF;
+constexpr std::uint16_t psf1_sequence = 0xFFFE;
+
+constexpr std::uint8_t psf2_magic[]{0x72, 0xB5, 0x4A, 0x86};
+constexpr std::uint32_t psf2_flag_table = 0x01;
+constexpr std::size_t psf2_header_size = 32;
+constexpr char psf2_separator = '\xFF';
+constexpr char psf2_sequence = '\xFE';
+
+[[nodiscard]] std::uint32_t read_le32(std::string_view const data, std::size_t const offset) noexcept
+{
+	std::uint32_t value = 0;
+	for (std::size_t i = 0; i < 4; i++)
+	{
+		value |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(data[offset + i])) << (8 * i);
+	}
+
+	return value;
+}
+
+[[nodiscard]] bool starts_with(std::string_view const data, std::uint8_t const* const magic, std::size_t const size) noexcept
+{
+	return data.size() >= size && std::equal(magic, magic + size, data.begin(), [] (std::uint8_t const a, char const b) {
+		return a == static_cast<std::uint8_t>(b);
+	});
+}
+
+/// Rasterise `count` glyphs of `glyph_size` bytes from `offset`, and map them to code points
+/// from the unicode table following them if any, or to their index otherwise.
+[[nodiscard]] Font load_psf(
+	std::string_view const data,
+	std::size_t const offset,
+	std::size_t const count,
+	std::size_t const glyph_size,
+	std::size_t const width,
+	std::size_t const height,
+	bool const has_table,
+	bool const is_version_2
+)
+{
+	std::size_t const stride = (width + 7) / 8;
+
+	if (
+		!count
+		|| !width
+		|| !height
+		|| width > max_glyph_size
+		|| height > max_glyph_size
+		|| glyph_size < stride * height
+		|| offset > data.size()
+		|| count > (data.size() - offset) / glyph_size
+	)
+	{
+		throw std::runtime_error("malformed psf font");
+	}
+
+	auto const* const bytes = reinterpret_cast<std::uint8_t const*>(data.data());
+
+	Font font(height);
+
+	std::vector<Glyph> glyphs(count);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		glyphs[i] = font.rasterise(bytes + offset + i * glyph_size, width, height, stride, 0, 0, width);
+	}
+
+	if (!has_table)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			font.assign(i, glyphs[i]);
+		}
+
+		return font;
+	}
+
+	// Every glyph lists the code points it stands for, then sequences of combining ones that are not supported.
+	std::size_t position = offset + count * glyph_size;
+	for (std::size_t i = 0; i < count && position < data.size(); i++)
+	{
+		if (is_version_2)
+		{
+			std::size_t const end = std::min(data.find(psf2_separator, position), data.size());
+			std::string_view const codes = data.substr(position, std::min(data.find(psf2_sequence, position), end) - position);
+
+			for (std::size_t j = 0; j < codes.size();)
+			{
+				font.assign(decode(codes, j), glyphs[i]);
+			}
+
+			position = end + 1;
+			continue;
+		}
+
+		bool is_sequence = false;
+		for (; position + 2 <= data.size(); position += 2)
+		{
+			std::uint16_t const code = static_cast<std::uint8_t>(data[position]) | static_cast<std::uint8_t>(data[position + 1]) << 8;
+
+			if (code == psf1_separator)
+			{
+				position += 2;
+				break;
+			}
+
+			if (code == psf1_sequence)
+			{
+				is_sequence = true;
+			}
+			else
+			if (!is_sequence)
+			{
+				font.assign(code, glyphs[i]);
+			}
+		}
+	}
+
+	return font;
+}
+
+[[nodiscard]] Font load_psf1(std::string_view const data)
+{
+	if (data.size() < psf1_header_size)
+	{
+		throw std::runtime_error("malformed psf font");
+	}
+
+	std::uint8_t const mode = data[2];
+	std::size_t const height = static_cast<std::uint8_t>(data[3]);
+
+	return load_psf(
+		data,
+		psf1_header_size,
+		mode & psf1_mode_512 ? 512 : 256,
+		height,
+		8,
+		height,
+		mode & psf1_mode_table,
+		false
+	);
+}
+
+[[nodiscard]] Font load_psf2(std::string_view const data)
+{
+	if (data.size() < psf2_header_size)
+	{
+		throw std::runtime_error("malformed psf font");
+	}
+
+	return load_psf(
+		data,
+		read_le32(data, 8),
+		read_le32(data, 16),
+		read_le32(data, 20),
+		read_le32(data, 28),
+		read_le32(data, 24),
+		read_le32(data, 12) & psf2_flag_table,
+		true
+	);
+}
+
+/// Read a line without its carriage return, if any.
+[[nodiscard]] bool next_line(std::istream& is, std::string& line)
+{
+	if (!std::getline(is, line))
+	{
+		return false;
+	}
+
+	if (!line.empty() && line.back() == '\r')
+	{
+		line.pop_back();
+	}
+
+	return true;
+}
+
+[[nodiscard]] Font load_bdf(std::string_view const data)
+{
+	std::istringstream is{std::string(data)};
+	std::string line;
+
+	auto const malformed = [] { return std::runtime_error("malformed bdf font"); };
+
+	// Font bounding box: default glyph dimensions and offset from the origin, on the baseline.
+	std::int64_t box_width = 0;
+	std::int64_t box_height = 0;
+	std::int64_t box_x = 0;
+	std::int64_t box_y = 0;
+
+	std::optional<std::int64_t> ascent;
+	std::optional<std::int64_t> descent;
+
+	std::optional<Font> font;
+
+	std::int64_t code = -1;
+	std::int64_t advance = 0;
+	std::int64_t width = 0;
+	std::int64_t height = 0;
+	std::int64_t x = 0;
+	std::int64_t y = 0;
+
+	std::vector<std::uint8_t> bitmap;
+
+	while (next_line(is, line))
+	{
+		std::istringstream fields(line);
+		std::string keyword;
+
+		if (!(fields >> keyword))
+		{
+			continue;
+		}
+
+		if (keyword == "FONTBOUNDINGBOX")
+		{
+			fields >> box_width >> box_height >> box_x >> box_y;
+		}
+		else
+		if (keyword == "FONT_ASCENT")
+		{
+			fields >> ascent.emplace();
+		}
+		else
+		if (keyword == "FONT_DESCENT")
+		{
+			fields >> descent.emplace();
+		}
+		else
+		if (keyword == "STARTCHAR")
+		{
+			if (!font.has_value())
+			{
+				std::int64_t const line_height = ascent.value_or(box_height + box_y) + descent.value_or(-box_y);
+				if (line_height <= 0 || line_height > max_glyph_size)
+				{
+					throw malformed();
+				}
+
+				font.emplace(line_height);
+			}
+
+			code = -1;
+			advance = box_width;
+			width = box_width;
+			height = box_height;
+			x = box_x;
+			y = box_y;
+		}
+		else
+		if (keyword == "ENCODING")
+		{
+			fields >> code;
+		}
+		else
+		if (keyword == "DWIDTH")
+		{
+			fields >> advance;
+		}
+		else
+		if (keyword == "BBX")
+		{
+			fields >> width >> height >> x >> y;
+		}
+		else
+		if (keyword == "BITMAP")
+		{
+			if (
+				!font.has_value()
+				|| width < 0 || width > max_glyph_size
+				|| height < 0 || height > max_glyph_size
+				|| std::abs(x) > max_glyph_size || std::abs(y) > max_glyph_size
+				|| advance < 0 || advance > max_glyph_size
+			)
+			{
+				throw malformed();
+			}
+
+			std::size_t const stride = (width + 7) / 8;
+			bitmap.assign(stride * height, 0);
+
+			for (std::int64_t row = 0; row < height; row++)
+			{
+				if (!next_line(is, line) || line.size() < stride * 2)
+				{
+					throw malformed();
+				}
+
+				for (std::size_t i = 0; i < stride; i++)
+				{
+					char const* const digits = line.data() + 2 * i;
+					if (std::from_chars(digits, digits + 2, bitmap[row * stride + i], 16).ptr != digits + 2)
+					{
+						throw malformed();
+					}
+				}
+			}
+
+			// Glyphs without an encoding cannot be drawn.
+			if (code >= 0)
+			{
+				std::int64_t const top = ascent.value_or(box_height + box_y) - (y + height);
+				font->assign(code, font->rasterise(bitmap.data(), width, height, stride, x, top, advance));
+			}
+		}
+
+		if (fields.fail())
+		{
+			throw malformed();
+		}
+	}
+
+	if (!font.has_value())
+	{
+		throw malformed();
+	}
+
+	return std::move(font.value());
+}
+}
+
+Font::Font(std::size_t const line_height) noexcept : line_height(line_height)
+{
+}
+
+[[nodiscard]] Glyph Font::rasterise(
+	std::uint8_t const* const bitmap,
+	std::size_t const width,
+	std::size_t const height,
+	std::size_t const stride,
+	std::int64_t const x_offset,
+	std::int64_t const y_offset,
+	std::size_t const advance
+) &
+{
+	Glyph glyph{static_cast<std::uint32_t>(spans.size()), 0, static_cast<std::uint16_t>(advance)};
+
+	auto const is_set = [bitmap, stride] (std::size_t const x, std::size_t const y) {
+		return bitmap[y * stride + x / 8] >> (7 - x % 8) & 1;
+	};
+
+	for (std::size_t y = 0; y < height; y++)
+	{
+		// Rows above the cell are cut off.
+		std::int64_t const row = y_offset + static_cast<std::int64_t>(y);
+		if (row < 0)
+		{
+			continue;
+		}
+
+		for (std::size_t x = 0; x < width;)
+		{
+			if (!is_set(x, y))
+			{
+				x++;
+				continue;
+			}
+
+			std::size_t const begin = x;
+			while (x < width && is_set(x, y))
+			{
+				x++;
+			}
+
+			std::int64_t const left = x_offset + static_cast<std::int64_t>(begin);
+
+			spans.push_back(Span{
+				static_cast<std::int16_t>(left),
+				static_cast<std::uint16_t>(row),
+				static_cast<std::uint16_t>(x - begin),
+			});
+
+			extent_left = std::min(extent_left, left);
+			extent_bottom = std::max(extent_bottom, static_cast<std::size_t>(row) + 1);
+		}
+	}
+
+	glyph.span_count = static_cast<std::uint32_t>(spans.size() - glyph.first_span);
+	return glyph;
+}
+
+void Font::assign(char32_t const code, Glyph const& glyph) &
+{
+	if (code < ascii.size())
+	{
+		// The first glyph of a code point wins, as fonts may list one several times.
+		if (!has_ascii[code])
+		{
+			ascii[code] = glyph;
+			has_ascii[code] = true;
+		}
+
+		return;
+	}
+
+	others.emplace(code, glyph);
+}
+
+[[nodiscard]] Glyph const* Font::glyph(char32_t const code) const& noexcept
+{
+	if (code < ascii.size())
+	{
+		if (has_ascii[code])
+		{
+			return &ascii[code];
+		}
+	}
+	else
+	if (auto const it = others.find(code); it != others.end())
+	{
+		return &it->second;
+	}
+
+	return code != '?' ? glyph('?') : nullptr;
+}
+
+[[nodiscard]] Span const* Font::atlas() const& noexcept
+{
+	return spans.data();
+}
+
+[[nodiscard]] std::size_t Font::height() const& noexcept
+{
+	return line_height;
+}
+
+[[nodiscard]] std::int64_t Font::left() const& noexcept
+{
+	return extent_left;
+}
+
+[[nodiscard]] std::size_t Font::bottom() const& noexcept
+{
+	return std::max(extent_bottom, line_height);
+}
+
+[[nodiscard]] char32_t decode(std::string_view const text, std::size_t& i) noexcept
+{
+	auto const byte = [text] (std::size_t const j) { return static_cast<std::uint8_t>(text[j]); };
+
+	std::uint8_t const lead = byte(i);
+	std::size_t const length =
+		lead >> 5 == 0x06 ? 2
+		: lead >> 4 == 0x0E ? 3
+		: lead >> 3 == 0x1E ? 4
+		: 1;
+
+	// Bytes of malformed sequences stand for themselves, as in Latin-1.
+	if (length == 1 || i + length > text.size())
+	{
+		i++;
+		return lead;
+	}
+
+	char32_t code = lead & (0x7F >> length);
+	for (std::size_t j = 1; j < length; j++)
+	{
+		if (byte(i + j) >> 6 != 0x02)
+		{
+			i++;
+			return lead;
+		}
+
+		code = code << 6 | (byte(i + j) & 0x3F);
+	}
+
+	i += length;
+	return code;
+}
+
+[[nodiscard]] Font const& embedded()
+{
+	static Font const font = [] {
+		Font font(embedded_size);
+
+		for (std::size_t i = 0; i < std::size(embedded_glyphs); i++)
+		{
+			Glyph const glyph = font.rasterise(embedded_glyphs[i], embedded_size, embedded_size, 1, 0, 0, embedded_size);
+			font.assign(embedded_first + i, glyph);
+		}
+
+		return font;
+	}();
+
+	return font;
+}
+
+[[nodiscard]] std::shared_ptr<Font const> load(std::string const& path)
+{
+	static loaded::Cache<Font> fonts(font_cache_capacity);
+
+	return fonts.get(
+		path,
+		[] (std::string const& path)
+		{
+			std::ifstream is(path, std::ios::in | std::ios::binary);
+			if (!is)
+			{
+				throw std::runtime_error("could not open font file for read");
+			}
+
+			std::string const data{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+
+			if (starts_with(data, psf1_magic, std::size(psf1_magic)))
+			{
+				return std::make_shared<Font const>(load_psf1(data));
+			}
+
+			if (starts_with(data, psf2_magic, std::size(psf2_magic)))
+			{
+				return std::make_shared<Font const>(load_psf2(data));
+			}
+
+			if (data.rfind("STARTFONT", 0) == 0)
+			{
+				return std::make_shared<Font const>(load_bdf(data));
+			}
+
+			throw std::runtime_error("unsupported font format (psf or bdf expected)");
+		}
+	);
+}
+}
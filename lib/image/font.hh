@@ -0,0 +1,95 @@
+#ifndef PNGR_IMAGE_FONT_H_
+#define PNGR_IMAGE_FONT_H_
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace image::font
+{
+/// Horizontal run of set pixels of a glyph, relative to the top left corner of its cell.
+struct Span
+{
+	std::int16_t x;
+	std::uint16_t y;
+	std::uint16_t length;
+};
+
+/// Spans of a glyph, as a range of the atlas of its font.
+struct Glyph
+{
+	std::uint32_t first_span = 0;
+	std::uint32_t span_count = 0;
+	std::uint16_t advance = 0;
+};
+
+/// Bitmap font whose glyphs are rasterised once into a single atlas of spans,
+/// so that drawing a glyph is filling a few rectangles rather than testing every bit of its bitmap.
+class Font
+{
+	std::size_t line_height;
+
+	std::vector<Span> spans;
+
+	std::int64_t extent_left = 0;
+	std::size_t extent_bottom = 0;
+
+	// Most text is ASCII, looked up without hashing.
+	std::array<Glyph, 128> ascii{};
+	std::bitset<128> has_ascii;
+	std::unordered_map<char32_t, Glyph> others;
+
+public:
+	explicit Font(std::size_t const line_height) noexcept;
+
+	/// Add the spans of a bitmap of `height` rows of `width` pixels, `stride` bytes apart,
+	/// packed from the most significant bit, its top left corner at `x_offset`, `y_offset` in the cell.
+	[[nodiscard]] Glyph rasterise(
+		std::uint8_t const* const bitmap,
+		std::size_t const width,
+		std::size_t const height,
+		std::size_t const stride,
+		std::int64_t const x_offset,
+		std::int64_t const y_offset,
+		std::size_t const advance
+	) &;
+
+	/// Draw a code point with a glyph, unless one was assigned to it already.
+	void assign(char32_t const code, Glyph const& glyph) &;
+
+	/// Glyph of a code point, that of `?` if the font has none, or nullptr.
+	[[nodiscard]] Glyph const* glyph(char32_t const code) const& noexcept;
+
+	[[nodiscard]] Span const* atlas() const& noexcept;
+
+	/// Distance between baselines of consecutive lines.
+	[[nodiscard]] std::size_t height() const& noexcept;
+
+	/// Leftmost column and row below the bottommost one that any glyph reaches, relative to its cell.
+	[[nodiscard]] std::int64_t left() const& noexcept;
+	[[nodiscard]] std::size_t bottom() const& noexcept;
+};
+
+/// Decode the UTF-8 code point at `i`, moving `i` past it.
+///
+/// Bytes that start no valid sequence decode as themselves.
+[[nodiscard]] extern char32_t decode(std::string_view const text, std::size_t& i) noexcept;
+
+/// Built-in 8x8 font of printable ASCII characters.
+[[nodiscard]] extern Font const& embedded();
+
+/// Load a PSF (version 1 or 2) or BDF font, reusing one loaded from the same version of the file,
+/// among the few most recently used.
+///
+/// Throws std::runtime_error if the file cannot be read or is malformed.
+[[nodiscard]] extern std::shared_ptr<Font const> load(std::string const& path);
+}
+
+#endif
@@ -10,6 +10,11 @@ namespace image
 	return number_of_channels;
 }
 
+[[nodiscard]] std::size_t Image::depth() const& noexcept
+{
+	return bit_depth;
+}
+
 [[nodiscard]] std::size_t Image::index(math::Vector const& position) const& noexcept
 {
 	return position.x + position.y * width();
@@ -3,6 +3,7 @@
 
 #include "../math.hh"
 #include "../color.hh"
+#include "transform.hh"
 
 #include <istream>
 #include <ostream>
@@ -26,6 +27,7 @@ public:
 
 	[[nodiscard]] virtual std::size_t color_depth() const& noexcept = 0;
 	[[nodiscard]] std::size_t channels() const& noexcept;
+	[[nodiscard]] std::size_t depth() const& noexcept;
 
 	[[nodiscard]] std::size_t index(math::Vector const& position) const& noexcept;
 	[[nodiscard]] math::Vector coordinates(std::size_t const i) const& noexcept;
@@ -37,6 +39,25 @@ public:
 	[[nodiscard]] virtual color::Value get(math::Vector const& position) const& noexcept = 0;
 	virtual void set(math::Vector const& position, color::Value const value) const& noexcept = 0;
 
+	/// Raw samples of a row: big-endian, channels interleaved, sub-byte pixels packed from the most significant bit.
+	[[nodiscard]] virtual std::uint8_t* row(std::size_t const y) const& noexcept = 0;
+
+	/// Convert samples to given number of channels (1 - grayscale, 2 - grayscale with alpha, 3 - RGB, 4 - RGBA)
+	/// and bit depth.
+	virtual void convert(std::size_t const channels, std::size_t const bit_depth) & = 0;
+
+	/// Convert indexed and sub-byte samples to 8 bits, so that every sample is an intensity.
+	virtual void expand() & = 0;
+
+	/// Rotate, flip or transpose the image.
+	virtual void transform(transform::Operation const operation) & = 0;
+
+	/// Number of frames of an animation, a still image having one.
+	[[nodiscard]] virtual std::size_t frame_count() const& noexcept = 0;
+
+	/// Frame of an animation, the first one being the image itself.
+	[[nodiscard]] virtual Image& frame(std::size_t const i) & noexcept = 0;
+
 	void set_channel(math::Vector const& position, color::ChannelIndex const channel, color::Value const value) const& noexcept;
 
 	virtual void save(std::ostream& os) const& = 0;
@@ -0,0 +1,126 @@
+#include "mask.hh"
+#include "png.hh"
+#include "../loaded.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+
+namespace image::mask
+{
+namespace
+{
+constexpr std::size_t word_bits = 64;
+
+// Masks kept loaded, each a bit per pixel of the images it applies to.
+constexpr std::size_t mask_cache_capacity = 4;
+}
+
+Mask::Mask(Image& img)
+	: mask_width(img.width()),
+	  mask_height(img.height()),
+	  words_per_row((mask_width + word_bits - 1) / word_bits),
+	  bits(words_per_row * mask_height),
+	  coverages(mask_height)
+{
+	img.convert(1, 8);
+
+	for (std::size_t y = 0; y < mask_height; y++)
+	{
+		std::uint8_t const* const samples = img.row(y);
+		std::uint64_t* const words = bits.data() + y * words_per_row;
+
+		std::size_t count = 0;
+		for (std::size_t x = 0; x < mask_width; x++)
+		{
+			bool const is_set = samples[x] >= 0x80;
+
+			words[x / word_bits] |= static_cast<std::uint64_t>(is_set) << (x % word_bits);
+			count += is_set;
+		}
+
+		coverages[y] = !count ? Coverage::None : count == mask_width ? Coverage::Full : Coverage::Partial;
+	}
+}
+
+[[nodiscard]] std::size_t Mask::width() const& noexcept
+{
+	return mask_width;
+}
+
+[[nodiscard]] std::size_t Mask::height() const& noexcept
+{
+	return mask_height;
+}
+
+[[nodiscard]] std::uint64_t const* Mask::row(std::size_t const y) const& noexcept
+{
+	return bits.data() + y * words_per_row;
+}
+
+[[nodiscard]] Coverage Mask::coverage(std::size_t const y) const& noexcept
+{
+	return coverages[y];
+}
+
+[[nodiscard]] bool Mask::is_set(std::size_t const x, std::size_t const y) const& noexcept
+{
+	return (bits[y * words_per_row + x / word_bits] >> (x % word_bits)) & 1;
+}
+
+[[nodiscard]] std::size_t Mask::find(std::size_t const y, std::size_t x, std::size_t const end, bool const is_set) const& noexcept
+{
+	std::uint64_t const* const words = row(y);
+
+	while (x < end)
+	{
+		// Bits of the pixels from `x` to the end of its word, those sought set.
+		std::uint64_t const word = (is_set ? words[x / word_bits] : ~words[x / word_bits]) >> (x % word_bits);
+
+		if (word)
+		{
+			return std::min<std::size_t>(x + __builtin_ctzll(word), end);
+		}
+
+		x = (x / word_bits + 1) * word_bits;
+	}
+
+	return end;
+}
+
+void validate(Mask const& mask, Image const& img)
+{
+	if (img.width() != mask.width() || img.height() != mask.height())
+	{
+		throw std::runtime_error(
+			"mask of different dimensions ("
+			+ std::to_string(mask.width()) + 'x' + std::to_string(mask.height()) + ") than the image ("
+			+ std::to_string(img.width()) + 'x' + std::to_string(img.height()) + ")"
+		);
+	}
+}
+
+[[nodiscard]] std::shared_ptr<Mask const> load(std::string const& path)
+{
+	static loaded::Cache<Mask> masks(mask_cache_capacity);
+
+	return masks.get(
+		path,
+		[] (std::string const& path)
+		{
+			std::ifstream is(path, std::ios::in | std::ios::binary);
+			if (!is)
+			{
+				throw std::runtime_error("could not open mask file for read");
+			}
+
+			png::PNG img;
+			img.open(is);
+
+			return std::make_shared<Mask const>(img);
+		}
+	);
+}
+}
@@ -0,0 +1,88 @@
+#ifndef PNGR_IMAGE_MASK_H_
+#define PNGR_IMAGE_MASK_H_
+
+#include "image.hh"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace image::mask
+{
+/// How many pixels of a row of a mask are set.
+enum class Coverage : std::uint8_t
+{
+	None,
+	Partial,
+	Full,
+};
+
+/// Pixels an operation may change, a bit each: pixel `x` of a row is bit `x % 64` of its word `x / 64`.
+class Mask
+{
+	std::size_t mask_width;
+	std::size_t mask_height;
+	std::size_t words_per_row;
+
+	std::vector<std::uint64_t> bits;
+	std::vector<Coverage> coverages;
+
+	/// First pixel of row `y` from `x` on, before `end`, whose bit is `is_set`, or `end` if there is none.
+	[[nodiscard]] std::size_t find(std::size_t const y, std::size_t x, std::size_t const end, bool const is_set) const& noexcept;
+
+public:
+	/// Pack an image whose pixels are set where the first channel is at least half the maximum:
+	/// white pixels of a 1-bit mask, those of at least 128 in an 8-bit one. Converts the image to 8-bit grayscale.
+	explicit Mask(Image& img);
+
+	[[nodiscard]] std::size_t width() const& noexcept;
+	[[nodiscard]] std::size_t height() const& noexcept;
+
+	[[nodiscard]] std::uint64_t const* row(std::size_t const y) const& noexcept;
+	[[nodiscard]] Coverage coverage(std::size_t const y) const& noexcept;
+
+	[[nodiscard]] bool is_set(std::size_t const x, std::size_t const y) const& noexcept;
+
+	/// Call `fill(first, last)` for every run of set pixels of row `y` from `x_first` to `x_last`, both within the mask.
+	///
+	/// A row the mask leaves out is skipped and one it fully covers is a single run, only the others being scanned,
+	/// a word of 64 pixels at a time.
+	template <typename Fill>
+	void runs(std::size_t const y, std::size_t const x_first, std::size_t const x_last, Fill const& fill) const&
+	{
+		Coverage const row_coverage = coverages[y];
+
+		if (row_coverage == Coverage::None)
+		{
+			return;
+		}
+
+		if (row_coverage == Coverage::Full)
+		{
+			fill(x_first, x_last);
+			return;
+		}
+
+		std::size_t const end = x_last + 1;
+
+		for (std::size_t x = find(y, x_first, end, true); x < end;)
+		{
+			std::size_t const run_end = find(y, x, end, false);
+			fill(x, run_end - 1);
+			x = find(y, run_end, end, true);
+		}
+	}
+};
+
+/// Throws std::runtime_error unless an image has the dimensions of a mask.
+extern void validate(Mask const& mask, Image const& img);
+
+/// Load a png mask, reusing one loaded from the same version of the file, among the few most recently used.
+///
+/// Throws std::runtime_error if the file cannot be read or decoded.
+[[nodiscard]] extern std::shared_ptr<Mask const> load(std::string const& path);
+}
+
+#endif
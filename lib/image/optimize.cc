@@ -0,0 +1,348 @@
+#include "optimize.hh"
+
+#include <algorithm>
+#include <iterator>
+
+
+namespace image::optimize
+{
+namespace
+{
+constexpr std::uint16_t opaque = 0xFFFF;
+
+// Bits of a sample that must equal the sample shifted right by 8, 4, 2 and 1 bits
+// for it to be an exact scaling of an 8, 4, 2 and 1-bit value.
+constexpr std::uint16_t repeat_masks[]{0x00FF, 0x0FFF, 0x3FFF, 0x7FFF};
+constexpr std::size_t repeat_depths[]{8, 4, 2, 1};
+
+// Per chunk: length, type and CRC.
+constexpr std::size_t chunk_overhead = 12;
+
+[[nodiscard]] inline std::uint16_t alpha_of(Color const color) noexcept
+{
+	return color & 0xFFFF;
+}
+
+[[nodiscard]] inline std::size_t hash(Color color) noexcept
+{
+	color ^= color >> 33;
+	color *= 0xFF51AFD7ED558CCD;
+	color ^= color >> 33;
+	return color;
+}
+
+[[nodiscard]] inline Color pack(std::uint16_t const* const pixel) noexcept
+{
+	return
+		static_cast<Color>(pixel[0]) << 48 |
+		static_cast<Color>(pixel[1]) << 32 |
+		static_cast<Color>(pixel[2]) << 16 |
+		pixel[3];
+}
+
+[[nodiscard]] inline std::size_t row_size(std::size_t const width, std::size_t const bits_per_pixel) noexcept
+{
+	return (width * bits_per_pixel + 7) / 8;
+}
+}
+
+void Analysis::insert(Color const color) noexcept
+{
+	if (!color)
+	{
+		has_zero = true;
+	}
+	else
+	{
+		for (std::size_t i = hash(color) % table_size;; i = (i + 1) % table_size)
+		{
+			if (table[i] == color)
+			{
+				return;
+			}
+
+			if (!table[i])
+			{
+				table[i] = color;
+				number_of_colors++;
+				break;
+			}
+		}
+	}
+
+	// The table stays at most a quarter full, so a probe always ends on an empty slot.
+	if (number_of_colors + has_zero > max_palette_size)
+	{
+		has_many_colors = true;
+	}
+}
+
+void Analysis::accumulate(std::uint16_t const* const rgba, std::size_t const width) noexcept
+{
+	// Branch-free reductions, which the compiler turns into vector code.
+	std::uint16_t row_alpha = alpha;
+	std::uint16_t row_chroma = chroma;
+	std::uint16_t row_samples = sample_repeats;
+	std::uint16_t row_gray_8 = gray_repeats[0];
+	std::uint16_t row_gray_4 = gray_repeats[1];
+	std::uint16_t row_gray_2 = gray_repeats[2];
+	std::uint16_t row_gray_1 = gray_repeats[3];
+
+	for (std::size_t x = 0; x < width; x++)
+	{
+		std::uint16_t const r = rgba[x * 4];
+		std::uint16_t const g = rgba[x * 4 + 1];
+		std::uint16_t const b = rgba[x * 4 + 2];
+		std::uint16_t const a = rgba[x * 4 + 3];
+
+		row_alpha &= a;
+		row_chroma |= (r ^ g) | (r ^ b);
+		row_samples |= (r ^ (r >> 8)) | (g ^ (g >> 8)) | (b ^ (b >> 8)) | (a ^ (a >> 8));
+
+		row_gray_8 |= r ^ (r >> 8);
+		row_gray_4 |= r ^ (r >> 4);
+		row_gray_2 |= r ^ (r >> 2);
+		row_gray_1 |= r ^ (r >> 1);
+	}
+
+	alpha = row_alpha;
+	chroma = row_chroma;
+	sample_repeats = row_samples;
+	gray_repeats = {row_gray_8, row_gray_4, row_gray_2, row_gray_1};
+
+	if (has_many_colors)
+	{
+		return;
+	}
+
+	// Runs of one color are frequent in flat images, and only need one lookup.
+	Color previous = 0;
+	bool has_previous = false;
+
+	for (std::size_t x = 0; x < width && !has_many_colors; x++)
+	{
+		Color const color = pack(rgba + x * 4);
+
+		if (has_previous && color == previous)
+		{
+			continue;
+		}
+
+		insert(color);
+
+		previous = color;
+		has_previous = true;
+	}
+}
+
+void Analysis::merge(Analysis const& other) noexcept
+{
+	alpha &= other.alpha;
+	chroma |= other.chroma;
+	sample_repeats |= other.sample_repeats;
+	for (std::size_t i = 0; i < gray_repeats.size(); i++)
+	{
+		gray_repeats[i] |= other.gray_repeats[i];
+	}
+
+	has_many_colors |= other.has_many_colors;
+
+	if (other.has_zero && !has_many_colors)
+	{
+		insert(0);
+	}
+
+	for (std::size_t i = 0; i < table_size && !has_many_colors; i++)
+	{
+		if (other.table[i])
+		{
+			insert(other.table[i]);
+		}
+	}
+}
+
+[[nodiscard]] bool Analysis::is_opaque() const& noexcept
+{
+	return alpha == opaque;
+}
+
+[[nodiscard]] bool Analysis::is_gray() const& noexcept
+{
+	return !chroma;
+}
+
+[[nodiscard]] bool Analysis::fits_8_bits() const& noexcept
+{
+	return !(sample_repeats & repeat_masks[0]);
+}
+
+[[nodiscard]] std::size_t Analysis::gray_bit_depth() const& noexcept
+{
+	std::size_t bit_depth = 16;
+
+	// Each depth can only hold values that every larger depth holds too.
+	for (std::size_t i = 0; i < gray_repeats.size() && !(gray_repeats[i] & repeat_masks[i]); i++)
+	{
+		bit_depth = repeat_depths[i];
+	}
+
+	return bit_depth;
+}
+
+[[nodiscard]] bool Analysis::is_palette_overflowed() const& noexcept
+{
+	return has_many_colors;
+}
+
+[[nodiscard]] std::vector<Color> Analysis::colors() const&
+{
+	std::vector<Color> colors;
+	if (has_many_colors)
+	{
+		return colors;
+	}
+
+	colors.reserve(number_of_colors + has_zero);
+	if (has_zero)
+	{
+		colors.push_back(0);
+	}
+
+	std::copy_if(table.begin(), table.end(), std::back_inserter(colors), [] (Color const color) { return color; });
+
+	// Translucent entries go first, so that the transparency chunk can leave out the opaque rest.
+	std::sort(
+		colors.begin(),
+		colors.end(),
+		[] (Color const a, Color const b)
+		{
+			bool const is_a_opaque = alpha_of(a) == opaque;
+			bool const is_b_opaque = alpha_of(b) == opaque;
+			return is_a_opaque != is_b_opaque ? is_b_opaque : a < b;
+		}
+	);
+
+	return colors;
+}
+
+Palette::Palette(std::vector<Color> const& entries) noexcept
+{
+	for (std::size_t i = 0; i < entries.size() && i < max_palette_size; i++)
+	{
+		Color const color = entries[i];
+		if (!color)
+		{
+			zero_index = i;
+			continue;
+		}
+
+		std::size_t slot = hash(color) % table_size;
+		while (colors[slot] && colors[slot] != color)
+		{
+			slot = (slot + 1) % table_size;
+		}
+
+		colors[slot] = color;
+		indices[slot] = i;
+	}
+}
+
+[[nodiscard]] std::uint8_t Palette::index(Color const color) const& noexcept
+{
+	if (!color)
+	{
+		return zero_index;
+	}
+
+	std::size_t slot = hash(color) % table_size;
+	while (colors[slot] != color && colors[slot])
+	{
+		slot = (slot + 1) % table_size;
+	}
+
+	return indices[slot];
+}
+
+void pack_indices(
+	std::uint16_t const* const rgba,
+	std::size_t const width,
+	Palette const& palette,
+	std::size_t const bit_depth,
+	std::uint8_t* const row
+) noexcept
+{
+	std::size_t const pixels_per_byte = 8 / bit_depth;
+
+	Color previous = pack(rgba);
+	std::uint8_t index = palette.index(previous);
+
+	for (std::size_t x = 0; x < width; x++)
+	{
+		Color const color = pack(rgba + x * 4);
+		if (color != previous)
+		{
+			previous = color;
+			index = palette.index(color);
+		}
+
+		if (bit_depth == 8)
+		{
+			row[x] = index;
+		}
+		else
+		{
+			std::size_t const shift = 8 - bit_depth * (x % pixels_per_byte + 1);
+			row[x / pixels_per_byte] |= index << shift;
+		}
+	}
+}
+
+[[nodiscard]] Representation choose(Analysis const& analysis, std::size_t const width, std::size_t const height)
+{
+	bool const is_opaque = analysis.is_opaque();
+	bool const fits_8_bits = analysis.fits_8_bits();
+
+	Representation direct{};
+	if (analysis.is_gray())
+	{
+		direct.channels = is_opaque ? 1 : 2;
+		direct.bit_depth = is_opaque ? analysis.gray_bit_depth() : fits_8_bits ? 8 : 16;
+	}
+	else
+	{
+		direct.channels = is_opaque ? 3 : 4;
+		direct.bit_depth = fits_8_bits ? 8 : 16;
+	}
+
+	if (analysis.is_palette_overflowed() || !fits_8_bits)
+	{
+		return direct;
+	}
+
+	std::vector<Color> const colors = analysis.colors();
+	if (colors.empty())
+	{
+		return direct;
+	}
+
+	Representation indexed{1, 1, true};
+	while ((static_cast<std::size_t>(1) << indexed.bit_depth) < colors.size())
+	{
+		indexed.bit_depth *= 2;
+	}
+
+	std::size_t const translucent = std::count_if(
+		colors.begin(),
+		colors.end(),
+		[] (Color const color) { return alpha_of(color) != opaque; }
+	);
+
+	std::size_t const direct_size = row_size(width, direct.channels * direct.bit_depth) * height;
+	std::size_t const indexed_size =
+		row_size(width, indexed.bit_depth) * height +
+		chunk_overhead + 3 * colors.size() +
+		(translucent ? chunk_overhead + translucent : 0);
+
+	return indexed_size < direct_size ? indexed : direct;
+}
+}
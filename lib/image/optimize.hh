@@ -0,0 +1,99 @@
+#ifndef PNGR_IMAGE_OPTIMIZE_H_
+#define PNGR_IMAGE_OPTIMIZE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace image::optimize
+{
+constexpr std::size_t max_palette_size = 256;
+
+/// Color packed as four 16-bit RGBA samples, red in the most significant bits.
+using Color = std::uint64_t;
+
+/// What is known of a set of pixels, gathered from 16-bit RGBA rows.
+class Analysis
+{
+	static constexpr std::size_t table_size = 4 * max_palette_size;
+
+	// Bitwise accumulators: an ANDed alpha, ORed differences between colors,
+	// and ORed differences between samples and themselves shifted by 8, 4, 2 and 1 bits.
+	std::uint16_t alpha = 0xFFFF;
+	std::uint16_t chroma = 0;
+	std::uint16_t sample_repeats = 0;
+	std::array<std::uint16_t, 4> gray_repeats{};
+
+	// Open-addressing set of distinct colors, zero marking empty slots.
+	std::array<Color, table_size> table{};
+	std::size_t number_of_colors = 0;
+	bool has_zero = false;
+	bool has_many_colors = false;
+
+	void insert(Color const color) noexcept;
+
+public:
+	/// Add a row of `width` pixels.
+	void accumulate(std::uint16_t const* const rgba, std::size_t const width) noexcept;
+
+	/// Add the pixels of another analysis.
+	void merge(Analysis const& other) noexcept;
+
+	[[nodiscard]] bool is_opaque() const& noexcept;
+	[[nodiscard]] bool is_gray() const& noexcept;
+
+	/// Whether every sample survives a round trip through 8 bits.
+	[[nodiscard]] bool fits_8_bits() const& noexcept;
+
+	/// Smallest of 1, 2, 4, 8 and 16 bits that holds every gray (red) sample.
+	[[nodiscard]] std::size_t gray_bit_depth() const& noexcept;
+
+	/// Whether there are more than `max_palette_size` distinct colors.
+	[[nodiscard]] bool is_palette_overflowed() const& noexcept;
+
+	/// Distinct colors, translucent ones first, unless there are more than `max_palette_size` of them.
+	[[nodiscard]] std::vector<Color> colors() const&;
+};
+
+/// Index of every color of a palette.
+class Palette
+{
+	static constexpr std::size_t table_size = 4 * max_palette_size;
+
+	// Open-addressing map, zero marking empty slots.
+	std::array<Color, table_size> colors{};
+	std::array<std::uint8_t, table_size> indices{};
+	std::uint8_t zero_index = 0;
+
+public:
+	explicit Palette(std::vector<Color> const& entries) noexcept;
+
+	/// Index of a color of the palette.
+	[[nodiscard]] std::uint8_t index(Color const color) const& noexcept;
+};
+
+/// Store a row of 16-bit RGBA as indices into given palette, packed from the most significant bit.
+extern void pack_indices(
+	std::uint16_t const* const rgba,
+	std::size_t const width,
+	Palette const& palette,
+	std::size_t const bit_depth,
+	std::uint8_t* const row
+) noexcept;
+
+struct Representation
+{
+	/// 1 - grayscale, 2 - grayscale with alpha, 3 - RGB, 4 - RGBA, ignored when indexed.
+	std::size_t channels;
+	std::size_t bit_depth;
+
+	bool is_indexed;
+};
+
+/// Smallest lossless representation of analysed pixels, judged by the size of raw rows and of the palette.
+[[nodiscard]] extern Representation choose(Analysis const& analysis, std::size_t const width, std::size_t const height);
+}
+
+#endif
@@ -1,174 +1,1403 @@
 #include "png.hh"
+#include "convert.hh"
+#include "optimize.hh"
 #include "../io.hh"
+#include "../parallel.hh"
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <string_view>
+#include <zlib.h>
 
 
 namespace image::png
 {
+namespace
+{
+// Every libpng and zlib allocation of a codec goes through the pool,
+// so that contexts created over and over on a thread reuse the blocks of their predecessors.
+[[nodiscard]] png_voidp allocate(png_struct*, png_alloc_size_t const size) noexcept
+{
+	return memory::Pool::allocate(size);
+}
+
+void deallocate(png_struct*, png_voidp const ptr) noexcept
+{
+	memory::Pool::deallocate(ptr);
+}
+
+// Color type of every number of channels, less one.
+constexpr ColorType color_types[]{ColorType::GS, ColorType::GSA, ColorType::RGB, ColorType::RGBA};
+
+// APNG dispose and blend operations of a frame.
+constexpr std::uint8_t dispose_none = 0;
+constexpr std::uint8_t dispose_background = 1;
+constexpr std::uint8_t dispose_previous = 2;
+
+constexpr std::uint8_t blend_source = 0;
+constexpr std::uint8_t blend_over = 1;
+
+constexpr std::size_t animation_control_size = 8;
+constexpr std::size_t frame_control_size = 26;
+
+[[nodiscard]] std::uint32_t load_big_endian(std::uint8_t const* const data) noexcept
+{
+	std::uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return memory::to_big_endian(value);
+}
+
+[[nodiscard]] std::uint16_t load_big_endian_16(std::uint8_t const* const data) noexcept
+{
+	return static_cast<std::uint16_t>(data[0] << 8 | data[1]);
+}
+
+void store_big_endian(std::uint8_t* const data, std::uint32_t const value) noexcept
+{
+	std::uint32_t const stored = memory::to_big_endian(value);
+	std::memcpy(data, &stored, sizeof(stored));
+}
+
+/// Write a chunk whose data is `head` followed by `tail`.
+void write_chunk(std::ostream& os, char const* const type, std::string_view const head, std::string_view const tail = {})
+{
+	// Zlib takes a null buffer as a request for the initial value, so empty parts are skipped.
+	uLong crc = crc32(0, reinterpret_cast<Bytef const*>(type), 4);
+	for (std::string_view const part : {head, tail})
+	{
+		if (!part.empty())
+		{
+			crc = crc32(crc, reinterpret_cast<Bytef const*>(part.data()), part.size());
+		}
+	}
+
+	io::write(os, memory::to_big_endian(static_cast<std::uint32_t>(head.size() + tail.size())));
+	os.write(type, 4);
+	os.write(head.data(), head.size());
+	os.write(tail.data(), tail.size());
+	io::write(os, memory::to_big_endian(static_cast<std::uint32_t>(crc)));
+}
+
+struct ChunkView
+{
+	std::string_view type;
+	std::string_view data;
+
+	// Length, type, data and CRC.
+	std::string_view whole;
+};
+
+/// Chunks of a well-formed png stream, as written by libpng.
+[[nodiscard]] std::vector<ChunkView> split_chunks(std::vector<char> const& stream)
+{
+	std::vector<ChunkView> chunks;
+
+	for (std::size_t offset = sizeof(signature); offset + 12 <= stream.size();)
+	{
+		std::size_t const length = load_big_endian(reinterpret_cast<std::uint8_t const*>(&stream[offset]));
+		char const* const chunk = &stream[offset];
+
+		chunks.push_back({{chunk + 4, 4}, {chunk + 8, length}, {chunk, length + 12}});
+		offset += length + 12;
+	}
+
+	return chunks;
+}
+
+// Image data deflated here is written in chunks of this size.
+constexpr std::size_t image_data_chunk_size = 1 << 16;
+
+// Whether rows are filtered is decided on runs of this many rows, one every period.
+constexpr std::size_t sample_rows = 16;
+constexpr std::size_t sample_period = 128;
+
+/// A zlib stream, its output handed over to a sink a buffer at a time.
+class Deflater
+{
+public:
+	explicit Deflater(int const level, int const strategy) : output(image_data_chunk_size)
+	{
+		stream.zalloc = [] (voidpf, uInt const count, uInt const size) -> voidpf
+		{
+			return memory::Pool::allocate(std::size_t{count} * size);
+		};
+		stream.zfree = [] (voidpf, voidpf const ptr)
+		{
+			memory::Pool::deallocate(ptr);
+		};
+
+		if (deflateInit2(&stream, level, Z_DEFLATED, 15, 8, strategy) != Z_OK)
+		{
+			throw std::runtime_error("could not create deflate stream");
+		}
+	}
+
+	Deflater(Deflater const&) = delete;
+	Deflater& operator=(Deflater const&) = delete;
+
+	~Deflater()
+	{
+		deflateEnd(&stream);
+	}
+
+	/// Compress bytes, handing over the buffer whenever it fills up, and whatever is left in it on Z_FINISH.
+	template <typename Sink>
+	void write(std::uint8_t const* const data, std::size_t const size, int const flush, Sink&& sink) &
+	{
+		stream.next_in = const_cast<Bytef*>(data);
+		stream.avail_in = static_cast<uInt>(size);
+
+		for (;;)
+		{
+			stream.next_out = output.data() + used;
+			stream.avail_out = static_cast<uInt>(output.size() - used);
+
+			int const result = deflate(&stream, flush);
+			if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+			{
+				throw std::runtime_error("could not deflate image data");
+			}
+
+			used = output.size() - stream.avail_out;
+
+			bool const is_done = flush == Z_FINISH ? result == Z_STREAM_END : !stream.avail_in && stream.avail_out;
+
+			if (used == output.size() || (is_done && flush == Z_FINISH && used))
+			{
+				sink(output.data(), used);
+				used = 0;
+			}
+
+			if (is_done)
+			{
+				return;
+			}
+		}
+	}
+
+private:
+	z_stream stream{};
+	std::vector<std::uint8_t> output;
+	std::size_t used = 0;
+};
+
+/// Filter a row, or not, and deflate it along with its filter byte.
+template <typename Sink>
+void deflate_row(
+	Deflater& deflater,
+	std::vector<std::uint8_t*> const& rows,
+	std::size_t const y,
+	std::size_t const row_size,
+	std::size_t const pixel_size,
+	bool const is_filtered,
+	std::vector<std::uint8_t>& line,
+	Sink&& sink
+)
+{
+	if (!is_filtered)
+	{
+		std::uint8_t const none = static_cast<std::uint8_t>(filter::Type::None);
+		deflater.write(&none, 1, Z_NO_FLUSH, sink);
+		deflater.write(rows[y], row_size, Z_NO_FLUSH, sink);
+		return;
+	}
+
+	line[0] = static_cast<std::uint8_t>(filter::select(rows[y], y ? rows[y - 1] : nullptr, row_size, pixel_size, &line[1]));
+	deflater.write(line.data(), line.size(), Z_NO_FLUSH, sink);
+}
+
+/// Write the IDAT chunks of a non-interlaced image, filtered and deflated here rather than by libpng.
+///
+/// Flat images, such as screenshots and diagrams, deflate better unfiltered than with any choice of filters,
+/// so sampled runs of rows are quickly deflated both ways first, and the smaller way is taken for the whole image.
+void write_image_data(
+	std::ostream& os,
+	std::vector<std::uint8_t*> const& rows,
+	std::size_t const row_size,
+	std::size_t const pixel_size,
+	bool const is_filterable
+)
+{
+	std::vector<std::uint8_t> line(row_size + 1);
+
+	bool is_filtered = is_filterable;
+
+	if (is_filterable)
+	{
+		std::size_t sizes[2]{};
+
+		for (bool const is_sample_filtered : {false, true})
+		{
+			Deflater sample(1, is_sample_filtered ? Z_FILTERED : Z_DEFAULT_STRATEGY);
+
+			auto const count = [&size = sizes[is_sample_filtered]] (std::uint8_t const*, std::size_t const written)
+			{
+				size += written;
+			};
+
+			for (std::size_t y = 0; y < rows.size(); y += sample_period)
+			{
+				for (std::size_t i = y; i < std::min(rows.size(), y + sample_rows); i++)
+				{
+					deflate_row(sample, rows, i, row_size, pixel_size, is_sample_filtered, line, count);
+				}
+			}
+
+			sample.write(nullptr, 0, Z_FINISH, count);
+		}
+
+		is_filtered = sizes[true] < sizes[false];
+	}
+
+	auto const write = [&os] (std::uint8_t const* const data, std::size_t const size)
+	{
+		write_chunk(os, "IDAT", {reinterpret_cast<char const*>(data), size});
+	};
+
+	Deflater deflater(Z_DEFAULT_COMPRESSION, is_filtered ? Z_FILTERED : Z_DEFAULT_STRATEGY);
+
+	for (std::size_t y = 0; y < rows.size(); y++)
+	{
+		deflate_row(deflater, rows, y, row_size, pixel_size, is_filtered, line, write);
+	}
+
+	deflater.write(nullptr, 0, Z_FINISH, write);
+}
+
+/// APNG chunks gathered by libpng as it reads a stream.
+struct AnimationReader
+{
+	Animation animation;
+	bool is_malformed = false;
+};
+
+[[nodiscard]] int read_animation_chunk(png_struct* const cache, png_unknown_chunkp const chunk) noexcept
+{
+	AnimationReader& reader = *static_cast<AnimationReader*>(png_get_user_chunk_ptr(cache));
+	Animation& animation = reader.animation;
+
+	std::string_view const type(reinterpret_cast<char const*>(chunk->name), 4);
+	std::uint8_t const* const data = chunk->data;
+
+	try
+	{
+		if (type == "acTL")
+		{
+			if (chunk->size != animation_control_size)
+			{
+				reader.is_malformed = true;
+				return 1;
+			}
+
+			animation.is_animated = true;
+			animation.plays = load_big_endian(data + 4);
+		}
+		else
+		if (type == "fcTL")
+		{
+			if (chunk->size != frame_control_size)
+			{
+				reader.is_malformed = true;
+				return 1;
+			}
+
+			animation.controls.push_back({
+				load_big_endian(data + 4),
+				load_big_endian(data + 8),
+				load_big_endian(data + 12),
+				load_big_endian(data + 16),
+				{load_big_endian_16(data + 20), load_big_endian_16(data + 22)},
+				data[24],
+				data[25],
+			});
+			animation.streams.emplace_back();
+		}
+		else
+		if (type == "fdAT")
+		{
+			if (chunk->size < 4 || animation.streams.empty())
+			{
+				reader.is_malformed = true;
+				return 1;
+			}
+
+			animation.streams.back().insert(animation.streams.back().end(), data + 4, data + chunk->size);
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	catch (std::bad_alloc const&)
+	{
+		return -1;
+	}
+
+	return 1;
+}
+
+/// Blend a straight-alpha RGBA pixel over another, with samples of `sample_size` bytes.
+void blend_over_pixel(std::uint8_t* const target, std::uint8_t const* const source, std::size_t const sample_size) noexcept
+{
+	auto const load = [sample_size] (std::uint8_t const* const sample) -> std::uint64_t
+	{
+		return sample_size == 1 ? sample[0] : load_big_endian_16(sample);
+	};
+
+	auto const store = [sample_size] (std::uint8_t* const sample, std::uint64_t const value)
+	{
+		if (sample_size == 1)
+		{
+			sample[0] = value;
+			return;
+		}
+
+		sample[0] = value >> 8;
+		sample[1] = value;
+	};
+
+	std::uint64_t const max = sample_size == 1 ? 0xFF : 0xFFFF;
+
+	std::uint64_t const source_alpha = load(source + 3 * sample_size);
+	if (source_alpha == max)
+	{
+		std::memcpy(target, source, 4 * sample_size);
+		return;
+	}
+
+	if (!source_alpha)
+	{
+		return;
+	}
+
+	std::uint64_t const target_weight = load(target + 3 * sample_size) * (max - source_alpha);
+	std::uint64_t const source_weight = source_alpha * max;
+	std::uint64_t const total_weight = source_weight + target_weight;
+
+	for (std::size_t channel = 0; channel < 3; channel++)
+	{
+		std::size_t const offset = channel * sample_size;
+		store(
+			target + offset,
+			(load(source + offset) * source_weight + load(target + offset) * target_weight + total_weight / 2) / total_weight
+		);
+	}
+
+	store(target + 3 * sample_size, (total_weight + max / 2) / max);
+}
+
+struct ReadCache
+{
+	png_struct* cache = nullptr;
+	png_info* info = nullptr;
+	png_info* info_end = nullptr;
+
+	~ReadCache()
+	{
+		png_destroy_read_struct(&cache, &info, &info_end);
+	}
+};
+}
+
+[[nodiscard]] Info probe(std::istream& is, bool const with_chunks)
+{
+	std::uint64_t header;
+	io::read_endian(is, header, arch::Endian::Big);
+
+	if (!is || header != signature)
+	{
+		throw std::runtime_error("invalid png signature");
+	}
+
+	Info info{};
+
+	for (bool has_header = false;;)
+	{
+		Chunk chunk;
+		io::read_endian(is, chunk.length, arch::Endian::Big);
+		is.read(chunk.type.data(), chunk.type.size());
+
+		if (!is)
+		{
+			throw std::runtime_error("unexpected end of stream");
+		}
+
+		std::string_view const type(chunk.type.data(), chunk.type.size());
+
+		if (!has_header && (type != "IHDR" || chunk.length != 13))
+		{
+			throw std::runtime_error("missing png header");
+		}
+
+		if (type == "IDAT" && !with_chunks)
+		{
+			break;
+		}
+
+		if (with_chunks)
+		{
+			info.chunks.push_back(chunk);
+		}
+
+		std::uint32_t data_left = chunk.length;
+
+		if (type == "IHDR")
+		{
+			Metadata& metadata = info.metadata;
+			io::read_endian(is, metadata.width, arch::Endian::Big);
+			io::read_endian(is, metadata.height, arch::Endian::Big);
+			io::read(is, metadata.bit_depth);
+			io::read(is, metadata.color_type);
+			io::read(is, metadata.compression_method);
+			io::read(is, metadata.filter_method);
+			io::read(is, metadata.interlace_method);
+
+			data_left = 0;
+			has_header = true;
+		}
+		else
+		if (type == "PLTE")
+		{
+			info.palette_size = chunk.length / 3;
+		}
+		else
+		if (type == "IEND")
+		{
+			break;
+		}
+
+		// Chunk data is never inflated, only skipped along with its CRC.
+		if (!is.seekg(data_left + 4, std::ios::cur))
+		{
+			throw std::runtime_error("unexpected end of stream");
+		}
+
+		if (type == "PLTE" && !with_chunks)
+		{
+			break;
+		}
+	}
+
+	return info;
+}
+
 PNG::PNG(std::istream& is)
 {
-	open(is);
+	open(is);
+}
+
+void PNG::open(std::istream& is) &
+{
+	frames.clear();
+	delays.clear();
+	plays = 0;
+
+	std::uint64_t header;
+	io::read_endian(is, header, arch::Endian::Big);
+
+	if (header != signature)
+	{
+		throw std::runtime_error("invalid png signature");
+	}
+
+	ReadCache read;
+
+	read.cache = png_create_read_struct_2(
+		PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr, nullptr, &allocate, &deallocate
+	);
+	if (!read.cache)
+	{
+		throw std::runtime_error("could not create read cache");
+	}
+
+	png_struct* const read_cache = read.cache;
+
+	png_info* const read_info = read.info = png_create_info_struct(read_cache);
+	if (!read_info)
+	{
+		throw std::runtime_error("could not create read info");
+	}
+
+	read.info_end = png_create_info_struct(read_cache);
+	if (!read.info_end)
+	{
+		throw std::runtime_error("could not finish creating read info");
+	}
+
+	// Objects with destructors live outside of the region libpng may jump out of.
+	AnimationReader reader;
+
+	if (setjmp(png_jmpbuf(read_cache)))
+	{
+		throw std::runtime_error("error while reading");
+	}
+
+	png_set_sig_bytes(read_cache, sizeof(header));
+
+	png_set_read_fn(
+		read_cache,
+		&is,
+		[] (png_struct* cache, std::uint8_t* data, std::size_t size)
+		{
+			if (!reinterpret_cast<std::istream*>(png_get_io_ptr(cache))->read(reinterpret_cast<char*>(data), size))
+			{
+				png_error(cache, "unexpected end of stream");
+			}
+		}
+	);
+
+	// APNG chunks are unknown to libpng, which hands them over whole.
+	png_set_read_user_chunk_fn(read_cache, &reader, &read_animation_chunk);
+
+	png_read_info(read_cache, read_info);
+
+	// Frame data may well exceed libpng's default limit on chunks, but not the image data of the whole image
+	// stored uncompressed, frames being no larger than the image. Interlacing adds a filter byte and a partial byte
+	// to every row of a pass, and there are fewer than twice as many of those as rows of the image.
+	std::size_t const image_data_size =
+		png_get_image_height(read_cache, read_info) * (png_get_rowbytes(read_cache, read_info) + 5) + 16;
+
+	png_set_chunk_malloc_max(
+		read_cache, std::max<png_alloc_size_t>(png_get_chunk_malloc_max(read_cache), compressBound(image_data_size) + 4)
+	);
+
+	// Only a frame control before the image data makes the default image the first frame.
+	reader.animation.has_default_frame = !reader.animation.controls.empty();
+
+	metadata.width = png_get_image_width(read_cache, read_info);
+	metadata.height = png_get_image_height(read_cache, read_info);
+
+	metadata.color_type = static_cast<ColorType>(png_get_color_type(read_cache, read_info));
+
+	palette.clear();
+	if (metadata.color_type == ColorType::Indexed)
+	{
+		png_color* entries;
+		int number_of_entries;
+		if (!png_get_PLTE(read_cache, read_info, &entries, &number_of_entries) || !number_of_entries)
+		{
+			throw std::runtime_error("could not read palette");
+		}
+
+		// The read cache owns the entries, and it does not outlive this call.
+		palette.assign(entries, entries + number_of_entries);
+	}
+
+	palette_alpha.clear();
+	if (metadata.color_type == ColorType::Indexed && png_get_valid(read_cache, read_info, PNG_INFO_tRNS))
+	{
+		png_byte* alpha;
+		int number_of_alpha;
+		png_get_tRNS(read_cache, read_info, &alpha, &number_of_alpha, nullptr);
+
+		palette_alpha.assign(alpha, alpha + std::min<std::size_t>(number_of_alpha, palette.size()));
+	}
+
+	metadata.bit_depth = png_get_bit_depth(read_cache, read_info);
+
+	layout();
+
+	metadata.compression_method = png_get_compression_type(read_cache, read_info);
+	metadata.filter_method = png_get_filter_type(read_cache, read_info);
+	metadata.interlace_method = png_get_interlace_type(read_cache, read_info);
+
+	number_of_passes = png_set_interlace_handling(read_cache);
+
+	png_read_update_info(read_cache, read_info);
+
+	std::size_t const row_size = png_get_rowbytes(read_cache, read_info);
+
+	// Pixel access may load a whole color::Value past the last pixel of a row.
+	pixels.resize(row_size * metadata.height + sizeof(color::Value));
+	index_rows(row_size);
+
+	png_read_image(read_cache, rows.data());
+	png_read_end(read_cache, read_info);
+
+	if (reader.is_malformed)
+	{
+		throw std::runtime_error("malformed apng chunk");
+	}
+
+	if (reader.animation.is_animated && !reader.animation.controls.empty())
+	{
+		animate(reader.animation);
+	}
+}
+
+void PNG::layout() & noexcept
+{
+	switch (metadata.color_type)
+	{
+	case ColorType::Indexed:
+	case ColorType::GS:
+		number_of_channels = 1;
+		break;
+	case ColorType::GSA:
+		number_of_channels = 2;
+		break;
+	case ColorType::RGB:
+		number_of_channels = 3;
+		break;
+	case ColorType::RGBA:
+		number_of_channels = 4;
+		break;
+	}
+
+	bit_depth = metadata.bit_depth;
+
+	std::size_t const pixel_bits = number_of_channels * bit_depth;
+
+	pixel_mask = pixel_bits < 64 ? (static_cast<color::Value>(1) << pixel_bits) - 1 : ~color::Value{};
+	pixel_stride = (pixel_bits + 7) / 8;
+	pixels_per_byte = 8 / pixel_bits;
+}
+
+void PNG::index_rows(std::size_t const row_size) &
+{
+	rows.resize(metadata.height);
+	for (std::size_t i = 0; i < metadata.height; i++)
+	{
+		rows[i] = &pixels[i * row_size];
+	}
+}
+
+[[nodiscard]] std::vector<std::uint16_t> PNG::expand_palette() const&
+{
+	std::vector<std::uint16_t> palette_rgba;
+	palette_rgba.reserve(palette.size() * 4);
+
+	for (std::size_t i = 0; i < palette.size(); i++)
+	{
+		png_color const& entry = palette[i];
+		palette_rgba.insert(palette_rgba.end(), {
+			static_cast<std::uint16_t>(entry.red * 257),
+			static_cast<std::uint16_t>(entry.green * 257),
+			static_cast<std::uint16_t>(entry.blue * 257),
+			static_cast<std::uint16_t>(i < palette_alpha.size() ? palette_alpha[i] * 257 : 0xFFFF),
+		});
+	}
+
+	return palette_rgba;
+}
+
+void PNG::animate(Animation const& animation) &
+{
+	std::vector<FrameControl> const& controls = animation.controls;
+	std::size_t const count = controls.size();
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		FrameControl const& control = controls[i];
+
+		bool const is_default = !i && animation.has_default_frame;
+		bool const is_inside =
+			control.width && control.height
+			&& control.x_offset <= metadata.width && control.width <= metadata.width - control.x_offset
+			&& control.y_offset <= metadata.height && control.height <= metadata.height - control.y_offset;
+
+		if (!is_inside || (is_default && (control.width != metadata.width || control.height != metadata.height)))
+		{
+			throw std::runtime_error("apng frame out of bounds");
+		}
+
+		if (!is_default && animation.streams[i].empty())
+		{
+			throw std::runtime_error("missing apng frame data");
+		}
+	}
+
+	// Samples of the canvas keep the precision of the source.
+	std::size_t const sample_size = metadata.bit_depth == 16 ? 2 : 1;
+	std::size_t const pixel_size = 4 * sample_size;
+
+	// Every frame is a png stream of its own, sharing the header and palette of the image,
+	// so that frames are inflated and unfiltered on separate threads.
+	std::vector<PNG> regions(count);
+
+	parallel::for_bands(
+		count,
+		parallel::concurrency(),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			std::vector<char> stream;
+
+			for (std::size_t i = begin; i < end; i++)
+			{
+				if (!i && animation.has_default_frame)
+				{
+					continue;
+				}
+
+				FrameControl const& control = controls[i];
+				std::vector<std::uint8_t> const& data = animation.streams[i];
+
+				stream.clear();
+				io::VectorBuffer output_buffer(stream);
+				std::ostream os(&output_buffer);
+
+				io::write(os, memory::to_big_endian(signature));
+
+				std::uint8_t header[13];
+				store_big_endian(header, control.width);
+				store_big_endian(header + 4, control.height);
+				header[8] = metadata.bit_depth;
+				header[9] = metadata.color_type;
+				header[10] = metadata.compression_method;
+				header[11] = metadata.filter_method;
+				header[12] = metadata.interlace_method;
+				write_chunk(os, "IHDR", {reinterpret_cast<char const*>(header), sizeof(header)});
+
+				if (metadata.color_type == ColorType::Indexed)
+				{
+					write_chunk(os, "PLTE", {reinterpret_cast<char const*>(palette.data()), palette.size() * sizeof(png_color)});
+
+					if (!palette_alpha.empty())
+					{
+						write_chunk(os, "tRNS", {reinterpret_cast<char const*>(palette_alpha.data()), palette_alpha.size()});
+					}
+				}
+
+				write_chunk(os, "IDAT", {reinterpret_cast<char const*>(data.data()), data.size()});
+				write_chunk(os, "IEND", {});
+
+				io::MemoryBuffer input_buffer(stream.data(), stream.size());
+				std::istream is(&input_buffer);
+
+				PNG& region = regions[i];
+				region.set_scratch_directory(scratch_directory);
+				region.open(is);
+				region.convert(4, sample_size * 8);
+			}
+		}
+	);
+
+	if (animation.has_default_frame)
+	{
+		convert(4, sample_size * 8);
+	}
+
+	std::size_t const canvas_row_size = metadata.width * pixel_size;
+
+	// Pixels outside of every frame so far are transparent black.
+	std::vector<std::uint8_t> canvas(canvas_row_size * metadata.height);
+	std::vector<std::uint8_t> previous;
+
+	std::vector<PNG> composited(count);
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		FrameControl const& control = controls[i];
+		PNG const& region = !i && animation.has_default_frame ? *this : regions[i];
+
+		std::size_t const region_row_size = control.width * pixel_size;
+		std::uint8_t* const origin = &canvas[control.y_offset * canvas_row_size + control.x_offset * pixel_size];
+
+		// Disposal to the previous state of the first frame clears it, as there is none.
+		std::uint8_t const dispose_op = !i && control.dispose_op == dispose_previous ? dispose_background : control.dispose_op;
+
+		if (dispose_op == dispose_previous)
+		{
+			previous.resize(region_row_size * control.height);
+			for (std::size_t y = 0; y < control.height; y++)
+			{
+				std::memcpy(&previous[y * region_row_size], origin + y * canvas_row_size, region_row_size);
+			}
+		}
+
+		for (std::size_t y = 0; y < control.height; y++)
+		{
+			std::uint8_t* const target = origin + y * canvas_row_size;
+			std::uint8_t const* const source = region.rows[y];
+
+			if (control.blend_op != blend_over)
+			{
+				std::memcpy(target, source, region_row_size);
+				continue;
+			}
+
+			for (std::size_t x = 0; x < region_row_size; x += pixel_size)
+			{
+				blend_over_pixel(target + x, source + x, sample_size);
+			}
+		}
+
+		PNG& frame = composited[i];
+		frame.set_scratch_directory(scratch_directory);
+		frame.row_filter = row_filter;
+		frame.metadata = {
+			metadata.width,
+			metadata.height,
+			static_cast<std::uint8_t>(sample_size * 8),
+			ColorType::RGBA,
+			metadata.compression_method,
+			metadata.filter_method,
+			PNG_INTERLACE_NONE,
+		};
+		frame.layout();
+		frame.pixels.resize(canvas.size() + sizeof(color::Value));
+		frame.index_rows(canvas_row_size);
+		std::memcpy(&frame.pixels[0], canvas.data(), canvas.size());
+
+		if (dispose_op == dispose_background)
+		{
+			for (std::size_t y = 0; y < control.height; y++)
+			{
+				std::memset(origin + y * canvas_row_size, 0, region_row_size);
+			}
+		}
+		else
+		if (dispose_op == dispose_previous)
+		{
+			for (std::size_t y = 0; y < control.height; y++)
+			{
+				std::memcpy(origin + y * canvas_row_size, &previous[y * region_row_size], region_row_size);
+			}
+		}
+	}
+
+	*this = std::move(composited.front());
+
+	frames.assign(std::make_move_iterator(composited.begin() + 1), std::make_move_iterator(composited.end()));
+
+	delays.resize(count);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		delays[i] = controls[i].delay;
+	}
+
+	plays = animation.plays;
+}
+
+[[nodiscard]] std::size_t PNG::color_depth() const& noexcept
+{
+	if (metadata.color_type == ColorType::Indexed)
+	{
+		return palette.size();
+	}
+
+	// Every value of a 64-bit pixel is valid, though the largest one is not representable here.
+	return pixel_mask == ~color::Value{} ? pixel_mask : pixel_mask + 1;
 }
 
-void PNG::open(std::istream& is) &
+[[nodiscard]] std::uint8_t* PNG::row(std::size_t const y) const& noexcept
 {
-	is.seekg(0);
+	return rows[y];
+}
 
-	std::uint64_t header;
-	io::read_endian(is, header, arch::Endian::Big);
+[[nodiscard]] std::size_t PNG::frame_count() const& noexcept
+{
+	return frames.size() + 1;
+}
 
-	if (header != signature)
-	{
-		throw std::runtime_error("invalid png signature");
-	}
+[[nodiscard]] Image& PNG::frame(std::size_t const i) & noexcept
+{
+	return i ? static_cast<Image&>(frames[i - 1]) : *this;
+}
+
+void PNG::assign(Image const& source) &
+{
+	std::size_t const channels = source.channels();
+	std::size_t const bit_depth = source.depth();
 
-	read_cache = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-	if (!read_cache)
+	if (!convert::is_valid({channels, bit_depth}))
 	{
-		throw std::runtime_error("could not create read cache");
+		throw std::runtime_error("unsupported color type and bit depth combination");
 	}
 
-	read_info = png_create_info_struct(read_cache);
-	if (!read_info)
+	metadata = {
+		static_cast<std::uint32_t>(source.width()),
+		static_cast<std::uint32_t>(source.height()),
+		static_cast<std::uint8_t>(bit_depth),
+		color_types[channels - 1],
+		PNG_COMPRESSION_TYPE_DEFAULT,
+		PNG_FILTER_TYPE_DEFAULT,
+		PNG_INTERLACE_NONE,
+	};
+
+	palette.clear();
+	palette_alpha.clear();
+
+	frames.clear();
+	delays.clear();
+	plays = 0;
+
+	layout();
+
+	std::size_t const row_size = (metadata.width * channels * bit_depth + 7) / 8;
+
+	pixels.resize(row_size * metadata.height + sizeof(color::Value));
+	index_rows(row_size);
+
+	for (std::size_t y = 0; y < metadata.height; y++)
 	{
-		throw std::runtime_error("could not create read info");
+		std::memcpy(rows[y], source.row(y), row_size);
 	}
+}
+
+void PNG::convert(std::size_t const channels, std::size_t const bit_depth) &
+{
+	convert::Layout const source{number_of_channels, this->bit_depth};
+	convert::Layout const target{channels, bit_depth};
 
-	read_info_end = png_create_info_struct(read_cache);
-	if (!read_info_end)
+	if (!convert::is_valid(target))
 	{
-		throw std::runtime_error("could not finish creating read info");
+		throw std::runtime_error("unsupported color type and bit depth combination");
 	}
 
-	if (setjmp(png_jmpbuf(read_cache)))
+	ColorType const color_type = color_types[channels - 1];
+	if (color_type == metadata.color_type && bit_depth == this->bit_depth)
 	{
-		throw std::runtime_error("error while reading");
+		return;
 	}
 
-	png_set_sig_bytes(read_cache, sizeof(header));
+	std::vector<std::uint16_t> const palette_rgba = expand_palette();
 
-	png_set_read_fn(
-		read_cache,
-		&is,
-		[] (png_struct* cache, std::uint8_t* data, std::size_t size)
+	bool const is_indexed = metadata.color_type == ColorType::Indexed;
+
+	std::size_t const source_row_size = (metadata.width * source.channels * source.bit_depth + 7) / 8;
+	std::size_t const row_size = (metadata.width * channels * bit_depth + 7) / 8;
+
+	storage::Block converted(scratch_directory);
+	converted.resize(row_size * metadata.height + sizeof(color::Value));
+
+	parallel::for_bands(
+		metadata.height,
+		parallel::concurrency_for(std::max(source_row_size, row_size) * metadata.height),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
 		{
-			reinterpret_cast<std::istream*>(png_get_io_ptr(cache))->read(reinterpret_cast<char*>(data), size);
+			std::vector<std::uint16_t> rgba(std::size_t{metadata.width} * 4);
+
+			for (std::size_t y = begin; y < end; y++)
+			{
+				convert::unpack(
+					rows[y],
+					source,
+					metadata.width,
+					rgba.data(),
+					is_indexed ? palette_rgba.data() : nullptr,
+					palette.size()
+				);
+
+				convert::pack(rgba.data(), metadata.width, target, &converted[y * row_size]);
+			}
 		}
 	);
 
-	png_read_info(read_cache, read_info);
+	pixels.swap(converted);
+	index_rows(row_size);
 
-	metadata.width = png_get_image_width(read_cache, read_info);
-	metadata.height = png_get_image_height(read_cache, read_info);
+	palette.clear();
+	palette_alpha.clear();
 
-	metadata.color_type = static_cast<ColorType>(png_get_color_type(read_cache, read_info));
-	switch (metadata.color_type)
+	metadata.color_type = color_type;
+	metadata.bit_depth = bit_depth;
+
+	layout();
+}
+
+void PNG::expand() &
+{
+	if (metadata.color_type == ColorType::Indexed)
 	{
-	case ColorType::Indexed:
-		if (!png_get_PLTE(read_cache, read_info, &palette, &palette_size) || !palette_size)
+		convert(palette_alpha.empty() ? 3 : 4, 8);
+	}
+	else
+	if (bit_depth < 8)
+	{
+		convert(number_of_channels, 8);
+	}
+}
+
+void PNG::transform(transform::Operation const operation) &
+{
+	std::size_t const width = metadata.width;
+	std::size_t const height = metadata.height;
+
+	bool const swaps = transform::swaps_dimensions(operation);
+	std::size_t const target_width = swaps ? height : width;
+	std::size_t const target_height = swaps ? width : height;
+
+	std::uint8_t* const* source = rows.data();
+	std::size_t pixel_size = pixel_stride;
+
+	// Sub-byte pixels are spread to a byte each for the operation, then packed again.
+	bool const is_packed = pixels_per_byte > 1;
+
+	storage::Block spread(scratch_directory);
+	std::vector<std::uint8_t*> spread_rows;
+
+	if (is_packed)
+	{
+		spread.resize(width * height);
+		spread_rows.resize(height);
+
+		for (std::size_t y = 0; y < height; y++)
 		{
-			throw std::runtime_error("could not read palette");
+			spread_rows[y] = &spread[y * width];
+			for (std::size_t x = 0; x < width; x++)
+			{
+				std::size_t const offset = 8 - bit_depth * (x % pixels_per_byte + 1);
+				spread_rows[y][x] = (rows[y][x / pixels_per_byte] >> offset) & pixel_mask;
+			}
 		}
-	case ColorType::GS:
-		number_of_channels = 1;
-		break;
-	case ColorType::GSA:
-		number_of_channels = 2;
-		break;
-	case ColorType::RGB:
-		number_of_channels = 3;
-		break;
-	case ColorType::RGBA:
-		number_of_channels = 4;
-		break;
+
+		source = spread_rows.data();
+		pixel_size = 1;
 	}
 
-	bit_depth = png_get_bit_depth(read_cache, read_info);
+	storage::Block transposed(scratch_directory);
+	std::vector<std::uint8_t*> transposed_rows;
 
-	pixel_mask = (static_cast<color::Value>(1) << (number_of_channels * bit_depth)) - 1;
-	pixel_stride = (number_of_channels * bit_depth + 7) / 8;
-	pixels_per_byte = 8 / (bit_depth * number_of_channels);
+	std::uint8_t* const* target = source;
 
-	metadata.compression_method = png_get_compression_type(read_cache, read_info);
-	metadata.filter_method = png_get_filter_type(read_cache, read_info);
-	metadata.interlace_method = png_get_interlace_type(read_cache, read_info);
+	if (swaps)
+	{
+		transposed.resize(target_width * target_height * pixel_size + sizeof(color::Value));
+		transposed_rows.resize(target_height);
 
-	number_of_passes = png_set_interlace_handling(read_cache);
+		for (std::size_t y = 0; y < target_height; y++)
+		{
+			transposed_rows[y] = &transposed[y * target_width * pixel_size];
+		}
 
-	png_read_update_info(read_cache, read_info);
+		target = transposed_rows.data();
+	}
 
-	rows = std::make_unique<std::uint8_t*[]>(metadata.height);
-	for (std::size_t i = 0; i < metadata.height; i++)
+	transform::apply(operation, source, width, height, pixel_size, target);
+
+	if (!is_packed && !swaps)
 	{
-		rows.get()[i] = new std::uint8_t[png_get_rowbytes(read_cache, read_info)];
+		return;
 	}
 
-	png_read_image(read_cache, rows.get());
-	png_read_end(read_cache, read_info);
+	metadata.width = target_width;
+	metadata.height = target_height;
+
+	std::size_t const row_size = (target_width * bit_depth * number_of_channels + 7) / 8;
+
+	if (!is_packed)
+	{
+		pixels.swap(transposed);
+		index_rows(row_size);
+		return;
+	}
+
+	pixels.reset(row_size * target_height + sizeof(color::Value));
+	index_rows(row_size);
+
+	for (std::size_t y = 0; y < target_height; y++)
+	{
+		for (std::size_t x = 0; x < target_width; x++)
+		{
+			std::size_t const offset = 8 - bit_depth * (x % pixels_per_byte + 1);
+			rows[y][x / pixels_per_byte] |= target[y][x] << offset;
+		}
+	}
 }
 
-PNG::~PNG()
+[[nodiscard]] optimize::Analysis PNG::analyse() const&
 {
-	for (std::size_t i = 0; i < metadata.height; i++)
+	std::vector<std::uint16_t> const palette_rgba = expand_palette();
+	bool const is_indexed = metadata.color_type == ColorType::Indexed;
+
+	convert::Layout const source{number_of_channels, bit_depth};
+	std::size_t const source_row_size = (metadata.width * source.channels * source.bit_depth + 7) / 8;
+
+	std::vector<optimize::Analysis> analyses(parallel::concurrency_for(source_row_size * metadata.height));
+
+	std::size_t const number_of_bands = parallel::for_bands(
+		metadata.height,
+		analyses.size(),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t const band)
+		{
+			std::vector<std::uint16_t> rgba(std::size_t{metadata.width} * 4);
+
+			for (std::size_t y = begin; y < end; y++)
+			{
+				convert::unpack(
+					rows[y],
+					source,
+					metadata.width,
+					rgba.data(),
+					is_indexed ? palette_rgba.data() : nullptr,
+					palette.size()
+				);
+				analyses[band].accumulate(rgba.data(), metadata.width);
+			}
+		}
+	);
+
+	optimize::Analysis& analysis = analyses.front();
+	for (std::size_t i = 1; i < number_of_bands; i++)
 	{
-		delete[] rows.get()[i];
+		analysis.merge(analyses[i]);
 	}
 
-	png_destroy_read_struct(&read_cache, &read_info, &read_info_end);
+	return analysis;
 }
 
-[[nodiscard]] std::size_t PNG::color_depth() const& noexcept
+void PNG::represent(optimize::Representation const& target, std::vector<optimize::Color> const& colors) &
 {
-	if (metadata.color_type == ColorType::Indexed)
+	if (!target.is_indexed)
+	{
+		convert(target.channels, target.bit_depth);
+		return;
+	}
+
+	std::vector<std::uint16_t> const palette_rgba = expand_palette();
+	bool const is_indexed = metadata.color_type == ColorType::Indexed;
+
+	convert::Layout const source{number_of_channels, bit_depth};
+	std::size_t const source_row_size = (metadata.width * source.channels * source.bit_depth + 7) / 8;
+
+	optimize::Palette const lookup(colors);
+
+	std::size_t const row_size = (metadata.width * target.bit_depth + 7) / 8;
+	storage::Block indexed(scratch_directory);
+	indexed.resize(row_size * metadata.height + sizeof(color::Value));
+
+	parallel::for_bands(
+		metadata.height,
+		parallel::concurrency_for(source_row_size * metadata.height),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			std::vector<std::uint16_t> rgba(std::size_t{metadata.width} * 4);
+
+			for (std::size_t y = begin; y < end; y++)
+			{
+				convert::unpack(
+					rows[y],
+					source,
+					metadata.width,
+					rgba.data(),
+					is_indexed ? palette_rgba.data() : nullptr,
+					palette.size()
+				);
+				optimize::pack_indices(rgba.data(), metadata.width, lookup, target.bit_depth, &indexed[y * row_size]);
+			}
+		}
+	);
+
+	pixels.swap(indexed);
+	index_rows(row_size);
+
+	// Every sample fits in 8 bits, so the high byte of each is exact.
+	palette.resize(colors.size());
+	palette_alpha.clear();
+	for (std::size_t i = 0; i < colors.size(); i++)
 	{
-		return palette_size;
+		optimize::Color const color = colors[i];
+		palette[i] = {
+			static_cast<png_byte>(color >> 56),
+			static_cast<png_byte>(color >> 40),
+			static_cast<png_byte>(color >> 24),
+		};
+
+		// Translucent entries come first.
+		if (static_cast<png_byte>(color >> 8) != 0xFF)
+		{
+			palette_alpha.push_back(color >> 8);
+		}
 	}
 
-	return static_cast<std::size_t>(1) << (bit_depth * number_of_channels);
+	metadata.color_type = ColorType::Indexed;
+	metadata.bit_depth = target.bit_depth;
+
+	layout();
 }
 
-[[nodiscard]] std::size_t PNG::width() const& noexcept
+void PNG::optimize() &
 {
-	return metadata.width;
+	std::size_t const count = frame_count();
+
+	// Frames of an animation share their header and palette, so they are analysed as one image.
+	std::vector<optimize::Analysis> analyses(count);
+
+	parallel::for_bands(
+		count,
+		parallel::concurrency(),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			for (std::size_t i = begin; i < end; i++)
+			{
+				analyses[i] = (i ? frames[i - 1] : *this).analyse();
+			}
+		}
+	);
+
+	optimize::Analysis& analysis = analyses.front();
+	for (std::size_t i = 1; i < count; i++)
+	{
+		analysis.merge(analyses[i]);
+	}
+
+	optimize::Representation const target = optimize::choose(analysis, metadata.width, metadata.height * count);
+	std::vector<optimize::Color> const colors = target.is_indexed ? analysis.colors() : std::vector<optimize::Color>{};
+
+	parallel::for_bands(
+		count,
+		parallel::concurrency(),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			for (std::size_t i = begin; i < end; i++)
+			{
+				(i ? frames[i - 1] : *this).represent(target, colors);
+			}
+		}
+	);
 }
 
-[[nodiscard]] std::size_t PNG::height() const& noexcept
+void PNG::set_scratch_directory(char const* const directory) &
 {
-	return metadata.height;
+	scratch_directory = directory;
+
+	metadata = Metadata{};
+	pixels = storage::Block(directory);
+	rows.clear();
+
+	frames.clear();
+	delays.clear();
+	plays = 0;
 }
 
-[[nodiscard]] color::Value PNG::get(math::Vector const& position) const& noexcept
+void PNG::set_row_filter(filter::Strategy const strategy) & noexcept
 {
-	if (pixels_per_byte > 1)
+	row_filter = strategy;
+
+	for (PNG& frame : frames)
 	{
-		return rows.get()[position.y][position.x / pixels_per_byte] & (pixel_mask << ((position.x % pixels_per_byte) * pixel_stride));
+		frame.row_filter = strategy;
 	}
-
-	return
-		memory::to_big_endian(
-			*reinterpret_cast<color::Value*>(&rows.get()[position.y][position.x * pixel_stride]), pixel_stride
-		) & pixel_mask;
 }
 
-void PNG::set(math::Vector const& position, color::Value const value) const& noexcept
+void PNG::save(std::ostream& os) const&
 {
-	if (pixels_per_byte > 1)
+	if (frames.empty())
 	{
-		std::size_t const offset = (position.x % pixels_per_byte) * pixel_stride;
-		std::uint8_t& byte = rows.get()[position.y][position.x / pixels_per_byte];
-		byte = (byte & ~(pixel_mask << offset)) | ((value & pixel_mask) << offset);
-
+		encode(os);
 		return;
 	}
 
-	color::Value& bytes = *reinterpret_cast<color::Value*>(&rows.get()[position.y][position.x * pixel_stride]);
-	bytes = (bytes & ~pixel_mask) | (memory::to_big_endian(value, number_of_channels) & pixel_mask);
+	for (PNG const& frame : frames)
+	{
+		bool const is_alike =
+			frame.metadata.width == metadata.width
+			&& frame.metadata.height == metadata.height
+			&& frame.metadata.color_type == metadata.color_type
+			&& frame.metadata.bit_depth == metadata.bit_depth
+			&& frame.palette.size() == palette.size()
+			&& frame.palette_alpha == palette_alpha
+			&& std::equal(
+				palette.begin(),
+				palette.end(),
+				frame.palette.begin(),
+				[] (png_color const& a, png_color const& b)
+				{
+					return a.red == b.red && a.green == b.green && a.blue == b.blue;
+				}
+			);
+
+		if (!is_alike)
+		{
+			throw std::runtime_error("frames of an animation differ in size, color type or palette");
+		}
+	}
+
+	std::size_t const count = frame_count();
+
+	// Every frame is filtered and deflated on its own thread, as a png stream whose image data becomes that of the frame.
+	std::vector<std::vector<char>> streams(count);
+
+	parallel::for_bands(
+		count,
+		parallel::concurrency(),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			for (std::size_t i = begin; i < end; i++)
+			{
+				io::VectorBuffer buffer(streams[i]);
+				std::ostream stream(&buffer);
+				(i ? frames[i - 1] : *this).encode(stream);
+			}
+		}
+	);
+
+	// Sequence numbers run through frame controls and frame data alike.
+	std::uint32_t sequence = 0;
+
+	auto const write_frame_control = [&] (std::size_t const i)
+	{
+		Delay const delay = i < delays.size() ? delays[i] : Delay{};
+
+		std::uint8_t control[frame_control_size]{};
+		store_big_endian(control, sequence++);
+		store_big_endian(control + 4, metadata.width);
+		store_big_endian(control + 8, metadata.height);
+		control[20] = delay.numerator >> 8;
+		control[21] = delay.numerator;
+		control[22] = delay.denominator >> 8;
+		control[23] = delay.denominator;
+		control[24] = dispose_none;
+		control[25] = blend_source;
+
+		write_chunk(os, "fcTL", {reinterpret_cast<char const*>(control), sizeof(control)});
+	};
+
+	io::write(os, memory::to_big_endian(signature));
+
+	for (ChunkView const& chunk : split_chunks(streams.front()))
+	{
+		if (chunk.type == "IEND")
+		{
+			break;
+		}
+
+		if (chunk.type == "IDAT" && !sequence)
+		{
+			write_frame_control(0);
+		}
+
+		os.write(chunk.whole.data(), chunk.whole.size());
+
+		if (chunk.type == "IHDR")
+		{
+			std::uint8_t control[animation_control_size];
+			store_big_endian(control, count);
+			store_big_endian(control + 4, plays);
+
+			write_chunk(os, "acTL", {reinterpret_cast<char const*>(control), sizeof(control)});
+		}
+	}
+
+	for (std::size_t i = 1; i < count; i++)
+	{
+		write_frame_control(i);
+
+		for (ChunkView const& chunk : split_chunks(streams[i]))
+		{
+			if (chunk.type != "IDAT")
+			{
+				continue;
+			}
+
+			std::uint8_t number[4];
+			store_big_endian(number, sequence++);
+
+			write_chunk(os, "fdAT", {reinterpret_cast<char const*>(number), sizeof(number)}, chunk.data);
+		}
+	}
+
+	write_chunk(os, "IEND", {});
+	os.flush();
 }
 
-void PNG::save(std::ostream& os) const&
+void PNG::encode(std::ostream& os) const&
 {
-	png_struct* write_cache = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	png_struct* write_cache = png_create_write_struct_2(
+		PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr, nullptr, &allocate, &deallocate
+	);
 	if (!write_cache)
 	{
 		throw std::runtime_error("could not create write cache");
@@ -213,11 +1442,71 @@ void PNG::save(std::ostream& os) const&
 
 	if (metadata.color_type == ColorType::Indexed)
 	{
-		png_set_PLTE(write_cache, write_info, palette, 1 << bit_depth);
+		png_set_PLTE(write_cache, write_info, palette.data(), palette.size());
+
+		if (!palette_alpha.empty())
+		{
+			png_set_tRNS(
+				write_cache,
+				write_info,
+				const_cast<png_byte*>(palette_alpha.data()),
+				palette_alpha.size(),
+				nullptr
+			);
+		}
+	}
+
+	// As the PNG specification recommends, palette and sub-byte images are not filtered.
+	bool const is_filterable = metadata.color_type != ColorType::Indexed && bit_depth >= 8;
+
+	switch (row_filter)
+	{
+	case filter::Strategy::Default:
+		break;
+
+	case filter::Strategy::Adaptive:
+		// Only interlaced images are left to libpng, whose passes are filtered by its own heuristic.
+		png_set_filter(write_cache, 0, is_filterable ? PNG_ALL_FILTERS : PNG_FILTER_NONE);
+		break;
+
+	case filter::Strategy::None:
+		png_set_filter(write_cache, 0, PNG_FILTER_NONE);
+		break;
+
+	case filter::Strategy::Sub:
+		png_set_filter(write_cache, 0, PNG_FILTER_SUB);
+		break;
+
+	case filter::Strategy::Up:
+		png_set_filter(write_cache, 0, PNG_FILTER_UP);
+		break;
+
+	case filter::Strategy::Average:
+		png_set_filter(write_cache, 0, PNG_FILTER_AVG);
+		break;
+
+	case filter::Strategy::Paeth:
+		png_set_filter(write_cache, 0, PNG_FILTER_PAETH);
+		break;
 	}
 
 	png_write_info(write_cache, write_info);
-	png_write_image(write_cache, rows.get());
+
+	if (row_filter == filter::Strategy::Adaptive && metadata.interlace_method == PNG_INTERLACE_NONE)
+	{
+		std::size_t const row_size = png_get_rowbytes(write_cache, write_info);
+
+		// Libpng takes no image data deflated elsewhere, so it is done with once the header is written.
+		png_destroy_write_struct(&write_cache, &write_info);
+
+		write_image_data(os, rows, row_size, pixel_stride, is_filterable);
+		write_chunk(os, "IEND", {});
+		os.flush();
+		return;
+	}
+
+	png_write_image(write_cache, const_cast<std::uint8_t**>(rows.data()));
+
 	png_write_end(write_cache, nullptr);
 
 	png_destroy_write_struct(&write_cache, &write_info);
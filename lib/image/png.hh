@@ -2,8 +2,14 @@
 #define PNGR_IMAGE_PNG_H_
 
 #include "image.hh"
+#include "filter.hh"
+#include "optimize.hh"
+#include "../memory.hh"
+#include "../storage.hh"
 
+#include <array>
 #include <memory>
+#include <vector>
 #include <png.h>
 
 
@@ -25,6 +31,7 @@ struct Metadata
 	std::uint32_t width;
 	std::uint32_t height;
 
+	std::uint8_t bit_depth;
 	ColorType color_type;
 
 	std::uint8_t compression_method;
@@ -32,18 +39,76 @@ struct Metadata
 	std::uint8_t interlace_method;
 };
 
-class PNG : public Image
+struct Chunk
+{
+	std::array<char, 4> type;
+	std::uint32_t length;
+};
+
+struct Info
 {
 	Metadata metadata{};
 
-	std::unique_ptr<std::uint8_t*[]> rows;
+	std::size_t palette_size;
+
+	std::vector<Chunk> chunks;
+};
+
+/// How long a frame of an animation is shown: `numerator / denominator` seconds, a zero denominator meaning 100.
+struct Delay
+{
+	std::uint16_t numerator = 0;
+	std::uint16_t denominator = 0;
+};
+
+/// Frame of an APNG stream, as described by its fcTL chunk.
+struct FrameControl
+{
+	std::uint32_t width;
+	std::uint32_t height;
+	std::uint32_t x_offset;
+	std::uint32_t y_offset;
+
+	Delay delay;
+
+	std::uint8_t dispose_op;
+	std::uint8_t blend_op;
+};
 
-	png_struct* read_cache;
-	png_info* read_info;
-	png_info* read_info_end;
+/// Frames of an APNG stream before they are decoded: acTL, fcTL and fdAT chunks.
+struct Animation
+{
+	bool is_animated = false;
+	std::uint32_t plays = 0;
 
-	png_color* palette;
-	int palette_size;
+	std::vector<FrameControl> controls;
+	// Zlib stream of every frame, sequence numbers stripped, empty for the default image.
+	std::vector<std::vector<std::uint8_t>> streams;
+
+	// Whether the default image is the first frame, rather than a fallback for decoders without APNG support.
+	bool has_default_frame = false;
+};
+
+/// Read the signature and the header chunks of a png stream without decoding its image data.
+///
+/// Stops right before the first IDAT chunk, unless `with_chunks` is set,
+/// in which case every chunk header up to IEND is walked (chunk data is skipped, not inflated).
+[[nodiscard]] extern Info probe(std::istream& is, bool const with_chunks = false);
+
+class PNG final : public Image
+{
+	Metadata metadata{};
+
+	// Rows live in one block, that keeps its capacity when the image is reopened.
+	storage::Block pixels;
+	std::vector<std::uint8_t*> rows;
+
+	// Where pixel blocks are memory-mapped, if anywhere.
+	char const* scratch_directory = nullptr;
+
+	std::vector<png_color> palette;
+	// Alpha of the leading palette entries, the rest being opaque.
+	std::vector<png_byte> palette_alpha;
 
 	std::size_t number_of_passes;
 
@@ -51,12 +116,39 @@ class PNG : public Image
 	std::size_t pixel_stride;
 	std::size_t pixels_per_byte;
 
+	filter::Strategy row_filter = filter::Strategy::Adaptive;
+
+	// Frames of an animation past the first one, which is the image itself, every one covering the whole canvas.
+	std::vector<PNG> frames;
+	std::vector<Delay> delays;
+	// How many times the animation plays, 0 meaning forever.
+	std::uint32_t plays = 0;
+
+	/// Derive channel count and pixel addressing from the metadata.
+	void layout() & noexcept;
+
+	/// Point rows into the pixel block.
+	void index_rows(std::size_t const row_size) &;
+
+	/// Palette entries as four 16-bit RGBA samples each.
+	[[nodiscard]] std::vector<std::uint16_t> expand_palette() const&;
+
+	/// Decode the frames of an animation and composite each onto the canvas, the image becoming the first one.
+	void animate(Animation const& animation) &;
+
+	/// Gather what `optimize` needs to know of the pixels.
+	[[nodiscard]] optimize::Analysis analyse() const&;
+
+	/// Store the pixels as given representation, `colors` being the palette when indexed.
+	void represent(optimize::Representation const& target, std::vector<optimize::Color> const& colors) &;
+
+	/// Write a single image.
+	void encode(std::ostream& os) const&;
+
 public:
 	explicit PNG() noexcept = default;
 	explicit PNG(std::istream& is);
 
-	~PNG();
-
 	void open(std::istream& is) & override;
 
 	[[nodiscard]] std::size_t color_depth() const& noexcept override;
@@ -67,8 +159,81 @@ public:
 	[[nodiscard]] color::Value get(math::Vector const& position) const& noexcept override;
 	void set(math::Vector const& position, color::Value const value) const& noexcept override;
 
+	[[nodiscard]] std::uint8_t* row(std::size_t const y) const& noexcept override;
+
+	/// Whether pixels are palette indices, transparency of the palette being kept apart from them.
+	[[nodiscard]] bool is_indexed() const& noexcept;
+
+	void convert(std::size_t const channels, std::size_t const bit_depth) & override;
+	void expand() & override;
+	void transform(transform::Operation const operation) & override;
+
+	[[nodiscard]] std::size_t frame_count() const& noexcept override;
+	[[nodiscard]] Image& frame(std::size_t const i) & noexcept override;
+
+	/// Copy the pixels of another image, whose rows must be laid out as those of a png without a palette.
+	void assign(Image const& source) &;
+
+	/// Switch to the smallest lossless color type and bit depth for the current pixels,
+	/// which may be a palette with transparency, common to every frame of an animation.
+	void optimize() &;
+
+	/// Keep pixels in files memory-mapped in given directory (none - on the heap), dropping the current ones.
+	void set_scratch_directory(char const* const directory) &;
+
+	/// Set how `save` chooses the filter of every row.
+	void set_row_filter(filter::Strategy const strategy) & noexcept;
+
+	/// Write the image, as an APNG stream when it has several frames, each encoded on its own thread.
 	void save(std::ostream& os) const& override;
 };
+
+// Pixel access is defined here, so that calls on a PNG, which no class derives from, are inlined.
+
+[[nodiscard]] inline std::size_t PNG::width() const& noexcept
+{
+	return metadata.width;
+}
+
+[[nodiscard]] inline std::size_t PNG::height() const& noexcept
+{
+	return metadata.height;
+}
+
+[[nodiscard]] inline bool PNG::is_indexed() const& noexcept
+{
+	return metadata.color_type == ColorType::Indexed;
+}
+
+[[nodiscard]] inline color::Value PNG::get(math::Vector const& position) const& noexcept
+{
+	if (pixels_per_byte > 1)
+	{
+		// Pixels are packed from the most significant bit.
+		std::size_t const offset = 8 - bit_depth * (position.x % pixels_per_byte + 1);
+		return (rows[position.y][position.x / pixels_per_byte] >> offset) & pixel_mask;
+	}
+
+	return
+		memory::to_big_endian(
+			*reinterpret_cast<color::Value*>(&rows[position.y][position.x * pixel_stride]), pixel_stride
+		) & pixel_mask;
+}
+
+inline void PNG::set(math::Vector const& position, color::Value const value) const& noexcept
+{
+	if (pixels_per_byte > 1)
+	{
+		std::size_t const offset = 8 - bit_depth * (position.x % pixels_per_byte + 1);
+		std::uint8_t& byte = rows[position.y][position.x / pixels_per_byte];
+		byte = (byte & ~(pixel_mask << offset)) | ((value & pixel_mask) << offset);
+
+		return;
+	}
+
+	color::Value& bytes = *reinterpret_cast<color::Value*>(&rows[position.y][position.x * pixel_stride]);
+	bytes = (bytes & ~pixel_mask) | (memory::to_big_endian(value, pixel_stride) & pixel_mask);
+}
 }
 
 #endif
@@ -0,0 +1,377 @@
+#include "pnm.hh"
+#include "../io.hh"
+#include "../parallel.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+
+
+namespace image::pnm
+{
+namespace
+{
+constexpr std::uint32_t max_dimension = 0x7FFFFFFF;
+
+// Largest image decoded, as for QOI, so that sizes of its samples never overflow.
+constexpr std::uint64_t max_pixels = 400'000'000;
+
+// Samples of a stream are read into a block that starts this large and doubles as they keep coming.
+constexpr std::size_t initial_read_size = static_cast<std::size_t>(1) << 20;
+
+[[noreturn]] void malformed()
+{
+	throw std::runtime_error("malformed netpbm header");
+}
+
+/// Read a decimal number of a PGM or PPM header, skipping whitespace and comments before it.
+[[nodiscard]] std::uint32_t read_number(std::istream& is)
+{
+	int ch = is.get();
+	while (std::isspace(ch) || ch == '#')
+	{
+		if (ch == '#')
+		{
+			while (ch != '\n' && ch != std::char_traits<char>::eof())
+			{
+				ch = is.get();
+			}
+		}
+
+		ch = is.get();
+	}
+
+	if (!std::isdigit(ch))
+	{
+		malformed();
+	}
+
+	std::uint64_t number = 0;
+	for (; std::isdigit(ch); ch = is.get())
+	{
+		number = number * 10 + (ch - '0');
+		if (number > max_dimension)
+		{
+			malformed();
+		}
+	}
+
+	// A single whitespace character ends a number, the last one of the header being right before the samples.
+	if (!std::isspace(ch))
+	{
+		malformed();
+	}
+
+	return number;
+}
+
+/// Read the `KEY value` lines of a PAM header up to ENDHDR.
+void read_pam_header(std::istream& is, Header& header)
+{
+	std::uint64_t fields[4]{};
+	constexpr std::string_view keys[]{"WIDTH", "HEIGHT", "DEPTH", "MAXVAL"};
+
+	for (std::string line; std::getline(is, line);)
+	{
+		std::size_t const begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string::npos || line[begin] == '#')
+		{
+			continue;
+		}
+
+		std::size_t const end = line.find_first_of(" \t\r", begin);
+		std::string_view const key = std::string_view(line).substr(begin, end - begin);
+
+		if (key == "ENDHDR")
+		{
+			header.width = fields[0];
+			header.height = fields[1];
+			header.channels = fields[2];
+			header.maxval = std::min<std::uint64_t>(fields[3], max_maxval + 1);
+			return;
+		}
+
+		auto const it = std::find(std::begin(keys), std::end(keys), key);
+		if (it == std::end(keys))
+		{
+			// TUPLTYPE only names what the channels mean, which their count tells already.
+			continue;
+		}
+
+		std::size_t const value_begin = end == std::string::npos ? end : line.find_first_not_of(" \t\r", end);
+		if (value_begin == std::string::npos || !std::isdigit(static_cast<unsigned char>(line[value_begin])))
+		{
+			malformed();
+		}
+
+		std::uint64_t value = 0;
+		for (std::size_t i = value_begin; i < line.size() && std::isdigit(static_cast<unsigned char>(line[i])); i++)
+		{
+			value = std::min<std::uint64_t>(value * 10 + (line[i] - '0'), std::uint64_t{max_dimension} + 1);
+		}
+
+		fields[it - std::begin(keys)] = value;
+	}
+
+	malformed();
+}
+
+/// Read up to `size` bytes into a block grown as they come, so that a header claiming more samples than follow it
+/// costs no more memory than those that do. Returns the number of bytes read.
+[[nodiscard]] std::size_t read_samples(std::istream& is, storage::Block& block, std::size_t const size)
+{
+	std::size_t count = 0;
+
+	while (count < size && is)
+	{
+		block.resize(std::min(size, std::max(initial_read_size, 2 * count)));
+
+		is.read(reinterpret_cast<char*>(block.data() + count), block.size() - count);
+		count += is.gcount();
+	}
+
+	return count;
+}
+
+/// Header of an image as written: PGM or PPM without alpha, PAM with it.
+[[nodiscard]] std::string header_of(Image const& img)
+{
+	std::size_t const channels = img.channels();
+	std::size_t const depth = img.depth();
+
+	if ((depth != 8 && depth != 16) || channels < 1 || channels > 4)
+	{
+		throw std::runtime_error("netpbm samples are 8 or 16 bits");
+	}
+
+	std::string const maxval = depth == 8 ? "255" : "65535";
+	std::string const width = std::to_string(img.width());
+	std::string const height = std::to_string(img.height());
+
+	if (channels == 1 || channels == 3)
+	{
+		return std::string(channels == 1 ? "P5" : "P6") + '\n' + width + ' ' + height + '\n' + maxval + '\n';
+	}
+
+	return
+		"P7\nWIDTH " + width
+		+ "\nHEIGHT " + height
+		+ "\nDEPTH " + std::to_string(channels)
+		+ "\nMAXVAL " + maxval
+		+ "\nTUPLTYPE " + (channels == 2 ? "GRAYSCALE_ALPHA" : "RGB_ALPHA")
+		+ "\nENDHDR\n";
+}
+}
+
+[[nodiscard]] bool has_extension(std::string_view const path) noexcept
+{
+	return std::any_of(
+		std::begin(extensions),
+		std::end(extensions),
+		[path] (std::string_view const extension)
+		{
+			return path.size() >= extension.size()
+				&& std::equal(
+					extension.begin(),
+					extension.end(),
+					path.end() - extension.size(),
+					[] (char const a, char const b) { return a == std::tolower(static_cast<unsigned char>(b)); }
+				);
+		}
+	);
+}
+
+[[nodiscard]] Header read_header(std::istream& is)
+{
+	char magic[2];
+	if (!is.read(magic, sizeof(magic)) || magic[0] != 'P' || magic[1] < '5' || magic[1] > '7')
+	{
+		throw std::runtime_error("invalid netpbm signature (binary pgm, ppm or pam expected)");
+	}
+
+	Header header{};
+
+	if (magic[1] == '7')
+	{
+		read_pam_header(is, header);
+	}
+	else
+	{
+		header.width = read_number(is);
+		header.height = read_number(is);
+		header.maxval = std::min<std::uint32_t>(read_number(is), max_maxval + 1);
+		header.channels = magic[1] == '5' ? 1 : 3;
+	}
+
+	if (
+		!header.width
+		|| !header.height
+		|| header.width > max_dimension
+		|| header.height > max_dimension
+		|| std::uint64_t{header.width} * header.height > max_pixels
+		|| header.channels < 1
+		|| header.channels > 4
+		|| !header.maxval
+		|| header.maxval > max_maxval
+	)
+	{
+		malformed();
+	}
+
+	return header;
+}
+
+void PNM::load(Header const& header, std::uint8_t const* const data, std::size_t const size) &
+{
+	std::size_t const sample_size = bit_depth / 8;
+	std::size_t const samples = header.width * header.height * header.channels;
+
+	if (size / sample_size < samples)
+	{
+		throw std::runtime_error("truncated netpbm data");
+	}
+
+	allocate();
+
+	std::uint32_t const maxval = header.maxval;
+	std::uint32_t const target_max = sample_size == 1 ? 0xFF : 0xFFFF;
+
+	if (maxval == target_max)
+	{
+		std::memcpy(pixels.data(), data, samples * sample_size);
+		return;
+	}
+
+	// Samples are scaled to the full range of their depth, those above the maximum value being clamped.
+	for (std::size_t i = 0; i < samples; i++)
+	{
+		std::uint32_t const sample = sample_size == 1 ? data[i] : data[2 * i] << 8 | data[2 * i + 1];
+		std::uint32_t const scaled = (std::min(sample, maxval) * target_max + maxval / 2) / maxval;
+
+		if (sample_size == 1)
+		{
+			pixels[i] = scaled;
+		}
+		else
+		{
+			pixels[2 * i] = scaled >> 8;
+			pixels[2 * i + 1] = scaled;
+		}
+	}
+}
+
+void PNM::release() & noexcept
+{
+	mapping = storage::Mapping();
+}
+
+void PNM::open(std::istream& is) &
+{
+	Header const header = read_header(is);
+	layout(header.width, header.height, header.channels, header.maxval > 0xFF ? 16 : 8);
+
+	std::size_t const size = header.width * header.height * pixel_stride;
+
+	if (header.maxval == 0xFF || header.maxval == 0xFFFF)
+	{
+		if (read_samples(is, pixels, size) < size)
+		{
+			throw std::runtime_error("truncated netpbm data");
+		}
+
+		allocate();
+		return;
+	}
+
+	storage::Block data;
+	std::size_t const count = read_samples(is, data, size);
+
+	load(header, data.data(), count);
+}
+
+void PNM::map(char const* const path) &
+{
+	storage::Mapping file = storage::Mapping::open(path);
+
+	io::MemoryBuffer buffer(reinterpret_cast<char const*>(file.data()), file.size());
+	std::istream is(&buffer);
+
+	Header const header = read_header(is);
+	layout(header.width, header.height, header.channels, header.maxval > 0xFF ? 16 : 8);
+
+	std::size_t const offset = is.tellg();
+	std::size_t const size = file.size() - offset;
+	std::size_t const row_size = header.width * pixel_stride;
+
+	static std::size_t const page_size = sysconf(_SC_PAGESIZE);
+
+	// Bytes of the last page past the end of the file can be read and written too.
+	std::size_t const slack = size / row_size >= header.height
+		? size - row_size * header.height + (page_size - file.size() % page_size) % page_size
+		: 0;
+
+	if ((header.maxval != 0xFF && header.maxval != 0xFFFF) || slack < sizeof(color::Value))
+	{
+		load(header, file.data() + offset, size);
+		return;
+	}
+
+	mapping = std::move(file);
+	index_rows(mapping.data() + offset, row_size);
+}
+
+void PNM::save(std::ostream& os) const&
+{
+	write(*this, os);
+}
+
+void write(Image const& img, std::ostream& os)
+{
+	std::string const header = header_of(img);
+	os.write(header.data(), header.size());
+
+	std::size_t const row_size = img.width() * img.channels() * img.depth() / 8;
+	for (std::size_t y = 0; y < img.height(); y++)
+	{
+		os.write(reinterpret_cast<char const*>(img.row(y)), row_size);
+	}
+
+	os.flush();
+}
+
+void write(Image const& img, char const* const path)
+{
+	std::string const header = header_of(img);
+
+	std::size_t const row_size = img.width() * img.channels() * img.depth() / 8;
+	std::size_t const height = img.height();
+
+	// Rows may point into a mapping of the very file written, which is only replaced once the new one is complete.
+	storage::Output output(path);
+
+	{
+		storage::Mapping const mapping = storage::Mapping::create(output.descriptor(), header.size() + row_size * height);
+
+		std::uint8_t* const data = mapping.data() + header.size();
+		std::memcpy(mapping.data(), header.data(), header.size());
+
+		parallel::for_bands(
+			height,
+			parallel::concurrency_for(row_size * height),
+			[&] (std::size_t const begin, std::size_t const end, std::size_t)
+			{
+				for (std::size_t y = begin; y < end; y++)
+				{
+					std::memcpy(data + y * row_size, img.row(y), row_size);
+				}
+			}
+		);
+	}
+
+	output.commit();
+}
+}
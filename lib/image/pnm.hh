@@ -0,0 +1,70 @@
+#ifndef PNGR_IMAGE_PNM_H_
+#define PNGR_IMAGE_PNM_H_
+
+#include "raster.hh"
+#include "../storage.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+namespace image::pnm
+{
+/// Extensions of Netpbm files: graymaps, pixmaps, any of them, and arbitrary maps.
+constexpr std::string_view extensions[]{".pgm", ".ppm", ".pnm", ".pam"};
+
+/// Largest sample value the format allows.
+constexpr std::uint32_t max_maxval = 0xFFFF;
+
+struct Header
+{
+	std::size_t width;
+	std::size_t height;
+	std::size_t channels;
+	std::uint32_t maxval;
+};
+
+/// Binary Netpbm image: PGM (P5), PPM (P6) or PAM (P7) with one to four channels.
+///
+/// Samples of 8 or 16 bits are rows as they are, so that rows of a mapped file point straight into the mapping.
+/// Other maximum values are scaled to the nearest of these depths on reading.
+class PNM : public raster::Raster
+{
+	// Rows point into it while the samples of a mapped file are left as they are.
+	storage::Mapping mapping;
+
+	/// Take the samples that follow the header, as read or as mapped.
+	void load(Header const& header, std::uint8_t const* const data, std::size_t const size) &;
+
+	void release() & noexcept override;
+
+public:
+	explicit PNM() noexcept = default;
+
+	void open(std::istream& is) & override;
+
+	/// Map a file rather than read it.
+	void map(char const* const path) &;
+
+	void save(std::ostream& os) const& override;
+};
+
+/// Whether a path has a Netpbm extension.
+[[nodiscard]] extern bool has_extension(std::string_view const path) noexcept;
+
+/// Read the header of a binary Netpbm stream, leaving the stream at the first sample.
+///
+/// Throws std::runtime_error if it is malformed or claims more than 400 million pixels.
+[[nodiscard]] extern Header read_header(std::istream& is);
+
+/// Write an image of 8 or 16-bit samples without a palette: as PGM or PPM, or as PAM when it has alpha.
+extern void write(Image const& img, std::ostream& os);
+
+/// Write an image to a file created at its final size and mapped, so that rows are copied straight into it,
+/// then renamed over the path.
+extern void write(Image const& img, char const* const path);
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include "points.hh"
+#include "../memory.hh"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+
+
+namespace image::points
+{
+namespace
+{
+[[nodiscard]] bool is_separator(char const ch) noexcept
+{
+	return ch == ',' || ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+/// Mark the start of a new path at the next point, unless one starts there already.
+void split(std::vector<math::Vector> const& points, std::vector<std::size_t>& breaks)
+{
+	if (!points.empty() && (breaks.empty() || breaks.back() != points.size()))
+	{
+		breaks.push_back(points.size());
+	}
+}
+
+void parse_binary(std::string_view const data, std::vector<math::Vector>& points, std::vector<std::size_t>& breaks)
+{
+	constexpr std::size_t point_size = 2 * sizeof(std::int32_t);
+
+	if (data.size() % point_size)
+	{
+		throw std::runtime_error("malformed points file (size not a multiple of 8 bytes)");
+	}
+
+	points.reserve(data.size() / point_size);
+
+	for (std::size_t i = 0; i < data.size(); i += point_size)
+	{
+		std::int32_t coordinates[2];
+		std::memcpy(coordinates, data.data() + i, point_size);
+
+		std::int32_t const x = memory::to_little_endian(coordinates[0]);
+		std::int32_t const y = memory::to_little_endian(coordinates[1]);
+
+		if (x == binary_separator && y == binary_separator)
+		{
+			split(points, breaks);
+			continue;
+		}
+
+		points.emplace_back(x, y);
+	}
+}
+
+void parse_text(std::string_view const data, std::vector<math::Vector>& points, std::vector<std::size_t>& breaks)
+{
+	char const* it = data.data();
+	char const* const end = it + data.size();
+
+	std::int64_t coordinates[2];
+	std::size_t count = 0;
+
+	while (true)
+	{
+		std::size_t line_feeds = 0;
+		for (; it != end && is_separator(*it); it++)
+		{
+			line_feeds += *it == '\n';
+		}
+
+		if (it == end)
+		{
+			break;
+		}
+
+		// A blank line ends a path.
+		if (line_feeds > 1 && !count)
+		{
+			split(points, breaks);
+		}
+
+		auto const [next, error] = std::from_chars(it, end, coordinates[count]);
+		if (error != std::errc{} || (next != end && !is_separator(*next)))
+		{
+			throw std::runtime_error("malformed points file (integers expected)");
+		}
+
+		it = next;
+
+		if (++count == 2)
+		{
+			points.emplace_back(coordinates[0], coordinates[1]);
+			count = 0;
+		}
+	}
+
+	if (count)
+	{
+		throw std::runtime_error("malformed points file (odd number of coordinates)");
+	}
+}
+
+void parse(std::string const& path, std::vector<math::Vector>& points, std::vector<std::size_t>& breaks)
+{
+	std::ifstream is(path, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!is)
+	{
+		throw std::runtime_error("could not open points file for read");
+	}
+
+	std::string data(static_cast<std::size_t>(is.tellg()), '\0');
+	is.seekg(0);
+	if (!is.read(data.data(), data.size()))
+	{
+		throw std::runtime_error("could not read points file");
+	}
+
+	std::size_t const extension_length = std::strlen(binary_extension);
+	bool const is_binary = path.size() >= extension_length
+		&& path.compare(path.size() - extension_length, extension_length, binary_extension) == 0;
+
+	if (is_binary)
+	{
+		parse_binary(data, points, breaks);
+	}
+	else
+	{
+		parse_text(data, points, breaks);
+	}
+}
+}
+
+[[nodiscard]] std::vector<math::Vector> read(std::string const& path)
+{
+	std::vector<math::Vector> points;
+	std::vector<std::size_t> breaks;
+
+	parse(path, points, breaks);
+	return points;
+}
+
+[[nodiscard]] std::vector<std::vector<math::Vector>> read_paths(std::string const& path)
+{
+	std::vector<math::Vector> points;
+	std::vector<std::size_t> breaks;
+
+	parse(path, points, breaks);
+
+	// A separator after the last point starts no path.
+	if (!breaks.empty() && breaks.back() == points.size())
+	{
+		breaks.pop_back();
+	}
+
+	breaks.push_back(points.size());
+
+	std::vector<std::vector<math::Vector>> paths;
+
+	std::size_t begin = 0;
+	for (std::size_t const end : breaks)
+	{
+		if (end > begin)
+		{
+			paths.emplace_back(points.begin() + begin, points.begin() + end);
+		}
+
+		begin = end;
+	}
+
+	return paths;
+}
+}
@@ -0,0 +1,28 @@
+#ifndef PNGR_IMAGE_POINTS_H_
+#define PNGR_IMAGE_POINTS_H_
+
+#include "../math.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace image::points
+{
+/// Extension of files holding points as pairs of little-endian int32 (x, y).
+constexpr char const* binary_extension = ".bin";
+
+/// Pair of coordinates separating paths in binary files, as blank lines do in text files.
+constexpr std::int32_t binary_separator = INT32_MIN;
+
+/// Read the points of a binary file, or of a text file holding `x,y` (or `x y`) lines.
+///
+/// Throws std::runtime_error if the file cannot be read or is malformed.
+[[nodiscard]] extern std::vector<math::Vector> read(std::string const& path);
+
+/// Read points as `read` does, split into paths by separators.
+[[nodiscard]] extern std::vector<std::vector<math::Vector>> read_paths(std::string const& path);
+}
+
+#endif
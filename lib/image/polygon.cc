@@ -0,0 +1,355 @@
+#include "polygon.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+
+namespace image::polygon
+{
+namespace
+{
+constexpr double pi = 3.14159265358979323846;
+
+// Bounds of the number of sides of the polygons approximating round joins.
+constexpr std::size_t min_join_sides = 8;
+constexpr std::size_t max_join_sides = 256;
+
+struct Point
+{
+	double x;
+	double y;
+};
+
+/// Edge crossing the centers of rows [first_row, end_row), top to bottom.
+struct Edge
+{
+	double x_top;
+	double y_top;
+	double slope;
+
+	std::int64_t first_row;
+	std::int64_t end_row;
+
+	// Whether the edge goes down (1) or up (-1) the ring.
+	int winding;
+};
+
+struct ActiveEdge
+{
+	std::size_t edge;
+	double x;
+};
+
+[[nodiscard]] std::int64_t clamp_to(double const value, std::int64_t const min, std::int64_t const max) noexcept
+{
+	return static_cast<std::int64_t>(std::clamp(value, static_cast<double>(min), static_cast<double>(max)));
+}
+
+/// Append pixels [ceil(left), ceil(right)) of a row, whose centers lie in [left, right).
+void add_span(
+	std::int64_t const y,
+	double const left,
+	double const right,
+	std::int64_t const width,
+	std::vector<Span>& spans
+)
+{
+	std::int64_t const x_first = clamp_to(std::ceil(left), 0, width);
+	std::int64_t const x_last = clamp_to(std::ceil(right), 0, width) - 1;
+
+	if (x_first <= x_last)
+	{
+		spans.push_back(Span{y, x_first, x_last});
+	}
+}
+
+/// Append the edges of a closed ring that cross row centers within [0, height).
+void add_ring(std::vector<Point> const& ring, std::int64_t const height, std::vector<Edge>& edges)
+{
+	for (std::size_t i = 0; i < ring.size(); i++)
+	{
+		Point top = ring[i];
+		Point bottom = ring[(i + 1) % ring.size()];
+
+		// Horizontal edges cross no row center.
+		if (top.y == bottom.y)
+		{
+			continue;
+		}
+
+		int winding = 1;
+		if (top.y > bottom.y)
+		{
+			std::swap(top, bottom);
+			winding = -1;
+		}
+
+		std::int64_t const first_row = clamp_to(std::ceil(top.y), 0, height);
+		std::int64_t const end_row = clamp_to(std::ceil(bottom.y), 0, height);
+
+		if (first_row < end_row)
+		{
+			edges.push_back(Edge{top.x, top.y, (bottom.x - top.x) / (bottom.y - top.y), first_row, end_row, winding});
+		}
+	}
+}
+
+/// Append the spans inside edges, row by row, keeping the edges crossing a row sorted by abscissa.
+void scan(std::vector<Edge>& edges, FillRule const rule, std::int64_t const width, std::vector<Span>& spans)
+{
+	std::sort(edges.begin(), edges.end(), [] (Edge const& a, Edge const& b) { return a.first_row < b.first_row; });
+
+	std::vector<ActiveEdge> active;
+
+	std::size_t next = 0;
+	std::int64_t y = 0;
+
+	while (next < edges.size() || !active.empty())
+	{
+		// Rows crossing no edge are skipped at once.
+		if (active.empty())
+		{
+			y = std::max(y, edges[next].first_row);
+		}
+
+		active.erase(
+			std::remove_if(active.begin(), active.end(), [&edges, y] (ActiveEdge const& a) { return edges[a.edge].end_row <= y; }),
+			active.end()
+		);
+
+		for (; next < edges.size() && edges[next].first_row == y; next++)
+		{
+			active.push_back(ActiveEdge{next, 0});
+		}
+
+		for (ActiveEdge& a : active)
+		{
+			Edge const& edge = edges[a.edge];
+			a.x = edge.x_top + (y - edge.y_top) * edge.slope;
+		}
+
+		// Crossings move little from one row to the next, insertion sort is about linear.
+		for (std::size_t i = 1; i < active.size(); i++)
+		{
+			ActiveEdge const a = active[i];
+
+			std::size_t j = i;
+			for (; j > 0 && active[j - 1].x > a.x; j--)
+			{
+				active[j] = active[j - 1];
+			}
+
+			active[j] = a;
+		}
+
+		if (rule == FillRule::EvenOdd)
+		{
+			for (std::size_t i = 0; i + 1 < active.size(); i += 2)
+			{
+				add_span(y, active[i].x, active[i + 1].x, width, spans);
+			}
+		}
+		else
+		{
+			int winding = 0;
+			double left = 0;
+
+			for (ActiveEdge const& a : active)
+			{
+				int const previous = winding;
+				winding += edges[a.edge].winding;
+
+				if (!previous && winding)
+				{
+					left = a.x;
+				}
+				else
+				if (previous && !winding)
+				{
+					add_span(y, left, a.x, width, spans);
+				}
+			}
+		}
+
+		y++;
+	}
+}
+
+/// Append the spans of a one pixel wide segment: every row gets the pixels nearest to the part of the segment within it.
+void add_segment(
+	math::Vector a,
+	math::Vector b,
+	std::int64_t const width,
+	std::int64_t const height,
+	std::vector<Span>& spans
+)
+{
+	if (a.y > b.y)
+	{
+		std::swap(a, b);
+	}
+
+	std::int64_t const first_row = std::max<std::int64_t>(a.y, 0);
+	std::int64_t const last_row = std::min(b.y, height - 1);
+
+	double const slope = a.y != b.y ? static_cast<double>(b.x - a.x) / (b.y - a.y) : 0;
+
+	for (std::int64_t y = first_row; y <= last_row; y++)
+	{
+		double left = std::min(a.x, b.x);
+		double right = std::max(a.x, b.x);
+
+		if (a.y != b.y)
+		{
+			double const x_top = a.x + (std::max(y - 0.5, static_cast<double>(a.y)) - a.y) * slope;
+			double const x_bottom = a.x + (std::min(y + 0.5, static_cast<double>(b.y)) - a.y) * slope;
+
+			left = std::min(x_top, x_bottom);
+			right = std::max(x_top, x_bottom);
+		}
+
+		// Halves round toward the middle, so that a diagonal takes a single pixel per row.
+		double const x_first = std::floor(left + 0.5);
+		double const x_last = std::max(std::ceil(right - 0.5), x_first);
+
+		add_span(y, x_first, x_last + 1, width, spans);
+	}
+}
+
+/// Reverse a ring going clockwise on screen, so that the non-zero rule unites overlapping rings.
+void orient(std::vector<Point>& ring) noexcept
+{
+	double area = 0;
+	for (std::size_t i = 0; i < ring.size(); i++)
+	{
+		Point const& a = ring[i];
+		Point const& b = ring[(i + 1) % ring.size()];
+		area += a.x * b.y - b.x * a.y;
+	}
+
+	if (area < 0)
+	{
+		std::reverse(ring.begin(), ring.end());
+	}
+}
+}
+
+[[nodiscard]] std::vector<Span> fill(
+	std::vector<std::vector<math::Vector>> const& rings,
+	FillRule const rule,
+	std::size_t const width,
+	std::size_t const height
+)
+{
+	std::vector<Edge> edges;
+	std::vector<Point> ring;
+
+	for (std::vector<math::Vector> const& vertices : rings)
+	{
+		ring.clear();
+		for (math::Vector const& vertex : vertices)
+		{
+			ring.push_back(Point{static_cast<double>(vertex.x), static_cast<double>(vertex.y)});
+		}
+
+		add_ring(ring, height, edges);
+	}
+
+	std::vector<Span> spans;
+	scan(edges, rule, width, spans);
+
+	// The interior takes pixels whose centers are strictly inside on the right and bottom, the outline the rest.
+	for (std::vector<math::Vector> const& vertices : rings)
+	{
+		for (std::size_t i = 0; i < vertices.size(); i++)
+		{
+			add_segment(vertices[i], vertices[(i + 1) % vertices.size()], width, height, spans);
+		}
+	}
+
+	return spans;
+}
+
+[[nodiscard]] std::vector<Span> stroke(
+	std::vector<math::Vector> const& path,
+	std::size_t const thickness,
+	std::size_t const width,
+	std::size_t const height
+)
+{
+	std::vector<Span> spans;
+
+	if (path.empty())
+	{
+		return spans;
+	}
+
+	if (thickness <= 1)
+	{
+		for (std::size_t i = 0; i + 1 < path.size(); i++)
+		{
+			add_segment(path[i], path[i + 1], width, height, spans);
+		}
+
+		if (path.size() == 1)
+		{
+			add_segment(path.front(), path.front(), width, height, spans);
+		}
+
+		return spans;
+	}
+
+	// Rectangles along segments and discs around vertices, united by the non-zero rule.
+	double const radius = thickness / 2.0;
+	std::size_t const sides = std::clamp<std::size_t>(std::ceil(pi * radius), min_join_sides, max_join_sides);
+
+	std::vector<Edge> edges;
+	std::vector<Point> ring;
+
+	for (std::size_t i = 0; i < path.size(); i++)
+	{
+		Point const a{static_cast<double>(path[i].x), static_cast<double>(path[i].y)};
+
+		ring.clear();
+		for (std::size_t side = 0; side < sides; side++)
+		{
+			double const angle = 2 * pi * side / sides;
+			ring.push_back(Point{a.x + radius * std::cos(angle), a.y + radius * std::sin(angle)});
+		}
+
+		orient(ring);
+		add_ring(ring, height, edges);
+
+		if (i + 1 == path.size())
+		{
+			break;
+		}
+
+		Point const b{static_cast<double>(path[i + 1].x), static_cast<double>(path[i + 1].y)};
+
+		double const length = std::hypot(b.x - a.x, b.y - a.y);
+		if (length == 0)
+		{
+			continue;
+		}
+
+		// Normal to the segment, half the thickness long.
+		double const nx = -(b.y - a.y) / length * radius;
+		double const ny = (b.x - a.x) / length * radius;
+
+		ring.assign({
+			Point{a.x + nx, a.y + ny},
+			Point{b.x + nx, b.y + ny},
+			Point{b.x - nx, b.y - ny},
+			Point{a.x - nx, a.y - ny},
+		});
+
+		orient(ring);
+		add_ring(ring, height, edges);
+	}
+
+	scan(edges, FillRule::NonZero, width, spans);
+	return spans;
+}
+}
@@ -0,0 +1,49 @@
+#ifndef PNGR_IMAGE_POLYGON_H_
+#define PNGR_IMAGE_POLYGON_H_
+
+#include "../math.hh"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace image::polygon
+{
+enum class FillRule
+{
+	/// Inside if a ray crosses an odd number of edges: rings inside rings are holes.
+	EvenOdd,
+	/// Inside if edges wind around the point: rings of the same orientation add up.
+	NonZero,
+};
+
+/// Pixels [x_first, x_last] of a row.
+struct Span
+{
+	std::int64_t y;
+	std::int64_t x_first;
+	std::int64_t x_last;
+};
+
+/// Spans filling the rings of a polygon and covering their outline, clipped to a `width` by `height` image.
+///
+/// Pixel centers lie on integral coordinates. Rows are scanned with an active edge table,
+/// so that time is proportional to the number of edges and spans.
+[[nodiscard]] extern std::vector<Span> fill(
+	std::vector<std::vector<math::Vector>> const& rings,
+	FillRule const rule,
+	std::size_t const width,
+	std::size_t const height
+);
+
+/// Spans covering a line through the points of a path, `thickness` pixels wide with round joins and caps,
+/// clipped to a `width` by `height` image.
+[[nodiscard]] extern std::vector<Span> stroke(
+	std::vector<math::Vector> const& path,
+	std::size_t const thickness,
+	std::size_t const width,
+	std::size_t const height
+);
+}
+
+#endif
@@ -0,0 +1,361 @@
+#include "pyramid.hh"
+#include "pnm.hh"
+#include "raster.hh"
+#include "../parallel.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+
+
+namespace image::pyramid
+{
+namespace
+{
+/// Pixels of a halved level, or of a tile of a level, its rows pointing into those of the level.
+class Level final : public raster::Raster
+{
+public:
+	explicit Level(
+		std::size_t const width,
+		std::size_t const height,
+		std::size_t const channels,
+		std::size_t const bit_depth,
+		char const* const scratch_directory
+	)
+	{
+		set_scratch_directory(scratch_directory);
+		layout(width, height, channels, bit_depth);
+		allocate();
+	}
+
+	explicit Level(Image const& source, std::size_t const x, std::size_t const y, std::size_t const width, std::size_t const height)
+	{
+		layout(width, height, source.channels(), source.depth());
+
+		rows.resize(height);
+		for (std::size_t i = 0; i < height; i++)
+		{
+			rows[i] = source.row(y + i) + x * pixel_stride;
+		}
+	}
+
+	void open(std::istream&) & override
+	{
+		throw std::runtime_error("levels of a pyramid are not decoded");
+	}
+
+	/// Samples are stored as they are, in a Netpbm image.
+	void save(std::ostream& os) const& override
+	{
+		pnm::write(*this, os);
+	}
+};
+
+template <std::size_t SampleSize>
+[[nodiscard]] std::uint64_t load(std::uint8_t const* const sample) noexcept
+{
+	if constexpr (SampleSize == 1)
+	{
+		return sample[0];
+	}
+	else
+	{
+		return sample[0] << 8 | sample[1];
+	}
+}
+
+template <std::size_t SampleSize>
+void store(std::uint8_t* const sample, std::uint64_t const value) noexcept
+{
+	if constexpr (SampleSize == 1)
+	{
+		sample[0] = static_cast<std::uint8_t>(value);
+	}
+	else
+	{
+		sample[0] = static_cast<std::uint8_t>(value >> 8);
+		sample[1] = static_cast<std::uint8_t>(value);
+	}
+}
+
+/// Halve rows [begin, end) of a level from the next one, the last row or column of an odd dimension averaged with itself.
+///
+/// Colors are weighted by alpha, so that the colors of transparent pixels do not bleed into those around them.
+template <std::size_t SampleSize>
+void halve(Image const& source, Image const& target, std::size_t const begin, std::size_t const end) noexcept
+{
+	std::size_t const channels = source.channels();
+	std::size_t const pixel_size = channels * SampleSize;
+
+	bool const has_alpha = channels % 2 == 0;
+	std::size_t const color_channels = channels - has_alpha;
+	std::size_t const alpha_offset = color_channels * SampleSize;
+
+	std::size_t const last_x = source.width() - 1;
+	std::size_t const last_y = source.height() - 1;
+
+	for (std::size_t y = begin; y < end; y++)
+	{
+		std::uint8_t const* const top = source.row(2 * y);
+		std::uint8_t const* const bottom = source.row(std::min(2 * y + 1, last_y));
+		std::uint8_t* const out = target.row(y);
+
+		for (std::size_t x = 0; x < target.width(); x++)
+		{
+			std::size_t const left = 2 * x * pixel_size;
+			std::size_t const right = std::min(2 * x + 1, last_x) * pixel_size;
+
+			std::uint8_t const* const pixels[]{top + left, top + right, bottom + left, bottom + right};
+			std::uint8_t* const pixel = out + x * pixel_size;
+
+			if (!has_alpha)
+			{
+				for (std::size_t c = 0; c < channels; c++)
+				{
+					std::uint64_t sum = 0;
+					for (std::uint8_t const* const p : pixels)
+					{
+						sum += load<SampleSize>(p + c * SampleSize);
+					}
+
+					store<SampleSize>(pixel + c * SampleSize, (sum + 2) / 4);
+				}
+
+				continue;
+			}
+
+			std::uint64_t weights[std::size(pixels)];
+			std::uint64_t total = 0;
+
+			for (std::size_t i = 0; i < std::size(pixels); i++)
+			{
+				weights[i] = load<SampleSize>(pixels[i] + alpha_offset);
+				total += weights[i];
+			}
+
+			store<SampleSize>(pixel + alpha_offset, (total + 2) / 4);
+
+			for (std::size_t c = 0; c < color_channels; c++)
+			{
+				std::uint64_t sum = 0;
+				for (std::size_t i = 0; i < std::size(pixels); i++)
+				{
+					sum += load<SampleSize>(pixels[i] + c * SampleSize) * weights[i];
+				}
+
+				store<SampleSize>(pixel + c * SampleSize, total ? (sum + total / 2) / total : 0);
+			}
+		}
+	}
+}
+
+/// Whether every pixel of a tile is of the same color, or fully transparent.
+[[nodiscard]] bool is_blank(Image const& tile) noexcept
+{
+	std::size_t const channels = tile.channels();
+	std::size_t const sample_size = tile.depth() / 8;
+	std::size_t const pixel_size = channels * sample_size;
+	std::size_t const alpha_offset = (channels - 1) * sample_size;
+
+	std::uint8_t const* const first = tile.row(0);
+
+	bool is_uniform = true;
+	bool is_transparent = channels % 2 == 0;
+
+	for (std::size_t y = 0; y < tile.height(); y++)
+	{
+		std::uint8_t const* const row = tile.row(y);
+
+		for (std::size_t x = 0; x < tile.width(); x++)
+		{
+			std::uint8_t const* const pixel = row + x * pixel_size;
+
+			is_uniform = is_uniform && !std::memcmp(pixel, first, pixel_size);
+			is_transparent =
+				is_transparent
+				&& std::all_of(pixel + alpha_offset, pixel + pixel_size, [] (std::uint8_t const byte) { return !byte; });
+
+			if (!is_uniform && !is_transparent)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/// Write the tiles of a level, every thread taking the next tile left, so that blank ones leave none idle.
+[[nodiscard]] std::size_t cut(
+	Image const& level,
+	std::size_t const z,
+	Options const& options,
+	std::size_t const number_of_threads,
+	Writer const& write
+)
+{
+	std::size_t const tile_size = options.tile_size;
+	std::size_t const columns = (level.width() + tile_size - 1) / tile_size;
+	std::size_t const count = columns * ((level.height() + tile_size - 1) / tile_size);
+
+	std::atomic<std::size_t> next = 0;
+	std::atomic<std::size_t> written = 0;
+
+	std::size_t const bands = std::min(number_of_threads, count);
+
+	parallel::for_bands(
+		bands,
+		bands,
+		[&] (std::size_t, std::size_t, std::size_t)
+		{
+			try
+			{
+				for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+				{
+					std::size_t const x = i % columns * tile_size;
+					std::size_t const y = i / columns * tile_size;
+
+					Level const tile(
+						level,
+						x,
+						y,
+						std::min(tile_size, level.width() - x),
+						std::min(tile_size, level.height() - y)
+					);
+
+					if (options.without_blank_tiles && is_blank(tile))
+					{
+						continue;
+					}
+
+					write(tile, tile_name(options.name_template, z, i % columns, i / columns));
+					written.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			catch (...)
+			{
+				// The other threads take no tile past a failed one.
+				next = count;
+				throw;
+			}
+		}
+	);
+
+	return written;
+}
+}
+
+[[nodiscard]] std::size_t level_count(std::size_t width, std::size_t height, std::size_t const tile_size) noexcept
+{
+	std::size_t count = 1;
+
+	for (; width > tile_size || height > tile_size; count++)
+	{
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+
+	return count;
+}
+
+[[nodiscard]] std::string tile_name(std::string_view const name_template, std::size_t const z, std::size_t const x, std::size_t const y)
+{
+	std::string name;
+	name.reserve(name_template.size() + 16);
+
+	for (std::size_t i = 0; i < name_template.size(); i++)
+	{
+		if (name_template[i] == '{' && i + 2 < name_template.size() && name_template[i + 2] == '}')
+		{
+			constexpr char placeholders[] = "zxy";
+
+			char const* const placeholder = std::strchr(placeholders, name_template[i + 1]);
+			if (placeholder && *placeholder)
+			{
+				std::size_t const values[]{z, x, y};
+				name += std::to_string(values[placeholder - placeholders]);
+				i += 2;
+				continue;
+			}
+		}
+
+		name += name_template[i];
+	}
+
+	return name;
+}
+
+void validate(Options const& options)
+{
+	if (!options.tile_size)
+	{
+		throw std::runtime_error("tile size must be positive");
+	}
+
+	for (std::string_view const placeholder : {"{z}", "{x}", "{y}"})
+	{
+		if (options.name_template.find(placeholder) == std::string::npos)
+		{
+			throw std::runtime_error("tile name template must hold {z}, {x} and {y}");
+		}
+	}
+}
+
+std::size_t generate(Image& img, Options const& options, Writer const& write)
+{
+	validate(options);
+
+	img.expand();
+
+	std::size_t const number_of_threads = parallel::concurrency(options.number_of_threads);
+
+	// Every level is halved from the one cut before it, which is dropped then.
+	std::unique_ptr<Level> halved;
+	Image const* level = &img;
+
+	std::size_t written = 0;
+
+	for (std::size_t z = level_count(img.width(), img.height(), options.tile_size); z-- > 0;)
+	{
+		written += cut(*level, z, options, number_of_threads, write);
+
+		if (!z)
+		{
+			break;
+		}
+
+		auto next = std::make_unique<Level>(
+			(level->width() + 1) / 2,
+			(level->height() + 1) / 2,
+			img.channels(),
+			img.depth(),
+			options.scratch_directory
+		);
+
+		parallel::for_bands(
+			next->height(),
+			number_of_threads,
+			[&img, level, &next] (std::size_t const begin, std::size_t const end, std::size_t)
+			{
+				if (img.depth() == 8)
+				{
+					halve<1>(*level, *next, begin, end);
+				}
+				else
+				{
+					halve<2>(*level, *next, begin, end);
+				}
+			}
+		);
+
+		halved = std::move(next);
+		level = halved.get();
+	}
+
+	return written;
+}
+}
@@ -0,0 +1,56 @@
+#ifndef PNGR_IMAGE_PYRAMID_H_
+#define PNGR_IMAGE_PYRAMID_H_
+
+#include "image.hh"
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+
+namespace image::pyramid
+{
+constexpr std::size_t tile_size_default = 256;
+constexpr char const* name_template_default = "{z}/{x}/{y}.png";
+
+struct Options
+{
+	std::size_t tile_size = tile_size_default;
+
+	/// Path of a tile, `{z}`, `{x}` and `{y}` standing for its level and its column and row in it.
+	std::string name_template = name_template_default;
+
+	/// Leave out tiles of a single color, or fully transparent ones.
+	bool without_blank_tiles = false;
+
+	/// Threads encoding tiles and halving levels (0 - one per hardware thread).
+	std::size_t number_of_threads = 0;
+
+	/// Directory of the files holding halved levels, on the heap if null.
+	char const* scratch_directory = nullptr;
+};
+
+/// Encode a tile under given name, called from several threads at once.
+using Writer = std::function<void(Image const& tile, std::string const& name)>;
+
+/// Number of levels of a pyramid down to the one that fits in a single tile, that being level 0.
+[[nodiscard]] extern std::size_t level_count(std::size_t width, std::size_t height, std::size_t const tile_size) noexcept;
+
+/// Fill in the level, column and row of a tile in a name template.
+[[nodiscard]] extern std::string tile_name(std::string_view const name_template, std::size_t const z, std::size_t const x, std::size_t const y);
+
+/// Throws std::runtime_error unless the template names every tile differently.
+extern void validate(Options const& options);
+
+/// Cut an image into tiles at every level, the last one being the image itself
+/// and each one before it halved from the next one by averaging 2x2 pixels, weighted by their alpha.
+///
+/// Tiles at the right and bottom edges are as large as what is left of a level. Tiles are views of a level,
+/// written in parallel bands, and every level but the image is dropped once the next one is halved from it.
+/// Expands the image to samples of 8 or 16 bits.
+///
+/// Returns the number of tiles written.
+extern std::size_t generate(Image& img, Options const& options, Writer const& write);
+}
+
+#endif
@@ -0,0 +1,389 @@
+#include "qoi.hh"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <stdexcept>
+#include <vector>
+
+
+namespace image::qoi
+{
+namespace
+{
+constexpr char magic[4]{'q', 'o', 'i', 'f'};
+constexpr std::size_t header_size = 14;
+
+// Largest image decoded, as in the reference implementation.
+constexpr std::uint64_t max_pixels = 400'000'000;
+
+constexpr std::uint8_t op_index = 0x00;
+constexpr std::uint8_t op_diff = 0x40;
+constexpr std::uint8_t op_luma = 0x80;
+constexpr std::uint8_t op_run = 0xC0;
+constexpr std::uint8_t op_rgb = 0xFE;
+constexpr std::uint8_t op_rgba = 0xFF;
+constexpr std::uint8_t op_mask = 0xC0;
+
+constexpr std::size_t max_run = 62;
+
+constexpr std::uint8_t end_marker[8]{0, 0, 0, 0, 0, 0, 0, 1};
+
+struct Pixel
+{
+	std::uint8_t r = 0;
+	std::uint8_t g = 0;
+	std::uint8_t b = 0;
+	std::uint8_t a = 0xFF;
+
+	[[nodiscard]] bool operator==(Pixel const& other) const noexcept
+	{
+		return r == other.r && g == other.g && b == other.b && a == other.a;
+	}
+
+	/// Position in the array of recently seen pixels.
+	[[nodiscard]] std::size_t hash() const noexcept
+	{
+		return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+	}
+};
+
+/// Next byte of a stream, the data being cut short if there is none.
+[[nodiscard]] std::uint8_t next(std::streambuf& buffer)
+{
+	std::streambuf::int_type const ch = buffer.sbumpc();
+	if (std::streambuf::traits_type::eq_int_type(ch, std::streambuf::traits_type::eof()))
+	{
+		throw std::runtime_error("truncated qoi data");
+	}
+
+	return std::streambuf::traits_type::to_char_type(ch);
+}
+
+[[nodiscard]] std::uint32_t next_32(std::streambuf& buffer)
+{
+	std::uint32_t value = 0;
+	for (std::size_t i = 0; i < 4; i++)
+	{
+		value = value << 8 | next(buffer);
+	}
+
+	return value;
+}
+
+std::uint8_t* store_32(std::uint8_t* const data, std::uint32_t const value) noexcept
+{
+	for (std::size_t i = 0; i < 4; i++)
+	{
+		data[i] = value >> (24 - 8 * i);
+	}
+
+	return data + 4;
+}
+
+/// Recently seen pixels, by their hash.
+using Index = std::array<Pixel, 64>;
+
+/// Index before any pixel is seen: all zero, alpha included, unlike the pixel before the first one.
+[[nodiscard]] Index empty_index() noexcept
+{
+	Index index;
+	index.fill({0, 0, 0, 0});
+	return index;
+}
+
+/// Pixel of a row of 8-bit samples of one to four channels.
+[[nodiscard]] Pixel load(std::uint8_t const* const pixel, std::size_t const channels) noexcept
+{
+	switch (channels)
+	{
+	case 1:
+		return {pixel[0], pixel[0], pixel[0]};
+	case 2:
+		return {pixel[0], pixel[0], pixel[0], pixel[1]};
+	case 3:
+		return {pixel[0], pixel[1], pixel[2]};
+	default:
+		return {pixel[0], pixel[1], pixel[2], pixel[3]};
+	}
+}
+
+/// Encoder of the pixels of an image taken row after row, runs carrying over from one row to the next.
+class Encoder
+{
+	Index index = empty_index();
+	Pixel previous{};
+	std::size_t run = 0;
+
+public:
+	/// Largest size of the operations coding a row.
+	[[nodiscard]] static std::size_t max_size(std::size_t const width) noexcept
+	{
+		return width * 5 + 1;
+	}
+
+	/// Store the operations coding a row at `data`, ending any run if it is the last one, and return their end.
+	[[nodiscard]] std::uint8_t* encode(
+		std::uint8_t const* const row,
+		std::size_t const width,
+		std::size_t const channels,
+		bool const is_last,
+		std::uint8_t* data
+	) & noexcept
+	{
+		for (std::size_t x = 0; x < width; x++)
+		{
+			Pixel const pixel = load(row + x * channels, channels);
+
+			if (pixel == previous)
+			{
+				if (++run == max_run)
+				{
+					*data++ = op_run | (run - 1);
+					run = 0;
+				}
+
+				continue;
+			}
+
+			if (run)
+			{
+				*data++ = op_run | (run - 1);
+				run = 0;
+			}
+
+			std::size_t const position = pixel.hash();
+
+			if (index[position] == pixel)
+			{
+				*data++ = op_index | position;
+			}
+			else
+			if (pixel.a == previous.a)
+			{
+				index[position] = pixel;
+
+				// Differences wrap around, as samples do.
+				std::int8_t const dr = pixel.r - previous.r;
+				std::int8_t const dg = pixel.g - previous.g;
+				std::int8_t const db = pixel.b - previous.b;
+
+				int const dr_dg = dr - dg;
+				int const db_dg = db - dg;
+
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				{
+					*data++ = op_diff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+				}
+				else
+				if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+				{
+					*data++ = op_luma | (dg + 32);
+					*data++ = (dr_dg + 8) << 4 | (db_dg + 8);
+				}
+				else
+				{
+					*data++ = op_rgb;
+					*data++ = pixel.r;
+					*data++ = pixel.g;
+					*data++ = pixel.b;
+				}
+			}
+			else
+			{
+				index[position] = pixel;
+
+				*data++ = op_rgba;
+				*data++ = pixel.r;
+				*data++ = pixel.g;
+				*data++ = pixel.b;
+				*data++ = pixel.a;
+			}
+
+			previous = pixel;
+		}
+
+		if (is_last && run)
+		{
+			*data++ = op_run | (run - 1);
+			run = 0;
+		}
+
+		return data;
+	}
+};
+}
+
+[[nodiscard]] bool has_extension(std::string_view const path) noexcept
+{
+	return path.size() >= extension.size()
+		&& std::equal(
+			extension.begin(),
+			extension.end(),
+			path.end() - extension.size(),
+			[] (char const a, char const b) { return a == std::tolower(static_cast<unsigned char>(b)); }
+		);
+}
+
+void QOI::open(std::istream& is) &
+{
+	std::streambuf& buffer = *is.rdbuf();
+
+	for (char const ch : magic)
+	{
+		if (buffer.sbumpc() != ch)
+		{
+			throw std::runtime_error("invalid qoi signature");
+		}
+	}
+
+	std::uint32_t const width = next_32(buffer);
+	std::uint32_t const height = next_32(buffer);
+	std::uint8_t const channels = next(buffer);
+	std::uint8_t const space = next(buffer);
+
+	if (
+		!width
+		|| !height
+		|| std::uint64_t{width} * height > max_pixels
+		|| (channels != 3 && channels != 4)
+		|| space > static_cast<std::uint8_t>(Colorspace::Linear)
+	)
+	{
+		throw std::runtime_error("malformed qoi header");
+	}
+
+	colorspace = static_cast<Colorspace>(space);
+
+	layout(width, height, channels, 8);
+	allocate();
+
+	Index index = empty_index();
+	Pixel pixel{};
+	std::size_t run = 0;
+
+	for (std::size_t y = 0; y < height; y++)
+	{
+		std::uint8_t* const row = rows[y];
+
+		for (std::size_t x = 0; x < width; x++)
+		{
+			if (run)
+			{
+				run--;
+			}
+			else
+			{
+				std::uint8_t const op = next(buffer);
+
+				if (op == op_rgb)
+				{
+					pixel.r = next(buffer);
+					pixel.g = next(buffer);
+					pixel.b = next(buffer);
+				}
+				else
+				if (op == op_rgba)
+				{
+					pixel.r = next(buffer);
+					pixel.g = next(buffer);
+					pixel.b = next(buffer);
+					pixel.a = next(buffer);
+				}
+				else
+				if ((op & op_mask) == op_index)
+				{
+					pixel = index[op];
+				}
+				else
+				if ((op & op_mask) == op_diff)
+				{
+					pixel.r += ((op >> 4) & 0x03) - 2;
+					pixel.g += ((op >> 2) & 0x03) - 2;
+					pixel.b += (op & 0x03) - 2;
+				}
+				else
+				if ((op & op_mask) == op_luma)
+				{
+					std::uint8_t const differences = next(buffer);
+					int const dg = (op & 0x3F) - 32;
+
+					pixel.r += dg - 8 + (differences >> 4);
+					pixel.g += dg;
+					pixel.b += dg - 8 + (differences & 0x0F);
+				}
+				else
+				{
+					run = op & 0x3F;
+				}
+
+				index[pixel.hash()] = pixel;
+			}
+
+			std::uint8_t* const target = row + x * channels;
+			target[0] = pixel.r;
+			target[1] = pixel.g;
+			target[2] = pixel.b;
+
+			if (channels == 4)
+			{
+				target[3] = pixel.a;
+			}
+		}
+	}
+
+	for (std::uint8_t const byte : end_marker)
+	{
+		if (next(buffer) != byte)
+		{
+			throw std::runtime_error("malformed qoi data");
+		}
+	}
+}
+
+void QOI::save(std::ostream& os) const&
+{
+	write(*this, os, colorspace);
+}
+
+void write(Image const& img, std::ostream& os, Colorspace const colorspace)
+{
+	std::size_t const channels = img.channels();
+	std::size_t const width = img.width();
+	std::size_t const height = img.height();
+
+	if (img.depth() != 8 || channels < 1 || channels > 4)
+	{
+		throw std::runtime_error("qoi samples are 8 bits");
+	}
+
+	if (width > 0xFFFFFFFF || height > 0xFFFFFFFF)
+	{
+		throw std::runtime_error("image too large for qoi");
+	}
+
+	bool const has_alpha = channels == 2 || channels == 4;
+
+	std::vector<std::uint8_t> data(std::max(header_size, Encoder::max_size(width)));
+
+	std::uint8_t* end = std::copy(std::begin(magic), std::end(magic), data.data());
+	end = store_32(end, width);
+	end = store_32(end, height);
+	*end++ = has_alpha ? 4 : 3;
+	*end++ = static_cast<std::uint8_t>(colorspace);
+
+	os.write(reinterpret_cast<char const*>(data.data()), end - data.data());
+
+	Encoder encoder;
+
+	// Only one row of operations is held at a time.
+	for (std::size_t y = 0; y < height; y++)
+	{
+		end = encoder.encode(img.row(y), width, channels, y + 1 == height, data.data());
+		os.write(reinterpret_cast<char const*>(data.data()), end - data.data());
+	}
+
+	os.write(reinterpret_cast<char const*>(end_marker), sizeof(end_marker));
+	os.flush();
+}
+}
@@ -0,0 +1,44 @@
+#ifndef PNGR_IMAGE_QOI_H_
+#define PNGR_IMAGE_QOI_H_
+
+#include "raster.hh"
+
+#include <cstdint>
+#include <string_view>
+
+
+namespace image::qoi
+{
+constexpr std::string_view extension = ".qoi";
+
+/// How the samples are meant to be displayed, which the format only records.
+enum class Colorspace : std::uint8_t
+{
+	/// sRGB colors, linear alpha.
+	Srgb,
+	/// All channels linear.
+	Linear,
+};
+
+/// "Quite OK Image" of 8-bit RGB or RGBA samples: losslessly compressed in a single pass over the pixels,
+/// trading some of the size of a png for much faster coding.
+class QOI : public raster::Raster
+{
+	Colorspace colorspace = Colorspace::Srgb;
+
+public:
+	explicit QOI() noexcept = default;
+
+	void open(std::istream& is) & override;
+
+	void save(std::ostream& os) const& override;
+};
+
+/// Whether a path has the QOI extension.
+[[nodiscard]] extern bool has_extension(std::string_view const path) noexcept;
+
+/// Write an image of 8-bit samples without a palette, row by row: grays as RGB, with alpha if it has any.
+extern void write(Image const& img, std::ostream& os, Colorspace const colorspace = Colorspace::Srgb);
+}
+
+#endif
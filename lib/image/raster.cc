@@ -0,0 +1,189 @@
+#include "raster.hh"
+#include "convert.hh"
+#include "../memory.hh"
+#include "../parallel.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace image::raster
+{
+void Raster::layout(
+	std::size_t const width,
+	std::size_t const height,
+	std::size_t const channels,
+	std::size_t const bit_depth
+) & noexcept
+{
+	raster_width = width;
+	raster_height = height;
+
+	number_of_channels = channels;
+	this->bit_depth = bit_depth;
+
+	std::size_t const pixel_bits = channels * bit_depth;
+
+	pixel_mask = pixel_bits < 64 ? (static_cast<color::Value>(1) << pixel_bits) - 1 : ~color::Value{};
+	pixel_stride = pixel_bits / 8;
+}
+
+void Raster::index_rows(std::uint8_t* const base, std::size_t const row_size) &
+{
+	rows.resize(raster_height);
+	for (std::size_t i = 0; i < raster_height; i++)
+	{
+		rows[i] = base + i * row_size;
+	}
+}
+
+void Raster::allocate() &
+{
+	std::size_t const row_size = raster_width * pixel_stride;
+
+	// Pixel access may load a whole color::Value past the last pixel of a row.
+	pixels.resize(row_size * raster_height + sizeof(color::Value));
+	index_rows(pixels.data(), row_size);
+
+	release();
+}
+
+void Raster::release() & noexcept
+{
+}
+
+[[nodiscard]] std::size_t Raster::color_depth() const& noexcept
+{
+	return pixel_mask == ~color::Value{} ? pixel_mask : pixel_mask + 1;
+}
+
+[[nodiscard]] std::size_t Raster::width() const& noexcept
+{
+	return raster_width;
+}
+
+[[nodiscard]] std::size_t Raster::height() const& noexcept
+{
+	return raster_height;
+}
+
+[[nodiscard]] color::Value Raster::get(math::Vector const& position) const& noexcept
+{
+	return
+		memory::to_big_endian(
+			*reinterpret_cast<color::Value*>(&rows[position.y][position.x * pixel_stride]), pixel_stride
+		) & pixel_mask;
+}
+
+void Raster::set(math::Vector const& position, color::Value const value) const& noexcept
+{
+	color::Value& bytes = *reinterpret_cast<color::Value*>(&rows[position.y][position.x * pixel_stride]);
+	bytes = (bytes & ~pixel_mask) | (memory::to_big_endian(value, pixel_stride) & pixel_mask);
+}
+
+[[nodiscard]] std::uint8_t* Raster::row(std::size_t const y) const& noexcept
+{
+	return rows[y];
+}
+
+void Raster::convert(std::size_t const channels, std::size_t const bit_depth) &
+{
+	convert::Layout const source{number_of_channels, this->bit_depth};
+	convert::Layout const target{channels, bit_depth};
+
+	if (!convert::is_valid(target) || bit_depth < 8)
+	{
+		throw std::runtime_error("samples are 8 or 16 bits in this format");
+	}
+
+	if (channels == number_of_channels && bit_depth == this->bit_depth)
+	{
+		return;
+	}
+
+	std::size_t const source_row_size = raster_width * pixel_stride;
+	std::size_t const row_size = raster_width * channels * bit_depth / 8;
+
+	storage::Block converted(scratch_directory);
+	converted.resize(row_size * raster_height + sizeof(color::Value));
+
+	parallel::for_bands(
+		raster_height,
+		parallel::concurrency_for(std::max(source_row_size, row_size) * raster_height),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			std::vector<std::uint16_t> rgba(raster_width * 4);
+
+			for (std::size_t y = begin; y < end; y++)
+			{
+				convert::unpack(rows[y], source, raster_width, rgba.data());
+				convert::pack(rgba.data(), raster_width, target, &converted[y * row_size]);
+			}
+		}
+	);
+
+	pixels.swap(converted);
+	layout(raster_width, raster_height, channels, bit_depth);
+	index_rows(pixels.data(), row_size);
+
+	release();
+}
+
+void Raster::expand() &
+{
+	// Every sample is an intensity of 8 or 16 bits already.
+}
+
+void Raster::transform(transform::Operation const operation) &
+{
+	if (!transform::swaps_dimensions(operation))
+	{
+		transform::apply(operation, rows.data(), raster_width, raster_height, pixel_stride);
+		return;
+	}
+
+	std::size_t const target_width = raster_height;
+	std::size_t const target_height = raster_width;
+	std::size_t const row_size = target_width * pixel_stride;
+
+	storage::Block transposed(scratch_directory);
+	transposed.resize(row_size * target_height + sizeof(color::Value));
+
+	std::vector<std::uint8_t*> transposed_rows(target_height);
+	for (std::size_t y = 0; y < target_height; y++)
+	{
+		transposed_rows[y] = &transposed[y * row_size];
+	}
+
+	transform::apply(operation, rows.data(), raster_width, raster_height, pixel_stride, transposed_rows.data());
+
+	pixels.swap(transposed);
+	rows.swap(transposed_rows);
+
+	raster_width = target_width;
+	raster_height = target_height;
+
+	release();
+}
+
+[[nodiscard]] std::size_t Raster::frame_count() const& noexcept
+{
+	return 1;
+}
+
+[[nodiscard]] Image& Raster::frame(std::size_t const) & noexcept
+{
+	return *this;
+}
+
+void Raster::set_scratch_directory(char const* const directory) &
+{
+	scratch_directory = directory;
+
+	layout(0, 0, 1, 8);
+	pixels = storage::Block(directory);
+	rows.clear();
+
+	release();
+}
+}
@@ -0,0 +1,69 @@
+#ifndef PNGR_IMAGE_RASTER_H_
+#define PNGR_IMAGE_RASTER_H_
+
+#include "image.hh"
+#include "../storage.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace image::raster
+{
+/// Image of one to four interleaved channels of 8 or 16-bit big-endian samples, without a palette:
+/// the pixels of codecs whose files store samples as they are, or close to it.
+///
+/// Rows live in one block, unless a codec points them into memory of its own until they are rewritten.
+class Raster : public Image
+{
+protected:
+	std::size_t raster_width = 0;
+	std::size_t raster_height = 0;
+
+	storage::Block pixels;
+	std::vector<std::uint8_t*> rows;
+
+	// Where pixel blocks are memory-mapped, if anywhere.
+	char const* scratch_directory = nullptr;
+
+	color::Value pixel_mask = 0;
+	std::size_t pixel_stride = 0;
+
+	/// Set dimensions and sample layout, and derive pixel addressing from them.
+	void layout(std::size_t const width, std::size_t const height, std::size_t const channels, std::size_t const bit_depth) & noexcept;
+
+	/// Point rows `row_size` bytes apart from `base`.
+	void index_rows(std::uint8_t* const base, std::size_t const row_size) &;
+
+	/// Size the pixel block for the current layout and point rows into it.
+	void allocate() &;
+
+	/// Drop whatever rows pointed into before they were moved to the pixel block.
+	virtual void release() & noexcept;
+
+public:
+	[[nodiscard]] std::size_t color_depth() const& noexcept override;
+
+	[[nodiscard]] std::size_t width() const& noexcept override;
+	[[nodiscard]] std::size_t height() const& noexcept override;
+
+	[[nodiscard]] color::Value get(math::Vector const& position) const& noexcept override;
+	void set(math::Vector const& position, color::Value const value) const& noexcept override;
+
+	[[nodiscard]] std::uint8_t* row(std::size_t const y) const& noexcept override;
+
+	/// Samples stay of 8 or 16 bits.
+	void convert(std::size_t const channels, std::size_t const bit_depth) & override;
+	void expand() & override;
+	void transform(transform::Operation const operation) & override;
+
+	[[nodiscard]] std::size_t frame_count() const& noexcept override;
+	[[nodiscard]] Image& frame(std::size_t const i) & noexcept override;
+
+	/// Keep pixels in files memory-mapped in given directory (none - on the heap), dropping the current ones.
+	void set_scratch_directory(char const* const directory) &;
+};
+}
+
+#endif
@@ -0,0 +1,383 @@
+#include "stamp.hh"
+#include "../parallel.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+
+namespace image::stamp
+{
+namespace
+{
+void check_radius(std::size_t const radius)
+{
+	if (radius > max_radius)
+	{
+		throw std::runtime_error("marker radius exceeding maximum (" + std::to_string(max_radius) + ")");
+	}
+}
+
+[[nodiscard]] std::int64_t isqrt(std::int64_t const value) noexcept
+{
+	std::int64_t root = static_cast<std::int64_t>(std::sqrt(static_cast<double>(value)));
+
+	// Rounding of the floating point root is off by one at most.
+	while (root * root > value)
+	{
+		root--;
+	}
+
+	while ((root + 1) * (root + 1) <= value)
+	{
+		root++;
+	}
+
+	return root;
+}
+}
+
+Marker::Marker(std::vector<Span> spans) noexcept : runs(std::move(spans))
+{
+	std::stable_sort(runs.begin(), runs.end(), [] (Span const& a, Span const& b) { return a.y < b.y; });
+
+	if (runs.empty())
+	{
+		return;
+	}
+
+	top_row = runs.front().y;
+	bottom_row = runs.back().y;
+	left_column = runs.front().x;
+	right_column = runs.front().x + runs.front().length - 1;
+
+	for (Span const& span : runs)
+	{
+		left_column = std::min<std::int64_t>(left_column, span.x);
+		right_column = std::max<std::int64_t>(right_column, span.x + span.length - 1);
+		number_of_pixels += span.length;
+	}
+}
+
+[[nodiscard]] std::vector<Span> const& Marker::spans() const& noexcept
+{
+	return runs;
+}
+
+[[nodiscard]] std::int64_t Marker::top() const& noexcept
+{
+	return top_row;
+}
+
+[[nodiscard]] std::int64_t Marker::bottom() const& noexcept
+{
+	return bottom_row;
+}
+
+[[nodiscard]] std::int64_t Marker::left() const& noexcept
+{
+	return left_column;
+}
+
+[[nodiscard]] std::int64_t Marker::right() const& noexcept
+{
+	return right_column;
+}
+
+[[nodiscard]] std::size_t Marker::area() const& noexcept
+{
+	return number_of_pixels;
+}
+
+[[nodiscard]] Marker circle(std::size_t const radius)
+{
+	check_radius(radius);
+
+	std::int32_t const r = radius;
+
+	std::vector<Span> spans;
+	for (std::int32_t y = -r; y <= r; y++)
+	{
+		std::int32_t const half = isqrt(static_cast<std::int64_t>(r) * r - static_cast<std::int64_t>(y) * y);
+		spans.push_back(Span{y, -half, 2 * half + 1});
+	}
+
+	return Marker(std::move(spans));
+}
+
+[[nodiscard]] Marker square(std::size_t const radius)
+{
+	check_radius(radius);
+
+	std::int32_t const r = radius;
+
+	std::vector<Span> spans;
+	for (std::int32_t y = -r; y <= r; y++)
+	{
+		spans.push_back(Span{y, -r, 2 * r + 1});
+	}
+
+	return Marker(std::move(spans));
+}
+
+[[nodiscard]] Marker cross(std::size_t const radius, std::size_t const thickness)
+{
+	check_radius(radius);
+
+	std::int32_t const r = radius;
+	std::int32_t const side = 2 * r + 1;
+
+	// Bars are centered, a bar of even thickness leaning to the top left.
+	std::int32_t const bar = std::clamp<std::int32_t>(thickness, 1, side);
+	std::int32_t const bar_first = -bar / 2;
+	std::int32_t const bar_last = bar_first + bar - 1;
+
+	std::vector<Span> spans;
+	for (std::int32_t y = -r; y <= r; y++)
+	{
+		if (bar_first <= y && y <= bar_last)
+		{
+			spans.push_back(Span{y, -r, side});
+		}
+		else
+		{
+			spans.push_back(Span{y, bar_first, bar});
+		}
+	}
+
+	return Marker(std::move(spans));
+}
+
+[[nodiscard]] Marker sprite(Image& img)
+{
+	std::size_t const width = img.width();
+	std::size_t const height = img.height();
+
+	if (width > 2 * max_radius + 1 || height > 2 * max_radius + 1)
+	{
+		throw std::runtime_error("marker sprite exceeding maximum size (" + std::to_string(2 * max_radius + 1) + ")");
+	}
+
+	// Gray and alpha samples of 8 bits take any color type and bit depth, transparent palette entries included.
+	img.convert(2, 8);
+
+	// Transparency may come from a palette or a transparent color rather than an alpha channel,
+	// so it is told by the converted samples: a sprite without alpha is opaque throughout.
+	bool has_alpha = false;
+	for (std::size_t y = 0; y < height && !has_alpha; y++)
+	{
+		std::uint8_t const* const row = img.row(y);
+		for (std::size_t x = 0; x < width && !has_alpha; x++)
+		{
+			has_alpha = row[2 * x + 1] != 0xFF;
+		}
+	}
+
+	std::int32_t const x_center = width / 2;
+	std::int32_t const y_center = height / 2;
+
+	std::vector<Span> spans;
+	for (std::size_t y = 0; y < height; y++)
+	{
+		std::uint8_t const* const row = img.row(y);
+
+		auto const is_set = [row, has_alpha] (std::size_t const x) {
+			return row[2 * x + 1] >= 0x80 && (has_alpha || row[2 * x] >= 0x80);
+		};
+
+		for (std::size_t x = 0; x < width;)
+		{
+			if (!is_set(x))
+			{
+				x++;
+				continue;
+			}
+
+			std::size_t const begin = x;
+			while (x < width && is_set(x))
+			{
+				x++;
+			}
+
+			spans.push_back(Span{
+				static_cast<std::int32_t>(y) - y_center,
+				static_cast<std::int32_t>(begin) - x_center,
+				static_cast<std::int32_t>(x - begin),
+			});
+		}
+	}
+
+	return Marker(std::move(spans));
+}
+
+void stamp(
+	Image& img,
+	Marker const& marker,
+	std::vector<math::Vector> const& points,
+	color::Value const value,
+	mask::Mask const* const mask,
+	std::size_t const number_of_threads
+)
+{
+	if (mask)
+	{
+		mask::validate(*mask, img);
+	}
+
+	std::int64_t const width = img.width();
+	std::int64_t const height = img.height();
+
+	std::vector<Span> const& spans = marker.spans();
+
+	if (spans.empty() || !width || !height)
+	{
+		return;
+	}
+
+	// Bounds of the centers of markers reaching the image.
+	std::int64_t const first_row = -marker.bottom();
+	std::int64_t const end_row = height - marker.top();
+	std::int64_t const first_column = -marker.right();
+	std::int64_t const end_column = width - marker.left();
+
+	auto const is_visible = [=] (math::Vector const& point) {
+		return first_row <= point.y && point.y < end_row && first_column <= point.x && point.x < end_column;
+	};
+
+	// Counting sort by row, that keeps only the columns of points: `offsets` delimits those of every row.
+	std::vector<std::size_t> offsets(end_row - first_row + 1);
+	for (math::Vector const& point : points)
+	{
+		if (is_visible(point))
+		{
+			offsets[point.y - first_row + 1]++;
+		}
+	}
+
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	std::vector<std::int64_t> columns(offsets.back());
+	{
+		std::vector<std::size_t> next(offsets.begin(), std::prev(offsets.end()));
+		for (math::Vector const& point : points)
+		{
+			if (is_visible(point))
+			{
+				columns[next[point.y - first_row]++] = point.x;
+			}
+		}
+	}
+
+	std::size_t const pixel_bits = img.channels() * img.depth();
+	std::size_t const pixel_size = pixel_bits / 8;
+
+	// Samples are stored big-endian.
+	std::uint8_t pattern[sizeof(color::Value)]{};
+	for (std::size_t i = 0; i < pixel_size; i++)
+	{
+		pattern[i] = value >> (8 * (pixel_size - 1 - i));
+	}
+
+	auto const fill_run = [&img, &pattern, pixel_bits, pixel_size, value] (
+		std::int64_t const y,
+		std::int64_t const x_first,
+		std::int64_t const x_last
+	) {
+		// Packed pixels share bytes, only those of a single row, that a single band writes.
+		if (pixel_bits < 8)
+		{
+			for (std::int64_t x = x_first; x <= x_last; x++)
+			{
+				img.set(math::Vector{x, y}, value);
+			}
+
+			return;
+		}
+
+		std::uint8_t* const row = img.row(y);
+
+		if (pixel_size == 1)
+		{
+			std::memset(row + x_first, pattern[0], x_last - x_first + 1);
+			return;
+		}
+
+		for (std::int64_t x = x_first; x <= x_last; x++)
+		{
+			std::memcpy(row + x * pixel_size, pattern, pixel_size);
+		}
+	};
+
+	// Only the runs of a span that the mask sets are filled.
+	auto const fill = [mask, &fill_run] (std::int64_t const y, std::int64_t const x_first, std::int64_t const x_last) {
+		if (!mask)
+		{
+			fill_run(y, x_first, x_last);
+			return;
+		}
+
+		mask->runs(
+			y,
+			x_first,
+			x_last,
+			[&fill_run, y] (std::size_t const first, std::size_t const last)
+			{
+				fill_run(y, first, last);
+			}
+		);
+	};
+
+	std::size_t const bytes = columns.size() * marker.area() * std::max<std::size_t>(pixel_size, 1);
+
+	parallel::for_bands(
+		height,
+		number_of_threads ? number_of_threads : parallel::concurrency_for(bytes),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			std::int64_t const band_first = begin;
+			std::int64_t const band_end = end;
+
+			// Markers centered on these rows reach the band, and are clipped to it.
+			std::int64_t const center_first = std::max(band_first - marker.bottom(), first_row);
+			std::int64_t const center_end = std::min(band_end - marker.top(), end_row);
+
+			for (std::int64_t y_center = center_first; y_center < center_end; y_center++)
+			{
+				std::size_t const row = y_center - first_row;
+
+				for (std::size_t i = offsets[row]; i < offsets[row + 1]; i++)
+				{
+					std::int64_t const x_center = columns[i];
+
+					for (Span const& span : spans)
+					{
+						std::int64_t const y = y_center + span.y;
+						if (y < band_first)
+						{
+							continue;
+						}
+
+						if (y >= band_end)
+						{
+							break;
+						}
+
+						std::int64_t const x_first = std::max<std::int64_t>(x_center + span.x, 0);
+						std::int64_t const x_last = std::min<std::int64_t>(x_center + span.x + span.length, width) - 1;
+
+						if (x_first <= x_last)
+						{
+							fill(y, x_first, x_last);
+						}
+					}
+				}
+			}
+		}
+	);
+}
+}
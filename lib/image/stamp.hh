@@ -0,0 +1,79 @@
+#ifndef PNGR_IMAGE_STAMP_H_
+#define PNGR_IMAGE_STAMP_H_
+
+#include "image.hh"
+#include "mask.hh"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace image::stamp
+{
+constexpr std::size_t max_radius = 0x7FFF;
+
+/// Horizontal run of pixels of a marker, relative to its center.
+struct Span
+{
+	std::int32_t y;
+	std::int32_t x;
+	std::int32_t length;
+};
+
+/// Shape rasterised once into spans, then stamped at every point.
+class Marker
+{
+	std::vector<Span> runs;
+
+	// Inclusive bounds of the spans.
+	std::int64_t top_row = 0;
+	std::int64_t bottom_row = 0;
+	std::int64_t left_column = 0;
+	std::int64_t right_column = 0;
+
+	std::size_t number_of_pixels = 0;
+
+public:
+	/// Sort spans by row, and bound them.
+	explicit Marker(std::vector<Span> spans) noexcept;
+
+	[[nodiscard]] std::vector<Span> const& spans() const& noexcept;
+
+	[[nodiscard]] std::int64_t top() const& noexcept;
+	[[nodiscard]] std::int64_t bottom() const& noexcept;
+	[[nodiscard]] std::int64_t left() const& noexcept;
+	[[nodiscard]] std::int64_t right() const& noexcept;
+
+	[[nodiscard]] std::size_t area() const& noexcept;
+};
+
+/// Disc of pixels within `radius` of the center.
+[[nodiscard]] extern Marker circle(std::size_t const radius);
+
+/// Square of side `2 * radius + 1`.
+[[nodiscard]] extern Marker square(std::size_t const radius);
+
+/// Plus sign of arms `radius` long and `thickness` wide.
+[[nodiscard]] extern Marker cross(std::size_t const radius, std::size_t const thickness);
+
+/// Mask of a sprite centered on its middle pixel: its opaque pixels (alpha at least half the maximum)
+/// or, if every pixel is opaque, its bright ones (at least half the maximum intensity). Converts the sprite.
+[[nodiscard]] extern Marker sprite(Image& img);
+
+/// Fill the pixels of a marker centered on every point with a value, clipped to the image,
+/// and to the pixels a mask sets if one is given.
+///
+/// Points are sorted by row first, then bands of rows are stamped on separate threads
+/// (0 - one per mebibyte written, up to one per hardware thread).
+/// Throws std::runtime_error if the mask and the image differ in dimensions.
+extern void stamp(
+	Image& img,
+	Marker const& marker,
+	std::vector<math::Vector> const& points,
+	color::Value const value,
+	mask::Mask const* const mask = nullptr,
+	std::size_t const number_of_threads = 0
+);
+}
+
+#endif
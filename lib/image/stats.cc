@@ -0,0 +1,292 @@
+#include "stats.hh"
+#include "../parallel.hh"
+
+#include <cmath>
+#include <memory>
+
+
+namespace image::stats
+{
+namespace
+{
+/// Open-addressing set of pixel values, for pixels too wide for a bitmap of every value.
+class PixelSet
+{
+	std::unique_ptr<color::Value[]> slots;
+	std::size_t capacity = 0;
+	std::size_t count = 0;
+
+	bool has_zero = false;
+
+	[[nodiscard]] static std::size_t hash(color::Value value) noexcept
+	{
+		value ^= value >> 33;
+		value *= 0xFF51AFD7ED558CCD;
+		value ^= value >> 33;
+		return value;
+	}
+
+	void grow()
+	{
+		std::size_t const old_capacity = capacity;
+		std::unique_ptr<color::Value[]> const old_slots = std::move(slots);
+
+		capacity = old_capacity ? old_capacity * 2 : 1024;
+		slots = std::make_unique<color::Value[]>(capacity);
+		count = 0;
+
+		for (std::size_t i = 0; i < old_capacity; i++)
+		{
+			if (old_slots[i])
+			{
+				insert(old_slots[i]);
+			}
+		}
+	}
+
+public:
+	void insert(color::Value const value)
+	{
+		if (!value)
+		{
+			has_zero = true;
+			return;
+		}
+
+		if (2 * (count + 1) > capacity)
+		{
+			grow();
+		}
+
+		for (std::size_t i = hash(value) & (capacity - 1);; i = (i + 1) & (capacity - 1))
+		{
+			if (slots[i] == value)
+			{
+				return;
+			}
+
+			if (!slots[i])
+			{
+				slots[i] = value;
+				count++;
+				return;
+			}
+		}
+	}
+
+	void merge(PixelSet const& other)
+	{
+		has_zero |= other.has_zero;
+
+		for (std::size_t i = 0; i < other.capacity; i++)
+		{
+			if (other.slots[i])
+			{
+				insert(other.slots[i]);
+			}
+		}
+	}
+
+	[[nodiscard]] std::size_t size() const noexcept
+	{
+		return count + has_zero;
+	}
+};
+
+// Pixels of up to this many bits are counted in a bitmap of every possible value.
+constexpr std::size_t max_bitmap_pixel_bits = 24;
+
+struct Band
+{
+	std::vector<std::vector<std::uint64_t>> histograms;
+
+	std::vector<std::uint64_t> bitmap;
+	PixelSet set;
+};
+
+template <std::size_t BitDepth>
+void accumulate(Image const& img, std::size_t const y_begin, std::size_t const y_end, Band& band)
+{
+	std::size_t const width = img.width();
+	std::size_t const channels = img.channels();
+	bool const use_bitmap = !band.bitmap.empty();
+
+	std::vector<std::uint64_t>* const histograms = band.histograms.data();
+
+	for (std::size_t y = y_begin; y < y_end; y++)
+	{
+		std::uint8_t const* const row = img.row(y);
+
+		if constexpr (BitDepth < 8)
+		{
+			// Sub-byte depths only exist for single-channel images.
+			std::uint64_t* const histogram = histograms[0].data();
+			constexpr std::size_t mask = (1 << BitDepth) - 1;
+
+			for (std::size_t x = 0; x < width; x++)
+			{
+				std::size_t const shift = 8 - BitDepth - (x * BitDepth) % 8;
+				std::size_t const value = (row[x * BitDepth / 8] >> shift) & mask;
+
+				histogram[value]++;
+				band.bitmap[value / 64] |= static_cast<std::uint64_t>(1) << (value % 64);
+			}
+		}
+		else
+		{
+			constexpr std::size_t sample_size = BitDepth / 8;
+
+			for (std::size_t x = 0; x < width; x++)
+			{
+				std::uint8_t const* const pixel = row + x * channels * sample_size;
+				color::Value value = 0;
+
+				for (std::size_t c = 0; c < channels; c++)
+				{
+					std::size_t sample = pixel[c * sample_size];
+					if constexpr (sample_size == 2)
+					{
+						sample = (sample << 8) | pixel[c * sample_size + 1];
+					}
+
+					histograms[c][sample]++;
+					value = (value << BitDepth) | sample;
+				}
+
+				if (use_bitmap)
+				{
+					band.bitmap[value / 64] |= static_cast<std::uint64_t>(1) << (value % 64);
+				}
+				else
+				{
+					band.set.insert(value);
+				}
+			}
+		}
+	}
+}
+}
+
+[[nodiscard]] Statistics compute(Image const& img, std::size_t const number_of_threads)
+{
+	std::size_t const channels = img.channels();
+	std::size_t const bit_depth = img.depth();
+	std::size_t const pixel_bits = channels * bit_depth;
+	std::size_t const bins = static_cast<std::size_t>(1) << bit_depth;
+
+	std::vector<Band> bands(parallel::concurrency(number_of_threads));
+
+	std::size_t const number_of_bands = parallel::for_bands(
+		img.height(),
+		bands.size(),
+		[&img, &bands, channels, bins, pixel_bits, bit_depth] (std::size_t const begin, std::size_t const end, std::size_t const index)
+		{
+			Band& band = bands[index];
+			band.histograms.assign(channels, std::vector<std::uint64_t>(bins));
+
+			if (pixel_bits <= max_bitmap_pixel_bits)
+			{
+				band.bitmap.assign(((static_cast<std::size_t>(1) << pixel_bits) + 63) / 64, 0);
+			}
+
+			switch (bit_depth)
+			{
+			case 1:
+				accumulate<1>(img, begin, end, band);
+				break;
+			case 2:
+				accumulate<2>(img, begin, end, band);
+				break;
+			case 4:
+				accumulate<4>(img, begin, end, band);
+				break;
+			case 8:
+				accumulate<8>(img, begin, end, band);
+				break;
+			case 16:
+				accumulate<16>(img, begin, end, band);
+				break;
+			}
+		}
+	);
+
+	Band& total = bands.front();
+	for (std::size_t i = 1; i < number_of_bands; i++)
+	{
+		for (std::size_t c = 0; c < channels; c++)
+		{
+			for (std::size_t value = 0; value < bins; value++)
+			{
+				total.histograms[c][value] += bands[i].histograms[c][value];
+			}
+		}
+
+		for (std::size_t word = 0; word < total.bitmap.size(); word++)
+		{
+			total.bitmap[word] |= bands[i].bitmap[word];
+		}
+
+		total.set.merge(bands[i].set);
+	}
+
+	Statistics statistics{};
+	statistics.number_of_pixels = static_cast<std::uint64_t>(img.width()) * img.height();
+
+	if (total.bitmap.empty())
+	{
+		statistics.distinct_colors = total.set.size();
+	}
+	else
+	{
+		for (std::uint64_t const word : total.bitmap)
+		{
+			statistics.distinct_colors += __builtin_popcountll(word);
+		}
+	}
+
+	// Moments are derived from the merged histograms, so the per-pixel loop only has to count.
+	for (std::vector<std::uint64_t>& histogram : total.histograms)
+	{
+		Channel channel{};
+		channel.min = bins - 1;
+
+		double sum = 0;
+		double squares = 0;
+
+		for (std::size_t value = 0; value < bins; value++)
+		{
+			if (std::uint64_t const count = histogram[value]; count)
+			{
+				channel.min = std::min<color::Value>(channel.min, value);
+				channel.max = value;
+
+				sum += static_cast<double>(count) * value;
+				squares += static_cast<double>(count) * value * value;
+			}
+		}
+
+		if (statistics.number_of_pixels)
+		{
+			channel.mean = sum / statistics.number_of_pixels;
+			channel.stddev = std::sqrt(std::max(0.0, squares / statistics.number_of_pixels - channel.mean * channel.mean));
+		}
+		else
+		{
+			channel.min = 0;
+		}
+
+		channel.histogram = std::move(histogram);
+		statistics.channels.push_back(std::move(channel));
+	}
+
+	statistics.has_alpha = channels == 2 || channels == 4;
+	if (statistics.has_alpha)
+	{
+		std::vector<std::uint64_t> const& alpha = statistics.channels.back().histogram;
+		statistics.transparent_pixels = alpha.front();
+		statistics.opaque_pixels = alpha.back();
+	}
+
+	return statistics;
+}
+}
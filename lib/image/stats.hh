@@ -0,0 +1,42 @@
+#ifndef PNGR_IMAGE_STATS_H_
+#define PNGR_IMAGE_STATS_H_
+
+#include "image.hh"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace image::stats
+{
+struct Channel
+{
+	/// One bin per representable sample value.
+	std::vector<std::uint64_t> histogram;
+
+	color::Value min;
+	color::Value max;
+
+	double mean;
+	double stddev;
+};
+
+struct Statistics
+{
+	std::uint64_t number_of_pixels;
+	std::uint64_t distinct_colors;
+
+	bool has_alpha;
+	std::uint64_t transparent_pixels;
+	std::uint64_t opaque_pixels;
+
+	std::vector<Channel> channels;
+};
+
+/// Compute per-channel statistics over raw rows, splitting the rows into bands accumulated on separate threads.
+///
+/// The last channel of two- and four-channel images is considered to be alpha.
+[[nodiscard]] extern Statistics compute(Image const& img, std::size_t const number_of_threads = 0);
+}
+
+#endif
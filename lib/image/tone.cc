@@ -0,0 +1,363 @@
+#include "tone.hh"
+#include "../parallel.hh"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+
+namespace image::tone
+{
+namespace
+{
+/// Samples of a table file: `columns` values for each of its lines, row-major.
+struct TableFile
+{
+	std::size_t columns = 0;
+	std::vector<std::uint32_t> values;
+};
+
+[[nodiscard]] bool is_separator(char const ch) noexcept
+{
+	return ch == ',' || ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+[[nodiscard]] TableFile read_table(std::string const& path)
+{
+	std::ifstream is(path, std::ios::in | std::ios::binary);
+	if (!is)
+	{
+		throw std::runtime_error("could not open lookup table file for read");
+	}
+
+	std::string const data{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+
+	TableFile table;
+
+	for (std::size_t begin = 0; begin < data.size();)
+	{
+		std::size_t const line_end = std::min(data.find('\n', begin), data.size());
+		std::string_view line = std::string_view(data).substr(begin, line_end - begin);
+		begin = line_end + 1;
+
+		std::size_t columns = 0;
+		while (true)
+		{
+			while (!line.empty() && is_separator(line.front()))
+			{
+				line.remove_prefix(1);
+			}
+
+			// Blank lines and comments hold no values.
+			if (line.empty() || line.front() == '#')
+			{
+				break;
+			}
+
+			std::uint32_t value;
+			auto const [end, error] = std::from_chars(line.data(), line.data() + line.size(), value);
+			if (error != std::errc{} || (end != line.data() + line.size() && !is_separator(*end) && *end != '#'))
+			{
+				throw std::runtime_error("malformed lookup table file");
+			}
+
+			table.values.push_back(value);
+			line.remove_prefix(end - line.data());
+			columns++;
+		}
+
+		if (!columns)
+		{
+			continue;
+		}
+
+		if (table.columns && columns != table.columns)
+		{
+			throw std::runtime_error("malformed lookup table file (lines of different lengths)");
+		}
+
+		table.columns = columns;
+	}
+
+	return table;
+}
+
+/// Sample a step other than a table maps given one to.
+[[nodiscard]] std::uint32_t map(Step const& step, std::uint32_t const sample, std::uint32_t const max) noexcept
+{
+	switch (step.operation)
+	{
+	case Operation::Invert:
+		return max - sample;
+
+	case Operation::Gamma:
+		return std::lround(max * std::pow(static_cast<double>(sample) / max, 1 / step.gamma));
+
+	case Operation::Levels:
+	{
+		if (sample <= step.black)
+		{
+			return 0;
+		}
+
+		if (sample >= step.white)
+		{
+			return max;
+		}
+
+		std::uint64_t const range = step.white - step.black;
+		return ((sample - step.black) * std::uint64_t{max} + range / 2) / range;
+	}
+
+	case Operation::Threshold:
+		return sample >= step.level ? max : 0;
+
+	case Operation::Posterize:
+	{
+		std::uint64_t const intervals = step.level - 1;
+		std::uint64_t const kept = (sample * intervals + max / 2) / max;
+
+		return (kept * max + intervals / 2) / intervals;
+	}
+
+	case Operation::Table:
+	default:
+		return sample;
+	}
+}
+
+void validate(Step const& step, std::uint32_t const max)
+{
+	std::string const maximum = " (" + std::to_string(max) + ")";
+
+	switch (step.operation)
+	{
+	case Operation::Levels:
+		if (step.white > max)
+		{
+			throw std::runtime_error("white level exceeding maximum" + maximum);
+		}
+
+		if (step.black >= step.white)
+		{
+			throw std::runtime_error("black level not below white level");
+		}
+
+		break;
+
+	case Operation::Threshold:
+		if (step.level > max)
+		{
+			throw std::runtime_error("threshold exceeding maximum" + maximum);
+		}
+
+		break;
+
+	case Operation::Posterize:
+		if (step.level < 2 || step.level > max + 1)
+		{
+			throw std::runtime_error("posterize levels out of range (2 to " + std::to_string(max + 1) + ")");
+		}
+
+		break;
+
+	default:
+		break;
+	}
+}
+
+/// Lookup tables of every channel, `size` entries each, composed from all steps.
+[[nodiscard]] std::vector<std::uint16_t> compose(
+	std::vector<Step> const& steps,
+	std::size_t const channels,
+	std::size_t const size
+)
+{
+	std::uint32_t const max = size - 1;
+
+	// Alpha is the last of two or four channels.
+	std::size_t const color_channels = channels % 2 ? channels : channels - 1;
+
+	std::vector<std::uint16_t> tables(channels * size);
+	for (std::size_t c = 0; c < channels; c++)
+	{
+		for (std::size_t i = 0; i < size; i++)
+		{
+			tables[c * size + i] = i;
+		}
+	}
+
+	std::vector<std::uint16_t> curve(size);
+
+	for (Step const& step : steps)
+	{
+		if (step.operation != Operation::Table)
+		{
+			validate(step, max);
+
+			for (std::size_t i = 0; i < size; i++)
+			{
+				curve[i] = map(step, i, max);
+			}
+
+			for (std::size_t c = 0; c < color_channels; c++)
+			{
+				for (std::size_t i = 0; i < size; i++)
+				{
+					tables[c * size + i] = curve[tables[c * size + i]];
+				}
+			}
+
+			continue;
+		}
+
+		TableFile const file = read_table(step.path);
+
+		if (file.values.size() != size * file.columns)
+		{
+			throw std::runtime_error("lookup table of " + std::to_string(size) + " lines expected");
+		}
+
+		if (file.columns != 1 && file.columns != channels)
+		{
+			throw std::runtime_error(
+				"lookup table of 1 or " + std::to_string(channels) + " values per line expected"
+			);
+		}
+
+		if (*std::max_element(file.values.begin(), file.values.end()) > max)
+		{
+			throw std::runtime_error("lookup table value exceeding maximum (" + std::to_string(max) + ")");
+		}
+
+		std::size_t const mapped_channels = file.columns == 1 ? color_channels : channels;
+		for (std::size_t c = 0; c < mapped_channels; c++)
+		{
+			std::size_t const column = file.columns == 1 ? 0 : c;
+
+			for (std::size_t i = 0; i < size; i++)
+			{
+				tables[c * size + i] = file.values[tables[c * size + i] * file.columns + column];
+			}
+		}
+	}
+
+	return tables;
+}
+
+template <std::size_t Channels>
+void map_rows_8(
+	Image const& img,
+	std::uint8_t const* const tables,
+	std::size_t const begin,
+	std::size_t const end
+) noexcept
+{
+	std::size_t const width = img.width();
+
+	for (std::size_t y = begin; y < end; y++)
+	{
+		std::uint8_t* sample = img.row(y);
+
+		for (std::size_t x = 0; x < width; x++, sample += Channels)
+		{
+			for (std::size_t c = 0; c < Channels; c++)
+			{
+				sample[c] = tables[c * 0x100 + sample[c]];
+			}
+		}
+	}
+}
+
+template <std::size_t Channels>
+void map_rows_16(
+	Image const& img,
+	std::uint16_t const* const tables,
+	std::size_t const begin,
+	std::size_t const end
+) noexcept
+{
+	std::size_t const width = img.width();
+
+	for (std::size_t y = begin; y < end; y++)
+	{
+		std::uint8_t* sample = img.row(y);
+
+		for (std::size_t x = 0; x < width; x++)
+		{
+			for (std::size_t c = 0; c < Channels; c++, sample += 2)
+			{
+				std::uint16_t const mapped = tables[c * 0x10000 + (sample[0] << 8 | sample[1])];
+
+				sample[0] = mapped >> 8;
+				sample[1] = mapped;
+			}
+		}
+	}
+}
+
+template <std::size_t Channels>
+void map_rows(Image const& img, std::vector<std::uint16_t> const& tables)
+{
+	std::size_t const height = img.height();
+	std::size_t const bytes = img.width() * Channels * img.depth() / 8 * height;
+
+	if (img.depth() == 8)
+	{
+		std::vector<std::uint8_t> const narrow(tables.begin(), tables.end());
+
+		parallel::for_bands(
+			height,
+			parallel::concurrency_for(bytes),
+			[&] (std::size_t const begin, std::size_t const end, std::size_t)
+			{
+				map_rows_8<Channels>(img, narrow.data(), begin, end);
+			}
+		);
+
+		return;
+	}
+
+	parallel::for_bands(
+		height,
+		parallel::concurrency_for(bytes),
+		[&] (std::size_t const begin, std::size_t const end, std::size_t)
+		{
+			map_rows_16<Channels>(img, tables.data(), begin, end);
+		}
+	);
+}
+}
+
+void apply(Image& img, std::vector<Step> const& steps)
+{
+	// Indices and packed samples are no intensities to map.
+	img.expand();
+
+	std::size_t const channels = img.channels();
+	std::vector<std::uint16_t> const tables = compose(steps, channels, static_cast<std::size_t>(1) << img.depth());
+
+	switch (channels)
+	{
+	case 1:
+		map_rows<1>(img, tables);
+		break;
+
+	case 2:
+		map_rows<2>(img, tables);
+		break;
+
+	case 3:
+		map_rows<3>(img, tables);
+		break;
+
+	default:
+		map_rows<4>(img, tables);
+		break;
+	}
+}
+}
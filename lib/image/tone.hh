@@ -0,0 +1,55 @@
+#ifndef PNGR_IMAGE_TONE_H_
+#define PNGR_IMAGE_TONE_H_
+
+#include "image.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace image::tone
+{
+enum class Operation
+{
+	Invert,
+	Gamma,
+	Levels,
+	Threshold,
+	Posterize,
+	Table,
+};
+
+/// Step of a tone curve, every step mapping the samples the previous one produced.
+///
+/// Sample values are those of the image's bit depth.
+struct Step
+{
+	Operation operation;
+
+	/// Gamma: exponent of the inverse power normalized samples are raised to, above 1 brightening them.
+	double gamma = 1;
+
+	/// Levels: samples up to `black` become black and from `white` on white, those between being stretched.
+	std::uint32_t black = 0;
+	std::uint32_t white = 0;
+
+	/// Threshold: smallest sample made white, the others becoming black.
+	/// Posterize: number of evenly spaced values kept.
+	std::uint32_t level = 0;
+
+	/// Table: text file of a line for every sample value in ascending order, holding either a single value
+	/// mapping every color channel, or one value per channel, alpha included.
+	std::string path;
+};
+
+/// Map every sample through the composition of `steps`, precomputed as one lookup table per channel
+/// and applied to bands of rows in parallel.
+///
+/// Steps other than tables leave alpha as it is. Indexed and sub-byte samples are expanded to 8 bits first.
+///
+/// Throws std::runtime_error if a parameter or a table does not fit the image.
+extern void apply(Image& img, std::vector<Step> const& steps);
+}
+
+#endif
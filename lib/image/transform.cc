@@ -0,0 +1,271 @@
+#include "transform.hh"
+#include "../parallel.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace image::transform
+{
+namespace
+{
+// Side of the square tiles that transposition copies at once, in pixels:
+// a tile of source rows and the target rows it lands on stay in the L1 cache.
+constexpr std::size_t tile_size = 32;
+
+#ifdef __SSE2__
+/// Reverse the order of the pixels of a 16-byte block.
+template <std::size_t PixelSize>
+[[nodiscard]] inline __m128i reverse(__m128i value) noexcept
+{
+	if constexpr (PixelSize == 8)
+	{
+		return _mm_shuffle_epi32(value, 0x4E);
+	}
+	else
+	if constexpr (PixelSize == 4)
+	{
+		return _mm_shuffle_epi32(value, 0x1B);
+	}
+	else
+	{
+		// Reverse 16-bit words in each half, then swap the halves.
+		value = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(value, 0x1B), 0x1B), 0x4E);
+
+		if constexpr (PixelSize == 1)
+		{
+			value = _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+		}
+
+		return value;
+	}
+}
+#endif
+
+template <std::size_t PixelSize>
+void flip_row(std::uint8_t* const row, std::size_t const count) noexcept
+{
+	std::size_t left = 0;
+	std::size_t right = count * PixelSize;
+
+#ifdef __SSE2__
+	if constexpr (16 % PixelSize == 0)
+	{
+		// Blocks from both ends are reversed and swapped, until they would overlap.
+		for (; left + 32 <= right; left += 16, right -= 16)
+		{
+			__m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + left));
+			__m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + right - 16));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(row + left), reverse<PixelSize>(b));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(row + right - 16), reverse<PixelSize>(a));
+		}
+	}
+#endif
+
+	for (; left + PixelSize < right; left += PixelSize, right -= PixelSize)
+	{
+		std::uint8_t pixel[PixelSize];
+		std::memcpy(pixel, row + left, PixelSize);
+		std::memcpy(row + left, row + right - PixelSize, PixelSize);
+		std::memcpy(row + right - PixelSize, pixel, PixelSize);
+	}
+}
+
+/// Copy the tiles of source rows [y_begin, y_end) to their transposed position,
+/// reversing the order of target rows and/or columns.
+///
+/// Tiles are copied a row of tiles at a time, so that every tile spans at most `tile_size` rows of either image.
+template <std::size_t PixelSize>
+void transpose_tiles(
+	std::uint8_t* const* const rows,
+	std::size_t const width,
+	std::size_t const height,
+	std::uint8_t* const* const target,
+	bool const reverse_rows,
+	bool const reverse_columns,
+	std::size_t const y_begin,
+	std::size_t const y_end
+) noexcept
+{
+	for (std::size_t y_tile = y_begin; y_tile < y_end; y_tile += tile_size)
+	{
+		std::size_t const y_tile_end = std::min(y_end, y_tile + tile_size);
+
+		for (std::size_t x_tile = 0; x_tile < width; x_tile += tile_size)
+		{
+			std::size_t const x_end = std::min(width, x_tile + tile_size);
+
+			for (std::size_t y = y_tile; y < y_tile_end; y++)
+			{
+				std::uint8_t const* const source = rows[y];
+				std::size_t const column = reverse_columns ? height - 1 - y : y;
+
+				for (std::size_t x = x_tile; x < x_end; x++)
+				{
+					std::uint8_t* const row = target[reverse_rows ? width - 1 - x : x];
+					std::memcpy(row + column * PixelSize, source + x * PixelSize, PixelSize);
+				}
+			}
+		}
+	}
+}
+
+template <std::size_t PixelSize>
+void apply(
+	Operation const operation,
+	std::uint8_t* const* const rows,
+	std::size_t const width,
+	std::size_t const height,
+	std::uint8_t* const* const target
+)
+{
+	std::size_t const row_size = width * PixelSize;
+	std::size_t const number_of_threads = parallel::concurrency_for(row_size * height);
+
+	switch (operation)
+	{
+	case Operation::FlipHorizontal:
+		parallel::for_bands(
+			height,
+			number_of_threads,
+			[rows, width] (std::size_t const begin, std::size_t const end, std::size_t)
+			{
+				for (std::size_t y = begin; y < end; y++)
+				{
+					flip_row<PixelSize>(rows[y], width);
+				}
+			}
+		);
+		break;
+
+	case Operation::FlipVertical:
+	case Operation::Rotate180:
+		// Rows of the top half swap with their counterparts in the bottom half, the middle one staying in place.
+		parallel::for_bands(
+			(height + 1) / 2,
+			number_of_threads,
+			[rows, width, height, row_size, operation] (std::size_t const begin, std::size_t const end, std::size_t)
+			{
+				for (std::size_t y = begin; y < end; y++)
+				{
+					std::uint8_t* const top = rows[y];
+					std::uint8_t* const bottom = rows[height - 1 - y];
+
+					if (top != bottom)
+					{
+						std::swap_ranges(top, top + row_size, bottom);
+					}
+
+					if (operation == Operation::Rotate180)
+					{
+						flip_row<PixelSize>(top, width);
+						if (top != bottom)
+						{
+							flip_row<PixelSize>(bottom, width);
+						}
+					}
+				}
+			}
+		);
+		break;
+
+	case Operation::Rotate90:
+	case Operation::Rotate270:
+	case Operation::Transpose:
+	{
+		// Rotating clockwise reverses columns of the transposition, rotating counterclockwise its rows.
+		bool const reverse_rows = operation == Operation::Rotate270;
+		bool const reverse_columns = operation == Operation::Rotate90;
+
+		std::size_t const number_of_tile_rows = (height + tile_size - 1) / tile_size;
+
+		parallel::for_bands(
+			number_of_tile_rows,
+			number_of_threads,
+			[=] (std::size_t const begin, std::size_t const end, std::size_t)
+			{
+				transpose_tiles<PixelSize>(
+					rows,
+					width,
+					height,
+					target,
+					reverse_rows,
+					reverse_columns,
+					begin * tile_size,
+					std::min(height, end * tile_size)
+				);
+			}
+		);
+		break;
+	}
+	}
+}
+}
+
+[[nodiscard]] bool swaps_dimensions(Operation const operation) noexcept
+{
+	return operation == Operation::Rotate90 || operation == Operation::Rotate270 || operation == Operation::Transpose;
+}
+
+void flip_row(std::uint8_t* const row, std::size_t const count, std::size_t const pixel_size) noexcept
+{
+	switch (pixel_size)
+	{
+	case 1:
+		flip_row<1>(row, count);
+		break;
+	case 2:
+		flip_row<2>(row, count);
+		break;
+	case 3:
+		flip_row<3>(row, count);
+		break;
+	case 4:
+		flip_row<4>(row, count);
+		break;
+	case 6:
+		flip_row<6>(row, count);
+		break;
+	case 8:
+		flip_row<8>(row, count);
+		break;
+	}
+}
+
+void apply(
+	Operation const operation,
+	std::uint8_t* const* const rows,
+	std::size_t const width,
+	std::size_t const height,
+	std::size_t const pixel_size,
+	std::uint8_t* const* const target
+)
+{
+	switch (pixel_size)
+	{
+	case 1:
+		apply<1>(operation, rows, width, height, target);
+		break;
+	case 2:
+		apply<2>(operation, rows, width, height, target);
+		break;
+	case 3:
+		apply<3>(operation, rows, width, height, target);
+		break;
+	case 4:
+		apply<4>(operation, rows, width, height, target);
+		break;
+	case 6:
+		apply<6>(operation, rows, width, height, target);
+		break;
+	case 8:
+		apply<8>(operation, rows, width, height, target);
+		break;
+	}
+}
+}
@@ -0,0 +1,41 @@
+#ifndef PNGR_IMAGE_TRANSFORM_H_
+#define PNGR_IMAGE_TRANSFORM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace image::transform
+{
+enum class Operation
+{
+	/// Clockwise.
+	Rotate90,
+	Rotate180,
+	Rotate270,
+	FlipHorizontal,
+	FlipVertical,
+	/// Mirror along the main diagonal.
+	Transpose,
+};
+
+/// Whether an operation swaps width and height.
+[[nodiscard]] extern bool swaps_dimensions(Operation const operation) noexcept;
+
+/// Reverse the order of `count` pixels of `pixel_size` bytes in place.
+extern void flip_row(std::uint8_t* const row, std::size_t const count, std::size_t const pixel_size) noexcept;
+
+/// Apply an operation to `height` rows of `width` pixels of `pixel_size` bytes, on several threads for large images.
+///
+/// Operations keeping dimensions run in place, the others write `width` rows of `height` pixels to `target`.
+extern void apply(
+	Operation const operation,
+	std::uint8_t* const* const rows,
+	std::size_t const width,
+	std::size_t const height,
+	std::size_t const pixel_size,
+	std::uint8_t* const* const target = nullptr
+);
+}
+
+#endif
@@ -3,8 +3,13 @@
 
 #include "memory.hh"
 
+#include <algorithm>
+#include <cerrno>
 #include <istream>
 #include <ostream>
+#include <streambuf>
+#include <vector>
+#include <unistd.h>
 
 
 namespace io
@@ -29,6 +34,178 @@ static inline std::ostream& write(std::ostream& os, T const& value, std::size_t
 {
 	return os.write(reinterpret_cast<char const* const>(&value), count ? count : sizeof(value));
 }
+
+/// Read-only stream buffer over memory it does not own.
+class MemoryBuffer : public std::streambuf
+{
+public:
+	explicit MemoryBuffer(char const* const data, std::size_t const size) noexcept
+	{
+		char* const begin = const_cast<char*>(data);
+		setg(begin, begin, begin + size);
+	}
+
+protected:
+	pos_type seekoff(off_type const offset, std::ios::seekdir const direction, std::ios::openmode const) override
+	{
+		char* const base = direction == std::ios::beg ? eback() : direction == std::ios::cur ? gptr() : egptr();
+		if (offset < eback() - base || offset > egptr() - base)
+		{
+			return pos_type(off_type(-1));
+		}
+
+		setg(eback(), base + offset, egptr());
+		return pos_type(gptr() - eback());
+	}
+
+	pos_type seekpos(pos_type const position, std::ios::openmode const mode) override
+	{
+		return seekoff(off_type(position), std::ios::beg, mode);
+	}
+};
+
+/// Write-only stream buffer appending to a vector, so that its capacity is kept between uses.
+class VectorBuffer : public std::streambuf
+{
+	std::vector<char>& data;
+
+public:
+	explicit VectorBuffer(std::vector<char>& destination) noexcept : data(destination) {}
+
+protected:
+	int_type overflow(int_type const ch) override
+	{
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			data.push_back(traits_type::to_char_type(ch));
+		}
+
+		return traits_type::not_eof(ch);
+	}
+
+	std::streamsize xsputn(char const* const s, std::streamsize const count) override
+	{
+		data.insert(data.end(), s, s + count);
+		return count;
+	}
+};
+
+/// Stream buffer reading or writing a file descriptor, such as a pipe, through a buffer large enough
+/// that a whole image takes few system calls. It never seeks.
+class DescriptorBuffer : public std::streambuf
+{
+	static constexpr std::size_t buffer_size = static_cast<std::size_t>(1) << 20;
+
+	int fd;
+	std::vector<char> buffer;
+
+	/// Write all of given bytes, retrying on interruption and partial writes.
+	[[nodiscard]] bool write_all(char const* data, std::size_t size) noexcept
+	{
+		while (size)
+		{
+			ssize_t const count = ::write(fd, data, size);
+			if (count < 0 && errno == EINTR)
+			{
+				continue;
+			}
+
+			if (count <= 0)
+			{
+				return false;
+			}
+
+			data += count;
+			size -= count;
+		}
+
+		return true;
+	}
+
+public:
+	explicit DescriptorBuffer(int const fd) : fd(fd), buffer(buffer_size)
+	{
+		setp(buffer.data(), buffer.data() + buffer.size());
+	}
+
+	DescriptorBuffer(DescriptorBuffer const&) = delete;
+	DescriptorBuffer& operator=(DescriptorBuffer const&) = delete;
+
+	~DescriptorBuffer() override
+	{
+		sync();
+	}
+
+protected:
+	int_type underflow() override
+	{
+		ssize_t count;
+		do
+		{
+			count = ::read(fd, buffer.data(), buffer.size());
+		}
+		while (count < 0 && errno == EINTR);
+
+		if (count <= 0)
+		{
+			return traits_type::eof();
+		}
+
+		setg(buffer.data(), buffer.data(), buffer.data() + count);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	int_type overflow(int_type const ch) override
+	{
+		if (sync())
+		{
+			return traits_type::eof();
+		}
+
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			*pptr() = traits_type::to_char_type(ch);
+			pbump(1);
+		}
+
+		return traits_type::not_eof(ch);
+	}
+
+	std::streamsize xsputn(char const* const s, std::streamsize const count) override
+	{
+		// Writes of a buffer or more skip the buffer.
+		if (static_cast<std::size_t>(count) < buffer.size())
+		{
+			std::streamsize const fitting = std::min<std::streamsize>(count, epptr() - pptr());
+			std::copy(s, s + fitting, pptr());
+			pbump(fitting);
+
+			if (fitting == count)
+			{
+				return count;
+			}
+
+			if (sync())
+			{
+				return fitting;
+			}
+
+			std::copy(s + fitting, s + count, pptr());
+			pbump(count - fitting);
+			return count;
+		}
+
+		return !sync() && write_all(s, count) ? count : 0;
+	}
+
+	int sync() override
+	{
+		std::size_t const size = pptr() - pbase();
+		setp(buffer.data(), buffer.data() + buffer.size());
+
+		return write_all(buffer.data(), size) ? 0 : -1;
+	}
+};
 }
 
 #endif
@@ -0,0 +1,108 @@
+#ifndef PNGR_LOADED_H_
+#define PNGR_LOADED_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <tuple>
+#include <vector>
+
+
+namespace loaded
+{
+/// What tells versions of a file apart: replacing it or writing to it changes its inode or modification time,
+/// short of a write that keeps its size within the same nanosecond.
+struct Identity
+{
+	dev_t device;
+	ino_t inode;
+	std::int64_t seconds;
+	std::int64_t nanoseconds;
+	off_t size;
+
+	[[nodiscard]] bool operator==(Identity const& other) const& noexcept
+	{
+		return std::tie(device, inode, seconds, nanoseconds, size)
+			== std::tie(other.device, other.inode, other.seconds, other.nanoseconds, other.size);
+	}
+};
+
+/// Objects loaded from files, such as fonts and masks, shared between the operations that use them,
+/// as long as their file is unchanged, a running server seeing files replaced under the same path.
+///
+/// At most `capacity` objects are kept, the least recently used one dropped first.
+/// Holders of a dropped object keep it until they are done with it.
+template <typename T>
+class Cache
+{
+	struct Entry
+	{
+		Identity identity;
+		std::shared_ptr<T const> object;
+		std::uint64_t last_use;
+	};
+
+	std::size_t capacity;
+
+	std::mutex mutex;
+	std::vector<Entry> entries;
+	std::uint64_t uses = 0;
+
+public:
+	explicit Cache(std::size_t const capacity) noexcept : capacity(capacity)
+	{}
+
+	/// The object loaded from a file by `load(path)`, loading it unless it already was from the same version of the file.
+	///
+	/// A file that cannot be examined is left to `load` to report.
+	template <typename Load>
+	[[nodiscard]] std::shared_ptr<T const> get(std::string const& path, Load const& load) &
+	{
+		struct stat status;
+		if (stat(path.c_str(), &status))
+		{
+			return load(path);
+		}
+
+		Identity const identity{
+			status.st_dev, status.st_ino, status.st_mtim.tv_sec, status.st_mtim.tv_nsec, status.st_size
+		};
+
+		std::lock_guard const lock(mutex);
+
+		for (Entry& entry : entries)
+		{
+			if (entry.identity == identity)
+			{
+				entry.last_use = ++uses;
+				return entry.object;
+			}
+		}
+
+		std::shared_ptr<T const> object = load(path);
+
+		if (entries.size() >= capacity)
+		{
+			auto const oldest = std::min_element(
+				entries.begin(),
+				entries.end(),
+				[] (Entry const& a, Entry const& b)
+				{
+					return a.last_use < b.last_use;
+				}
+			);
+
+			entries.erase(oldest);
+		}
+
+		entries.push_back({identity, object, ++uses});
+		return object;
+	}
+};
+}
+
+#endif
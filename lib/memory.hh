@@ -3,6 +3,12 @@
 
 #include "arch.hh"
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
 
 namespace memory
 {
@@ -13,6 +19,16 @@ template <typename T>
 	std::size_t const zero_init_count = 0
 ) noexcept
 {
+	// The leading bytes of a pixel, as read and written by images, swap with a shift and a single instruction.
+	if constexpr (std::is_same_v<T, std::uint64_t>)
+	{
+		if (arch::is_little_endian() && !zero_init_count)
+		{
+			std::size_t const length = swap_count ? swap_count : sizeof(value);
+			return __builtin_bswap64(value << (64 - 8 * length));
+		}
+	}
+
 	std::size_t const size = zero_init_count ? zero_init_count : sizeof(value);
 	char result[size]{};
 
@@ -46,6 +62,120 @@ template <typename T>
 {
 	return arch::is_little_endian() ? value : swap_byte_order(value, swap_count, zero_init_count);
 }
+
+/// Allocator recycling freed blocks through thread-local free lists of power-of-two size classes.
+///
+/// A block may be freed by a thread other than the one that allocated it, it then joins the cache of the freeing thread.
+class Pool
+{
+	static constexpr std::size_t min_class_shift = 6;
+	static constexpr std::size_t class_count = 17;
+	static constexpr std::size_t max_cached_blocks = 8;
+
+	// Keeps the returned pointers aligned the way malloc does.
+	static constexpr std::size_t header_size = alignof(std::max_align_t);
+
+	struct Node
+	{
+		Node* next;
+	};
+
+	struct Cache
+	{
+		Node* heads[class_count]{};
+		std::size_t counts[class_count]{};
+
+		~Cache()
+		{
+			for (Node* head : heads)
+			{
+				while (head)
+				{
+					Node* const next = head->next;
+					std::free(reinterpret_cast<char*>(head) - header_size);
+					head = next;
+				}
+			}
+
+			destroyed() = true;
+		}
+	};
+
+	[[nodiscard]] static bool& destroyed() noexcept
+	{
+		thread_local bool value = false;
+		return value;
+	}
+
+	[[nodiscard]] static Cache& cache() noexcept
+	{
+		thread_local Cache instance;
+		return instance;
+	}
+
+	[[nodiscard]] static std::size_t size_class(std::size_t const size) noexcept
+	{
+		std::size_t index = 0;
+		while (index < class_count && (static_cast<std::size_t>(1) << (index + min_class_shift)) < size)
+		{
+			index++;
+		}
+
+		return index;
+	}
+
+public:
+	[[nodiscard]] static void* allocate(std::size_t const size) noexcept
+	{
+		std::size_t const index = size_class(size);
+
+		if (index < class_count && !destroyed())
+		{
+			Cache& blocks = cache();
+			if (Node* const head = blocks.heads[index]; head)
+			{
+				blocks.heads[index] = head->next;
+				blocks.counts[index]--;
+				return head;
+			}
+		}
+
+		std::size_t const block_size = index < class_count ? static_cast<std::size_t>(1) << (index + min_class_shift) : size;
+
+		char* const block = static_cast<char*>(std::malloc(header_size + block_size));
+		if (!block)
+		{
+			return nullptr;
+		}
+
+		*reinterpret_cast<std::size_t*>(block) = index;
+		return block + header_size;
+	}
+
+	static void deallocate(void* const ptr) noexcept
+	{
+		if (!ptr)
+		{
+			return;
+		}
+
+		char* const block = static_cast<char*>(ptr) - header_size;
+		std::size_t const index = *reinterpret_cast<std::size_t*>(block);
+
+		if (index < class_count && !destroyed())
+		{
+			Cache& blocks = cache();
+			if (blocks.counts[index] < max_cached_blocks)
+			{
+				blocks.heads[index] = new (ptr) Node{blocks.heads[index]};
+				blocks.counts[index]++;
+				return;
+			}
+		}
+
+		std::free(block);
+	}
+};
 }
 
 #endif
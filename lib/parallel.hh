@@ -0,0 +1,87 @@
+#ifndef PNGR_PARALLEL_H_
+#define PNGR_PARALLEL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+
+namespace parallel
+{
+/// Number of threads to use, given a requested one (0 - one per hardware thread).
+[[nodiscard]] static inline std::size_t concurrency(std::size_t const requested = 0) noexcept
+{
+	return requested ? requested : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/// Number of threads worth using for a pass over given number of bytes: one per mebibyte, up to `concurrency()`.
+[[nodiscard]] static inline std::size_t concurrency_for(std::size_t const bytes) noexcept
+{
+	return std::min(concurrency(), bytes / (static_cast<std::size_t>(1) << 20) + 1);
+}
+
+/// Split [0, count) into at most `number_of_bands` contiguous bands
+/// and call `function(begin, end, band)` for each of them, all but the first band on their own threads.
+///
+/// An exception escaping a band is rethrown once every band is done, that of the first band if several throw.
+///
+/// Returns the number of bands used.
+template <typename Function>
+std::size_t for_bands(std::size_t const count, std::size_t const number_of_bands, Function const& function)
+{
+	std::size_t const bands = std::max<std::size_t>(1, std::min(count, number_of_bands));
+	std::size_t const band_size = (count + bands - 1) / std::max<std::size_t>(1, bands);
+
+	std::vector<std::exception_ptr> errors(bands);
+
+	std::vector<std::thread> threads;
+	threads.reserve(bands - 1);
+
+	for (std::size_t band = 1; band < bands; band++)
+	{
+		std::size_t const begin = std::min(count, band * band_size);
+		std::size_t const end = std::min(count, begin + band_size);
+		threads.emplace_back(
+			[&function, &errors, begin, end, band]
+			{
+				try
+				{
+					function(begin, end, band);
+				}
+				catch (...)
+				{
+					errors[band] = std::current_exception();
+				}
+			}
+		);
+	}
+
+	try
+	{
+		function(0, std::min(count, band_size), 0);
+	}
+	catch (...)
+	{
+		errors.front() = std::current_exception();
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (std::exception_ptr const& error : errors)
+	{
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+	return bands;
+}
+}
+
+#endif
@@ -0,0 +1,343 @@
+#include "storage.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace storage
+{
+Block::Block(char const* const scratch_directory) noexcept : scratch_directory(scratch_directory)
+{
+}
+
+Block::Block(Block&& other) noexcept
+{
+	swap(other);
+}
+
+Block& Block::operator=(Block&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		scratch_directory = nullptr;
+		swap(other);
+	}
+
+	return *this;
+}
+
+Block::~Block()
+{
+	release();
+}
+
+void Block::release() noexcept
+{
+	if (fd >= 0)
+	{
+		if (bytes)
+		{
+			munmap(bytes, capacity);
+		}
+
+		close(fd);
+	}
+	else
+	{
+		std::free(bytes);
+	}
+
+	bytes = nullptr;
+	length = 0;
+	capacity = 0;
+	fd = -1;
+}
+
+void Block::reserve(std::size_t const size) &
+{
+	if (size <= capacity)
+	{
+		return;
+	}
+
+	if (!scratch_directory)
+	{
+		void* const reallocated = std::realloc(bytes, size);
+		if (!reallocated)
+		{
+			throw std::bad_alloc();
+		}
+
+		bytes = static_cast<std::uint8_t*>(reallocated);
+		capacity = size;
+		return;
+	}
+
+	if (fd < 0)
+	{
+		std::string path = std::string(scratch_directory) + "/pngr-XXXXXX";
+
+		fd = mkstemp(path.data());
+		if (fd < 0)
+		{
+			throw std::runtime_error("could not create scratch file");
+		}
+
+		unlink(path.c_str());
+	}
+
+	// The file grows sparse, reading as zeros until written.
+	if (ftruncate(fd, size))
+	{
+		throw std::runtime_error("could not grow scratch file");
+	}
+
+	// Mappings are shared with the file, so the bytes of the old one are in the new one.
+	void* const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED)
+	{
+		throw std::runtime_error("could not map scratch file");
+	}
+
+	if (bytes)
+	{
+		munmap(bytes, capacity);
+	}
+
+	bytes = static_cast<std::uint8_t*>(mapping);
+	capacity = size;
+}
+
+void Block::resize(std::size_t const size) &
+{
+	std::size_t const previous_capacity = capacity;
+
+	reserve(size);
+
+	// Bytes a scratch file grew by are zero already, and are left untouched.
+	std::size_t const end = fd >= 0 ? std::min(size, previous_capacity) : size;
+	if (end > length)
+	{
+		std::memset(bytes + length, 0, end - length);
+	}
+
+	length = size;
+}
+
+void Block::reset(std::size_t const size) &
+{
+	if (scratch_directory)
+	{
+		// Truncating the file drops its pages instead of writing zeros to each.
+		if (fd >= 0 && (ftruncate(fd, 0) || ftruncate(fd, capacity)))
+		{
+			throw std::runtime_error("could not clear scratch file");
+		}
+
+		length = std::min(size, capacity);
+		resize(size);
+		return;
+	}
+
+	reserve(size);
+	std::memset(bytes, 0, size);
+	length = size;
+}
+
+void Block::swap(Block& other) noexcept
+{
+	std::swap(scratch_directory, other.scratch_directory);
+	std::swap(bytes, other.bytes);
+	std::swap(length, other.length);
+	std::swap(capacity, other.capacity);
+	std::swap(fd, other.fd);
+}
+
+[[nodiscard]] std::uint8_t* Block::data() const& noexcept
+{
+	return bytes;
+}
+
+[[nodiscard]] std::size_t Block::size() const& noexcept
+{
+	return length;
+}
+
+[[nodiscard]] std::uint8_t& Block::operator[](std::size_t const i) const& noexcept
+{
+	return bytes[i];
+}
+
+[[nodiscard]] Mapping Mapping::open(char const* const path)
+{
+	int const fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		throw std::runtime_error("could not open input file for read");
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) || !status.st_size)
+	{
+		close(fd);
+		throw std::runtime_error("could not map input file");
+	}
+
+	// Private pages are copied on the first write, the file itself is never written.
+	void* const mapping = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED)
+	{
+		throw std::runtime_error("could not map input file");
+	}
+
+	Mapping result;
+	result.bytes = static_cast<std::uint8_t*>(mapping);
+	result.length = status.st_size;
+	return result;
+}
+
+[[nodiscard]] Mapping Mapping::create(int const fd, std::size_t const size)
+{
+	if (ftruncate(fd, size))
+	{
+		throw std::runtime_error("could not grow output file");
+	}
+
+	void* const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED)
+	{
+		throw std::runtime_error("could not map output file");
+	}
+
+	Mapping result;
+	result.bytes = static_cast<std::uint8_t*>(mapping);
+	result.length = size;
+	return result;
+}
+
+Mapping::Mapping(Mapping&& other) noexcept
+{
+	std::swap(bytes, other.bytes);
+	std::swap(length, other.length);
+}
+
+Mapping& Mapping::operator=(Mapping&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		std::swap(bytes, other.bytes);
+		std::swap(length, other.length);
+	}
+
+	return *this;
+}
+
+Mapping::~Mapping()
+{
+	release();
+}
+
+void Mapping::release() noexcept
+{
+	if (bytes)
+	{
+		munmap(bytes, length);
+	}
+
+	bytes = nullptr;
+	length = 0;
+}
+
+[[nodiscard]] std::uint8_t* Mapping::data() const& noexcept
+{
+	return bytes;
+}
+
+[[nodiscard]] std::size_t Mapping::size() const& noexcept
+{
+	return length;
+}
+
+Output::Output(char const* const path) : path(path)
+{
+	struct stat status;
+	if (stat(path, &status) == 0 && !S_ISREG(status.st_mode))
+	{
+		fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	}
+	else
+	{
+		static std::atomic<std::uint64_t> count = 0;
+
+		// A name left over by a process of the same id is skipped.
+		do
+		{
+			temporary_path =
+				this->path + ".tmp-" + std::to_string(getpid()) + '-' + std::to_string(count.fetch_add(1, std::memory_order_relaxed));
+
+			fd = ::open(temporary_path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+		}
+		while (fd < 0 && errno == EEXIST);
+	}
+
+	if (fd < 0)
+	{
+		throw std::runtime_error("could not open output file for write");
+	}
+}
+
+Output::~Output()
+{
+	if (fd >= 0)
+	{
+		close(fd);
+
+		if (!temporary_path.empty())
+		{
+			unlink(temporary_path.c_str());
+		}
+	}
+}
+
+[[nodiscard]] int Output::descriptor() const& noexcept
+{
+	return fd;
+}
+
+void Output::commit() &
+{
+	int const closed = close(fd);
+	fd = -1;
+
+	if (temporary_path.empty())
+	{
+		if (closed)
+		{
+			throw std::runtime_error("could not write output file");
+		}
+
+		return;
+	}
+
+	if (closed || rename(temporary_path.c_str(), path.c_str()))
+	{
+		unlink(temporary_path.c_str());
+		throw std::runtime_error("could not write output file");
+	}
+}
+}
@@ -0,0 +1,114 @@
+#ifndef PNGR_STORAGE_H_
+#define PNGR_STORAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace storage
+{
+/// Contiguous bytes, on the heap or, given a scratch directory, in a memory-mapped file there,
+/// so that blocks larger than memory are paged in and out by the kernel instead of swapping the host.
+///
+/// A scratch file is unlinked as soon as it is created, it never outlives the block.
+/// Like std::vector, a block keeps its capacity when shrunk and zero-fills the bytes it grows by.
+class Block
+{
+	char const* scratch_directory = nullptr;
+
+	std::uint8_t* bytes = nullptr;
+	std::size_t length = 0;
+	std::size_t capacity = 0;
+
+	int fd = -1;
+
+	void reserve(std::size_t const size) &;
+	void release() noexcept;
+
+public:
+	explicit Block(char const* const scratch_directory = nullptr) noexcept;
+
+	Block(Block&& other) noexcept;
+	Block& operator=(Block&& other) noexcept;
+
+	Block(Block const&) = delete;
+	Block& operator=(Block const&) = delete;
+
+	~Block();
+
+	/// Resize the block, keeping the bytes that fit.
+	void resize(std::size_t const size) &;
+
+	/// Resize the block, setting every byte to zero.
+	void reset(std::size_t const size) &;
+
+	void swap(Block& other) noexcept;
+
+	[[nodiscard]] std::uint8_t* data() const& noexcept;
+	[[nodiscard]] std::size_t size() const& noexcept;
+
+	[[nodiscard]] std::uint8_t& operator[](std::size_t const i) const& noexcept;
+};
+
+/// Whole file mapped into memory.
+///
+/// An opened file is mapped privately, so that writes to the mapping never reach it,
+/// and a created one is shared, so that writes to the mapping are what the file holds.
+class Mapping
+{
+	std::uint8_t* bytes = nullptr;
+	std::size_t length = 0;
+
+	void release() noexcept;
+
+public:
+	explicit Mapping() noexcept = default;
+
+	/// Map an existing file.
+	[[nodiscard]] static Mapping open(char const* const path);
+
+	/// Resize a file open for read and write to given size and map it, leaving the descriptor open.
+	[[nodiscard]] static Mapping create(int const fd, std::size_t const size);
+
+	Mapping(Mapping&& other) noexcept;
+	Mapping& operator=(Mapping&& other) noexcept;
+
+	Mapping(Mapping const&) = delete;
+	Mapping& operator=(Mapping const&) = delete;
+
+	~Mapping();
+
+	[[nodiscard]] std::uint8_t* data() const& noexcept;
+	[[nodiscard]] std::size_t size() const& noexcept;
+};
+
+/// Output file written next to its path and renamed over it once complete, so that the file at the path
+/// is never seen truncated, not even by a mapping of it that the output is made from.
+///
+/// Paths of anything but regular files, such as /dev/null or a pipe, are written in place.
+/// A new file gets the permissions of any file created, 0666 less the umask.
+class Output
+{
+	std::string path;
+	std::string temporary_path;
+
+	int fd = -1;
+
+public:
+	explicit Output(char const* const path);
+
+	Output(Output const&) = delete;
+	Output& operator=(Output const&) = delete;
+
+	/// Close the file, removing it unless it was committed.
+	~Output();
+
+	[[nodiscard]] int descriptor() const& noexcept;
+
+	/// Close the file and move it into place.
+	void commit() &;
+};
+}
+
+#endif
@@ -1,21 +1,46 @@
 #include "cli/cli.hh"
+#include "cli/codecs.hh"
+#include "cli/server.hh"
+#include "lib/image/compare.hh"
 #include "lib/image/png.hh"
-#include "lib/image/drawer.hh"
-
+#include "lib/image/pyramid.hh"
+#include "lib/image/stats.hh"
+#include "lib/async.hh"
+#include "lib/cache.hh"
+#include "lib/io.hh"
+#include "lib/storage.hh"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <filesystem>
 #include <optional>
+#include <vector>
+#include <unistd.h>
+
 
+// Whether the standard output carries the output image, which messages must then stay out of.
+static bool is_output_standard = false;
 
 [[noreturn]] static inline void graceful_exit() noexcept
 {
 	std::exit(0);
 }
 
+/// Print a message and exit, on the standard error with a failure status if the standard output carries the image,
+/// for the reader of the image to see it failed rather than decode the message.
 template <typename... Args>
 [[noreturn]] static inline void print_and_exit(Args const&... args) noexcept
 {
+	if (is_output_standard)
+	{
+		(std::cerr << ... << args) << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
 	(std::cout << ... << args) << std::endl;
 	graceful_exit();
 }
@@ -31,400 +56,649 @@ template <typename... Args>
 	print_and_exit(cli::help_message);
 }
 
-int main(int const argc, char* const argv[])
+static void print_info(std::vector<char const*> const& filepaths, bool const with_chunks)
 {
-	if (static_cast<std::size_t>(argc) <= cli::min_number_of_arguments)
-	{
-		print_help_and_exit();
-	}
-
-	cli::Mode mode = cli::Mode::None;
-
-	color::ChannelIndex channel;
+	std::ios::sync_with_stdio(false);
 
-	std::optional<color::Value> primary_value_opt;
-	std::optional<color::Value> secondary_value_opt;
+	for (char const* const filepath : filepaths)
+	{
+		std::cout << "{\"path\":" << cli::json_string(filepath);
 
-	bool with_diagonals = false;
+		try
+		{
+			std::ifstream is(filepath, std::ios::in | std::ios::binary);
+			if (!is.good())
+			{
+				throw std::runtime_error("could not open input file for read");
+			}
 
-	cli::Shape shape = cli::Shape::None;
+			image::png::Info const info = image::png::probe(is, with_chunks);
+			image::png::Metadata const& metadata = info.metadata;
 
-	math::Vector center(cli::center_default);
-	math::Vector start(cli::start_default);
-	math::Vector end(cli::end_default);
+			std::cout
+				<< ",\"width\":" << metadata.width
+				<< ",\"height\":" << metadata.height
+				<< ",\"bit_depth\":" << +metadata.bit_depth
+				<< ",\"color_type\":" << +metadata.color_type
+				<< ",\"compression_method\":" << +metadata.compression_method
+				<< ",\"filter_method\":" << +metadata.filter_method
+				<< ",\"interlace_method\":" << +metadata.interlace_method
+				<< ",\"palette_size\":" << info.palette_size;
 
-	math::Vector slice_dimensions(cli::slice_dimensions_default);
+			if (with_chunks)
+			{
+				std::cout << ",\"chunks\":[";
+				for (std::size_t j = 0; j < info.chunks.size(); j++)
+				{
+					image::png::Chunk const& chunk = info.chunks[j];
+					std::cout
+						<< (j ? "," : "")
+						<< "{\"type\":" << cli::json_string(std::string_view(chunk.type.data(), chunk.type.size()))
+						<< ",\"length\":" << chunk.length << '}';
+				}
+				std::cout << ']';
+			}
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << ",\"error\":" << cli::json_string(e.what());
+		}
 
-	char const* const filepath_in = argv[cli::input_file_index];
-	if (!std::strlen(filepath_in) || filepath_in[0] == '-')
-	{
-		print_help_and_exit();
+		std::cout << "}\n";
 	}
 
-	char const* filepath_out = nullptr;
+	std::cout.flush();
+}
 
-	std::size_t radius = cli::radius_default;
-	std::size_t thickness = cli::thickness_default;
-	std::size_t width = cli::width_default;
-	std::size_t height = cli::height_default;
+static void print_stats(cli::Arguments const& arguments)
+{
+	std::ios::sync_with_stdio(false);
 
-	char const* error_message = nullptr;
+	async::Prefetcher prefetcher(arguments.filepaths_in, arguments.prefetch);
 
-	try
+	image::png::PNG img;
+	img.set_scratch_directory(arguments.scratch_directory);
+
+	for (char const* const filepath : arguments.filepaths_in)
 	{
-		int option_index = cli::input_file_index;
-		int opt;
+		std::cout << "{\"path\":" << cli::json_string(filepath);
 
-		while ((opt = getopt_long(argc, argv, cli::short_options, cli::options, &option_index)) != -1)
+		try
 		{
-			switch (opt)
+			std::vector<char> const data = prefetcher.next();
+			io::MemoryBuffer buffer(data.data(), data.size());
+			std::istream is(&buffer);
+
+			img.open(is);
+
+			// Palette indices say nothing of colors, nor of the transparency of palette entries.
+			if (img.is_indexed())
 			{
-			case 0:
+				img.expand();
+			}
+
+			image::stats::Statistics const statistics = image::stats::compute(img, arguments.workers);
+
+			std::cout
+				<< ",\"width\":" << img.width()
+				<< ",\"height\":" << img.height()
+				<< ",\"bit_depth\":" << img.depth()
+				<< ",\"pixels\":" << statistics.number_of_pixels
+				<< ",\"distinct_colors\":" << statistics.distinct_colors;
+
+			if (statistics.has_alpha)
 			{
-				if (mode != cli::Mode::Draw)
-				{
-					print_help_and_exit();
-				}
+				std::cout
+					<< ",\"alpha\":{\"transparent\":" << statistics.transparent_pixels
+					<< ",\"opaque\":" << statistics.opaque_pixels
+					<< ",\"coverage\":"
+					<< (statistics.number_of_pixels
+						? 1 - static_cast<double>(statistics.transparent_pixels) / statistics.number_of_pixels
+						: 0)
+					<< '}';
+			}
 
-				math::Vector const position(cli::string_to_vector(optarg, cli::point_delimiter));
+			std::cout << ",\"channels\":[";
+			for (std::size_t i = 0; i < statistics.channels.size(); i++)
+			{
+				image::stats::Channel const& channel = statistics.channels[i];
 
-				char const* const option_name = cli::options[option_index].name;
+				std::cout
+					<< (i ? "," : "")
+					<< "{\"min\":" << channel.min
+					<< ",\"max\":" << channel.max
+					<< ",\"mean\":" << channel.mean
+					<< ",\"stddev\":" << channel.stddev
+					<< ",\"histogram\":[";
 
-				if (!std::strcmp(option_name, "start"))
+				for (std::size_t value = 0; value < channel.histogram.size(); value++)
 				{
-					start = position;
-					break;
+					std::cout << (value ? "," : "") << channel.histogram[value];
 				}
 
-				if (!std::strcmp(option_name, "end"))
-				{
-					if (shape == cli::Shape::Point)
-					{
-						print_help_and_exit();
-					}
+				std::cout << "]}";
+			}
+			std::cout << ']';
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << ",\"error\":" << cli::json_string(e.what());
+		}
 
-					end = position;
-					break;
-				}
+		std::cout << "}\n";
+	}
 
-				if (shape != cli::Shape::Circle)
-				{
-					print_help_and_exit();
-				}
+	std::cout.flush();
+}
 
-				if (!std::strcmp(option_name, "center"))
-				{
-					center = position;
-					break;
-				}
+/// Print a JSON number, or null for a value JSON has no number for.
+static void print_number(double const value)
+{
+	if (std::isfinite(value))
+	{
+		std::cout << value;
+	}
+	else
+	{
+		std::cout << "null";
+	}
+}
 
-				break;
-			}
+static void print_comparison(cli::Arguments const& arguments)
+{
+	std::ios::sync_with_stdio(false);
 
-			case cli::ShortOption::Out:
-				filepath_out = optarg;
-				break;
+	cli::Codecs first;
+	cli::Codecs second;
 
-			case cli::ShortOption::Filter:
-			{
-				if (mode != cli::Mode::None)
-				{
-					print_help_and_exit();
-				}
+	image::Image& a = first.open(arguments.filepaths_in[0]);
+	image::Image& b = second.open(arguments.filepaths_in[1]);
 
-				mode = cli::Mode::Filter;
+	bool const has_same_dimensions = a.width() == b.width() && a.height() == b.height();
 
-				std::size_t const length = std::strlen(optarg);
+	if (arguments.equality_only)
+	{
+		if (has_same_dimensions)
+		{
+			image::compare::match_layouts(a, b);
+		}
 
-				if (length < 1)
-				{
-					print_help_and_exit();
-				}
+		bool const is_equal = has_same_dimensions && image::compare::equal(a, b, arguments.workers);
+		std::cout << "{\"equal\":" << (is_equal ? "true" : "false") << "}\n";
+		std::cout.flush();
+		return;
+	}
 
-				if (length == 1)
-				{
-					if (char const* const ptr = std::strchr(cli::truecolor_channels, tolower(optarg[0])); ptr)
-					{
-						channel = ptr - cli::truecolor_channels;
-						break;
-					}
-				}
+	if (!has_same_dimensions)
+	{
+		throw std::runtime_error(
+			"images of different dimensions ("
+			+ std::to_string(a.width()) + 'x' + std::to_string(a.height()) + " and "
+			+ std::to_string(b.width()) + 'x' + std::to_string(b.height()) + ")"
+		);
+	}
 
-				channel = std::stoull(optarg);
-				break;
-			}
+	image::compare::match_layouts(a, b);
 
-			case cli::ShortOption::Draw:
-				if (mode != cli::Mode::None)
-				{
-					print_help_and_exit();
-				}
+	image::compare::Difference const difference = image::compare::compute(a, b, arguments.workers);
 
-				mode = cli::Mode::Draw;
+	std::cout
+		<< "{\"equal\":" << (difference.differing_pixels ? "false" : "true")
+		<< ",\"width\":" << a.width()
+		<< ",\"height\":" << a.height()
+		<< ",\"bit_depth\":" << a.depth()
+		<< ",\"pixels\":" << difference.number_of_pixels
+		<< ",\"differing_pixels\":" << difference.differing_pixels
+		<< ",\"bounds\":";
 
-				if (!std::strcmp(optarg, "point"))
-				{
-					shape = cli::Shape::Point;
-				}
-				else
-				if (!std::strcmp(optarg, "line"))
-				{
-					shape = cli::Shape::Line;
-				}
-				else
-				if (!std::strcmp(optarg, "rect") || !std::strcmp(optarg, "rectangle"))
-				{
-					shape = cli::Shape::Rectangle;
-				}
-				else
-				if (!std::strcmp(optarg, "square"))
-				{
-					shape = cli::Shape::Rectangle;
-				}
-				else
-				if (!std::strcmp(optarg, "circle"))
-				{
-					shape = cli::Shape::Circle;
-				}
-				else
-				{
-					print_help_and_exit();
-				}
+	if (difference.differing_pixels)
+	{
+		std::cout
+			<< "{\"x0\":" << difference.first.x
+			<< ",\"y0\":" << difference.first.y
+			<< ",\"x1\":" << difference.last.x
+			<< ",\"y1\":" << difference.last.y << '}';
+	}
+	else
+	{
+		std::cout << "null";
+	}
 
-				break;
+	double mse = 0;
+	for (image::compare::Channel const& channel : difference.channels)
+	{
+		mse += channel.mse / difference.channels.size();
+	}
 
-			case cli::ShortOption::Slice:
-				if (mode != cli::Mode::None)
-				{
-					print_help_and_exit();
-				}
+	std::cout << ",\"mse\":" << mse << ",\"psnr\":";
+	print_number(image::compare::psnr(mse, difference.max));
 
-				mode = cli::Mode::Slice;
-				slice_dimensions = cli::string_to_vector(optarg, cli::point_delimiter);
-				break;
+	std::cout << ",\"channels\":[";
+	for (std::size_t i = 0; i < difference.channels.size(); i++)
+	{
+		image::compare::Channel const& channel = difference.channels[i];
+
+		std::cout
+			<< (i ? "," : "")
+			<< "{\"max_error\":" << channel.max_error
+			<< ",\"mse\":" << channel.mse
+			<< ",\"psnr\":";
+		print_number(image::compare::psnr(channel.mse, difference.max));
+		std::cout << '}';
+	}
+	std::cout << "]}\n";
+	std::cout.flush();
 
-			case cli::ShortOption::Color:
-				primary_value_opt = std::stoull(optarg, nullptr, cli::is_hex(optarg) ? 16 : 10);
-				break;
+	if (arguments.filepath_out)
+	{
+		image::compare::highlight(a, b);
+		first.save(arguments.filepath_out, cli::output_format(arguments, arguments.filepath_out), false);
+	}
+}
 
-			case cli::ShortOption::Fill:
-				if (shape != cli::Shape::Rectangle && shape != cli::Shape::Circle)
-				{
-					print_help_and_exit();
-				}
+/// Decode the input once and write the tiles of its pyramid under the output directory, encoding them on worker threads.
+static void write_tiles(cli::Arguments const& arguments)
+{
+	char const* const filepath_in = arguments.filepaths_in.front();
+	std::filesystem::path const directory(arguments.filepath_out);
 
-				secondary_value_opt = std::stoull(optarg, nullptr, cli::is_hex(optarg) ? 16 : 10);
-				break;
+	cli::Codecs codecs;
+	codecs.set_scratch_directory(arguments.scratch_directory);
 
-			case cli::ShortOption::Thickness:
-				if (mode != cli::Mode::Slice && shape != cli::Shape::Rectangle && shape != cli::Shape::Circle)
-				{
-					print_help_and_exit();
-				}
+	image::Image* img;
 
-				thickness = std::stoull(optarg);
-				break;
+	if (!std::strcmp(filepath_in, "-"))
+	{
+		io::DescriptorBuffer buffer(STDIN_FILENO);
+		std::istream is(&buffer);
+		img = &codecs.open(is);
+	}
+	else
+	{
+		img = &codecs.open(filepath_in);
+	}
 
-			case cli::ShortOption::Radius:
-				if (shape != cli::Shape::Circle)
-				{
-					print_help_and_exit();
-				}
+	cli::Format const format = cli::output_format(arguments, arguments.tile_name);
 
-				radius = std::stoull(optarg);
-				break;
+	image::pyramid::generate(
+		*img,
+		cli::tile_options(arguments),
+		[&arguments, &directory, format] (image::Image const& tile, std::string const& name)
+		{
+			std::filesystem::path const path = directory / name;
+			std::filesystem::create_directories(path.parent_path());
+
+			storage::Output output(path.c_str());
 
-			case cli::ShortOption::Side:
 			{
-				if (shape != cli::Shape::Rectangle)
-				{
-					print_help_and_exit();
-				}
+				io::DescriptorBuffer buffer(output.descriptor());
+				std::ostream os(&buffer);
 
-				std::size_t const side = std::stoull(optarg);
-				end = start + math::Vector{side, side};
-				break;
-			}
+				cli::encode(tile, os, format, arguments.row_filter);
 
-			case cli::ShortOption::Width:
-				if (shape != cli::Shape::Line)
+				if (!os.flush())
 				{
-					print_help_and_exit();
+					throw std::runtime_error("could not write output file");
 				}
+			}
 
-				width = std::stoull(optarg);
-				break;
+			output.commit();
+		}
+	);
+}
 
-			case cli::ShortOption::Height:
-				if (shape != cli::Shape::Line)
-				{
-					print_help_and_exit();
-				}
+/// Read all bytes of a descriptor.
+static std::vector<char> read_all(int const fd)
+{
+	std::vector<char> data;
 
-				height = std::stoull(optarg);
-				break;
+	for (std::size_t done = 0;;)
+	{
+		data.resize(std::max<std::size_t>(done * 2, 1 << 16));
 
-			case cli::ShortOption::WithDiagonals:
-				if (shape != cli::Shape::Rectangle)
-				{
-					print_help_and_exit();
-				}
+		ssize_t const count = read(fd, data.data() + done, data.size() - done);
+		if (count < 0 && errno == EINTR)
+		{
+			continue;
+		}
 
-				with_diagonals = true;
-				break;
+		if (count < 0)
+		{
+			throw std::runtime_error("could not read input");
+		}
 
-			case cli::ShortOption::Help:
-			case '?':
-			default:
-				print_help_and_exit();
-				break;
-			}
+		if (!count)
+		{
+			data.resize(done);
+			return data;
 		}
+
+		done += count;
 	}
-	catch (std::out_of_range const& e)
-	{
-		error_message = "argument out of bounds";
-	}
-	catch (std::invalid_argument const& e)
+}
+
+/// Apply the operation to every input, overlapping reads of the upcoming inputs and writes of the previous outputs.
+static void process_batch(cli::Arguments const& arguments)
+{
+	std::filesystem::path const directory(arguments.filepath_out);
+	if (std::error_code error; !std::filesystem::is_directory(directory, error))
 	{
-		error_message = "invalid argument";
+		print_error_and_exit("output path must be a directory when given several inputs");
 	}
-	catch (std::exception const& e)
+
+	async::Prefetcher prefetcher(arguments.filepaths_in, arguments.prefetch);
+	async::Writer writer(arguments.prefetch);
+
+	cli::Codecs codecs;
+	codecs.set_scratch_directory(arguments.scratch_directory);
+	codecs.set_row_filter(arguments.row_filter);
+
+	// The operation is hashed once, every input forking the hash.
+	std::optional<cache::Cache> cache;
+	hash::Hasher operation_hasher;
+
+	if (arguments.cache_directory)
 	{
-		error_message = e.what();
+		try
+		{
+			cache.emplace(arguments.cache_directory, arguments.cache_size.value_or(cli::cache_size_default));
+			cli::hash_operation(arguments, operation_hasher);
+		}
+		catch (std::exception const& e)
+		{
+			print_error_and_exit(e.what());
+		}
 	}
 
-	if (error_message)
+	for (char const* const filepath : arguments.filepaths_in)
 	{
-		print_error_and_exit(error_message);
+		try
+		{
+			std::vector<char> const data = prefetcher.next();
+
+			cli::Format const format = cli::output_format(arguments, filepath);
+			std::filesystem::path const output_path = directory / std::filesystem::path(filepath).filename();
+
+			hash::Digest key{};
+
+			if (cache)
+			{
+				hash::Hasher hasher = operation_hasher;
+				hasher.update_value(format);
+				hasher.update(data.data(), data.size());
+				key = hasher.digest();
+
+				if (std::vector<char> output; cache->fetch(key, output))
+				{
+					writer.write(output_path, std::move(output));
+					continue;
+				}
+			}
+
+			io::MemoryBuffer input_buffer(data.data(), data.size());
+			std::istream is(&input_buffer);
+
+			cli::apply(arguments, codecs.open(is));
+
+			std::vector<char> output;
+			io::VectorBuffer output_buffer(output);
+			std::ostream os(&output_buffer);
+
+			codecs.save(os, format, arguments.with_optimization);
+
+			if (cache)
+			{
+				cache->store(key, output.data(), output.size());
+			}
+
+			writer.write(output_path, std::move(output));
+		}
+		catch (cli::InvalidUsage const& e)
+		{
+			print_help_and_exit();
+		}
+		catch (std::exception const& e)
+		{
+			std::cout << "error: " << filepath << ": " << e.what() << '\n';
+		}
 	}
 
-	if (!filepath_out)
+	for (std::string const& filepath : writer.finish())
 	{
-		print_error_and_exit("no output file specified");
+		std::cout << "error: " << filepath << ": could not write output file\n";
 	}
 
-	if (!primary_value_opt.has_value())
+	std::cout.flush();
+}
+
+/// Whether arguments send the output to the standard output, told before parsing them so that usage errors are covered.
+[[nodiscard]] static bool has_standard_output(int const argc, char* const argv[]) noexcept
+{
+	for (int i = 1; i < argc; i++)
 	{
-		print_error_and_exit("no primary color specified");
+		bool const is_out = !std::strcmp(argv[i], "--out") || !std::strcmp(argv[i], "-o");
+
+		if ((is_out && i + 1 < argc && !std::strcmp(argv[i + 1], "-")) || !std::strcmp(argv[i], "--out=-"))
+		{
+			return true;
+		}
 	}
 
-	color::Value const primary_value = primary_value_opt.value();
+	return false;
+}
 
-	bool const is_secondary_value_specified = secondary_value_opt.has_value();
-	color::Value const secondary_value = secondary_value_opt.value_or(color::Value{});
+int main(int const argc, char* const argv[])
+{
+	is_output_standard = has_standard_output(argc, argv);
 
-	std::ifstream is(filepath_in, std::ios::in | std::ios::binary);
-	if (!is.good())
+	if (static_cast<std::size_t>(argc) <= cli::min_number_of_arguments)
 	{
-		print_error_and_exit("could not open input file for read");
+		print_help_and_exit();
 	}
 
-	image::png::PNG img;
+	cli::Arguments arguments;
 
 	try
 	{
-		img.open(is);
+		arguments = cli::parse(argc, argv);
 	}
-	catch (std::runtime_error const& e)
+	catch (cli::InvalidUsage const& e)
+	{
+		print_help_and_exit();
+	}
+	catch (std::exception const& e)
 	{
 		print_error_and_exit(e.what());
 	}
 
-	std::size_t channels = img.channels();
-	if (mode == cli::Mode::Filter && channel >= channels)
+	switch (arguments.mode)
 	{
-		print_error_and_exit("channel index exceeding maximum (", channels, ")");
+	case cli::Mode::Info:
+		print_info(arguments.filepaths_in, arguments.with_chunks);
+		graceful_exit();
+
+	case cli::Mode::Stats:
+		print_stats(arguments);
+		graceful_exit();
+
+	case cli::Mode::Compare:
+		try
+		{
+			print_comparison(arguments);
+		}
+		catch (std::exception const& e)
+		{
+			print_error_and_exit(e.what());
+		}
+
+		graceful_exit();
+
+	case cli::Mode::Tiles:
+		try
+		{
+			write_tiles(arguments);
+		}
+		catch (std::exception const& e)
+		{
+			print_error_and_exit(e.what());
+		}
+
+		graceful_exit();
+
+	case cli::Mode::Serve:
+		try
+		{
+			cli::serve(arguments.socket_path, arguments.workers);
+		}
+		catch (std::exception const& e)
+		{
+			print_error_and_exit(e.what());
+		}
+
+	default:
+		break;
 	}
 
-	std::size_t const color_depth = img.color_depth();
-	if (primary_value >= color_depth || secondary_value >= color_depth)
+	if (arguments.filepaths_in.size() > 1)
 	{
-		print_error_and_exit("color value exceeding maximum (", color_depth, ")");
+		process_batch(arguments);
+		graceful_exit();
 	}
 
-	image::Drawer dw(img);
-
-	switch (mode)
+	char const* const filepath_in = arguments.filepaths_in.front();
+	bool const is_standard_input = !std::strcmp(filepath_in, "-");
+	if (filepath_in[0] == '-' && !is_standard_input)
 	{
-	case cli::Mode::Filter:
-		dw.color_filter(channel, primary_value);
-		break;
+		print_help_and_exit();
+	}
 
-	case cli::Mode::Slice:
-		dw.slice(slice_dimensions.x, slice_dimensions.y, thickness, primary_value);
-		break;
+	cli::Format const format = cli::output_format(arguments, arguments.filepath_out);
+	bool const is_standard_output = !std::strcmp(arguments.filepath_out, "-");
 
-	case cli::Mode::Draw:
-		switch (shape)
+	std::optional<cache::Cache> cache;
+	hash::Digest key{};
+
+	// The standard input is read whole when cached, since it is hashed before it is decoded.
+	std::vector<char> input;
+
+	if (arguments.cache_directory)
+	{
+		try
 		{
-		case cli::Shape::Point:
-			dw.point(start, primary_value);
-			break;
+			cache.emplace(arguments.cache_directory, arguments.cache_size.value_or(cli::cache_size_default));
 
-		case cli::Shape::Line:
-			dw.line(start, end, primary_value, width, height);
-			break;
+			hash::Hasher hasher;
+			cli::hash_operation(arguments, hasher);
+			hasher.update_value(format);
 
-		case cli::Shape::Rectangle:
-			if (!is_secondary_value_specified)
+			if (is_standard_input)
 			{
-				dw.rectangle(start, end, thickness, primary_value, with_diagonals);
+				input = read_all(STDIN_FILENO);
+				hasher.update(input.data(), input.size());
 			}
 			else
 			{
-				dw.rectangle_filled(start, end, thickness, primary_value, secondary_value, with_diagonals);
+				storage::Mapping const mapping = storage::Mapping::open(filepath_in);
+				hasher.update(mapping.data(), mapping.size());
 			}
-			break;
 
-		case cli::Shape::Circle:
-			if (start != end || start != cli::start_default)
-			{
-				if (radius != cli::radius_default)
-				{
-					print_error_and_exit("circle bounds (start, end) and radius cannot specified together");
-				}
-
-				if (!is_secondary_value_specified)
-				{
-					dw.circle(start, end, thickness, primary_value);
-				}
-				else
-				{
-					dw.circle_filled(start, end, thickness, primary_value, secondary_value);
-				}
-				break;
-			}
+			key = hasher.digest();
 
-			if (!is_secondary_value_specified)
+			if (is_standard_output ? cache->fetch(key, STDOUT_FILENO) : cache->fetch(key, arguments.filepath_out))
 			{
-				dw.circle(center, radius, thickness, primary_value);
-			}
-			else
-			{
-				dw.circle_filled(center, radius, thickness, primary_value, secondary_value);
+				graceful_exit();
 			}
+		}
+		catch (std::exception const& e)
+		{
+			print_error_and_exit(e.what());
+		}
+	}
 
-			break;
+	cli::Codecs codecs;
+	codecs.set_scratch_directory(arguments.scratch_directory);
+	codecs.set_row_filter(arguments.row_filter);
 
-		case cli::Shape::None:
-		default:
-			break;
-		}
+	image::Image* img;
 
-		break;
+	try
+	{
+		// A pipe is read once through, its signature consumed by the decoder rather than peeked at by seeking,
+		// unless it was read whole to be hashed.
+		if (cache && is_standard_input)
+		{
+			io::MemoryBuffer buffer(input.data(), input.size());
+			std::istream is(&buffer);
+			img = &codecs.open(is);
+		}
+		else
+		if (is_standard_input)
+		{
+			io::DescriptorBuffer buffer(STDIN_FILENO);
+			std::istream is(&buffer);
+			img = &codecs.open(is);
+		}
+		else
+		{
+			img = &codecs.open(filepath_in);
+		}
+	}
+	catch (std::runtime_error const& e)
+	{
+		print_error_and_exit(e.what());
+	}
 
-	case cli::Mode::None:
-	default:
+	try
+	{
+		cli::apply(arguments, *img);
+	}
+	catch (cli::InvalidUsage const& e)
+	{
 		print_help_and_exit();
-		break;
 	}
-
-	std::ofstream os(filepath_out, std::ios::out | std::ios::binary);
+	catch (std::exception const& e)
+	{
+		print_error_and_exit(e.what());
+	}
 
 	try
 	{
-		img.save(os);
+		if (is_standard_output)
+		{
+			io::DescriptorBuffer buffer(STDOUT_FILENO);
+			std::ostream os(&buffer);
+
+			if (cache)
+			{
+				// Encoded in memory first, so that the bytes written are also those stored.
+				std::vector<char> output;
+				io::VectorBuffer output_buffer(output);
+				std::ostream output_stream(&output_buffer);
+
+				codecs.save(output_stream, format, arguments.with_optimization);
+
+				os.write(output.data(), output.size());
+				cache->store(key, output.data(), output.size());
+			}
+			else
+			{
+				codecs.save(os, format, arguments.with_optimization);
+			}
+
+			if (!os.flush())
+			{
+				throw std::runtime_error("could not write output");
+			}
+		}
+		else
+		{
+			codecs.save(arguments.filepath_out, format, arguments.with_optimization);
+
+			if (cache)
+			{
+				cache->store(key, arguments.filepath_out);
+			}
+		}
 	}
 	catch (std::exception const& e)
 	{
@@ -0,0 +1,94 @@
+#include "../lib/image/qoi.hh"
+#include "../lib/io.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+struct Case
+{
+	char const* name;
+
+	/// Samples of the image, row after row.
+	std::vector<std::uint8_t> samples;
+
+	/// The image as the reference encoder codes it.
+	std::vector<std::uint8_t> encoded;
+};
+
+// Images whose pixels hash to the position of a zero entry of the index, which holds no pixel seen yet.
+Case const cases[]{
+	{
+		"transparent black first",
+		{0, 0, 0, 0, 0, 0, 0, 0},
+		{
+			'q', 'o', 'i', 'f', 0, 0, 0, 2, 0, 0, 0, 1, 4, 0,
+			0x00, 0xC0,
+			0, 0, 0, 0, 0, 0, 0, 1,
+		},
+	},
+	{
+		"opaque black after red",
+		{0xFF, 0, 0, 0, 0, 0},
+		{
+			'q', 'o', 'i', 'f', 0, 0, 0, 2, 0, 0, 0, 1, 3, 0,
+			0x5A, 0x7A,
+			0, 0, 0, 0, 0, 0, 0, 1,
+		},
+	},
+};
+
+[[nodiscard]] bool check(Case const& test)
+{
+	io::MemoryBuffer buffer(reinterpret_cast<char const*>(test.encoded.data()), test.encoded.size());
+	std::istream is(&buffer);
+
+	image::qoi::QOI img;
+	img.open(is);
+
+	std::size_t const row_size = img.width() * img.channels();
+	if (img.height() * row_size != test.samples.size())
+	{
+		std::cerr << test.name << ": decoded " << img.width() << 'x' << img.height() << 'x' << img.channels() << '\n';
+		return false;
+	}
+
+	for (std::size_t y = 0; y < img.height(); y++)
+	{
+		if (std::memcmp(img.row(y), test.samples.data() + y * row_size, row_size))
+		{
+			std::cerr << test.name << ": decoded samples differ in row " << y << '\n';
+			return false;
+		}
+	}
+
+	std::ostringstream os;
+	img.save(os);
+
+	std::string const encoded = os.str();
+	if (encoded != std::string(test.encoded.begin(), test.encoded.end()))
+	{
+		std::cerr << test.name << ": encoded bytes differ\n";
+		return false;
+	}
+
+	return true;
+}
+}
+
+int main()
+{
+	bool passed = true;
+	for (Case const& test : cases)
+	{
+		passed = check(test) && passed;
+	}
+
+	return passed ? 0 : 1;
+}